@@ -1,6 +1,7 @@
 #pragma once
 
 #include <iostream>
+#include <map>
 #include <regex>
 
 #include <nlohmann/json.hpp>
@@ -83,7 +84,26 @@ namespace SpiceQL {
 
 
       /**
-       * @brief get kernel list from all instances of a key 
+       * @brief get kernel lists from key for only a subset of kernel types
+       *
+       * Like get(std::string), except only the regex groups that belong to the
+       * requested kernel types are expanded. Kernel type groups not in kernelTypes
+       * are dropped before evaluation, and for kernel types in the qualities map
+       * only the listed quality groups are kept. Kernel types not in the qualities
+       * map keep all of their qualities.
+       *
+       * @param pointer key or JSON pointer to subgroup on
+       * @param kernelTypes list of kernel types to evaluate (e.g. ck, spk, sclk)
+       * @param qualities map of kernel type to the list of qualities to evaluate
+       * @return nlohmann::json JSON subgroup with only the requested kernel types
+       */
+      nlohmann::json get(std::string pointer,
+                         std::vector<std::string> kernelTypes,
+                         std::map<std::string, std::vector<std::string>> qualities = {});
+
+
+      /**
+       * @brief get kernel list from all instances of a key
        *
        * Searches recursively for all instances of the input key 
        * and returns a new merged JSON object with values of the 
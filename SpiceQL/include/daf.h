@@ -0,0 +1,82 @@
+#pragma once
+/**
+ * @file
+ *
+ * Native reader for NAIF Double precision Array Files (DAF), the binary
+ * container used by SPK, CK and binary PCK kernels.
+ *
+ * Only the file record and the summary records are read, the file is memory
+ * mapped and nothing is furnished into the CSPICE kernel pool. None of these
+ * functions touch global state, so they can be called from any number of threads.
+ *
+ **/
+
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace SpiceQL {
+
+  /**
+   * @brief Descriptor of a single DAF array (segment)
+   *
+   * For SPK and CK files the double components are the segment's start and stop times,
+   * ephemeris seconds past J2000 for SPKs and encoded spacecraft clock ticks for CKs.
+   *
+   * SPK integer components are target, center, frame, data type, begin address and end address.
+   * CK integer components are instrument, frame, data type, angular velocity flag,
+   * begin address and end address.
+   */
+  struct DafSegment {
+    //! double precision components of the summary
+    std::vector<double> dc;
+    //! integer components of the summary
+    std::vector<int> ic;
+  };
+
+
+  /**
+   * @brief Contents of a DAF's summary records
+   */
+  struct DafSummaries {
+    //! kernel architecture from the ID word, e.g. "SPK", "CK" or "PCK"
+    std::string type;
+    //! number of double components per summary
+    int nd = 0;
+    //! number of integer components per summary
+    int ni = 0;
+    //! every segment in the file, in file order
+    std::vector<DafSegment> segments;
+  };
+
+
+  /**
+   * @brief Read the segment summaries of a DAF
+   *
+   * Reads the file record and walks the linked list of summary records.
+   * Both LTL-IEEE and BIG-IEEE files are supported on any host,
+   * files written before the binary format ID existed are read as native.
+   *
+   * @param path path to a binary DAF kernel
+   * @returns the file's type and segment summaries
+   * @throws std::invalid_argument if the file is not a DAF or uses an unsupported binary format
+   */
+  DafSummaries readDafSummaries(std::string path);
+
+
+  /**
+   * @brief Get the coverage of every body in SPK or CK summaries
+   *
+   * Segments are grouped on their first integer component (the SPK target or CK instrument)
+   * and each body's segment bounds are merged into a sorted list of disjoint intervals,
+   * the same as spkcov_c or a segment level ckcov_c would give.
+   *
+   * Times are left in the file's units, CK intervals are encoded SCLK ticks and have to be
+   * converted to ephemeris time by the caller.
+   *
+   * @param summaries summaries read with readDafSummaries
+   * @returns map of body/instrument ID to merged coverage intervals
+   */
+  std::map<int, std::vector<std::pair<double, double>>> getDafCoverage(const DafSummaries &summaries);
+}
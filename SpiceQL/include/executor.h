@@ -0,0 +1,224 @@
+#pragma once
+/**
+ * @file
+ *
+ * Executor that runs all CSPICE work on a single thread.
+ *
+ * CSPICE keeps its kernel pool and error state in globals, so only one thread can
+ * use it at a time. With the executor on, SpiceQL functions that touch CSPICE hand their
+ * work to one thread owned by the executor and wait for the result, so they can be
+ * called from any thread. Work that doesn't touch CSPICE, like cache lookups in the
+ * Memo functions, stays on the calling thread.
+ *
+ **/
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+
+namespace SpiceQL {
+
+  /**
+   * @brief Singleton that owns the thread CSPICE work runs on
+   *
+   * Tasks are queued in a lock free multiple producer, single consumer queue and run in
+   * the order they were submitted. Tasks submitted from the executor thread itself run inline,
+   * so SpiceQL functions can call each other without deadlocking.
+   *
+   * The executor is off unless $SPICEQL_SPICE_EXECUTOR is true or it is turned on with setEnabled.
+   * When it is off every task runs inline on the calling thread.
+   */
+  class SpiceExecutor {
+    public:
+
+    /**
+     * @brief Get the executor
+     *
+     * @return SpiceExecutor& the singleton
+     */
+    static SpiceExecutor &getInstance();
+
+
+    /**
+     * @brief Queue a task to run on the executor thread
+     *
+     * Exceptions thrown by the task are rethrown by the future's get().
+     * If the executor is off or this is the executor thread, the task runs before returning.
+     *
+     * @param task callable with no arguments
+     * @return std::future with the task's result
+     */
+    template <typename F>
+    std::future<std::invoke_result_t<F>> submit(F task) {
+      using Result = std::invoke_result_t<F>;
+      auto packaged = std::make_shared<std::packaged_task<Result()>>(std::move(task));
+      std::future<Result> result = packaged->get_future();
+
+      // push refuses the task once the executor is turned off, it runs here instead
+      if (isExecutorThread() || !push([packaged]() { (*packaged)(); })) {
+        (*packaged)();
+      }
+      return result;
+    }
+
+
+    /**
+     * @brief Run a task on the executor thread and wait for its result
+     *
+     * @param task callable with no arguments
+     * @return the task's result
+     */
+    template <typename F>
+    std::invoke_result_t<F> run(F task) {
+      if (!isEnabled() || isExecutorThread()) {
+        return task();
+      }
+      return submit(std::move(task)).get();
+    }
+
+
+    /**
+     * @brief Turn the executor on or off
+     *
+     * Turning it on starts the executor thread. Turning it off stops the thread once the
+     * queue is empty, tasks queued while it was stopping are run by the calling thread and
+     * tasks submitted after it is off run on the thread that submitted them.
+     *
+     * @param enabled true to run CSPICE work on the executor thread
+     */
+    void setEnabled(bool enabled);
+
+
+    /**
+     * @brief Hold the executor between tasks so the process can fork
+     *
+     * Waits for the running task to finish and parks the executor thread, tasks submitted
+     * meanwhile stay queued. The executor can't be turned on or off until resumeAfterFork
+     * or resetAfterFork is called. Does nothing to the thread if the executor is off or
+     * this is the executor thread.
+     */
+    void pauseForFork();
+
+
+    /**
+     * @brief Let the executor run queued tasks again, call in the parent after forking
+     */
+    void resumeAfterFork();
+
+
+    /**
+     * @brief Start a new executor in a forked child, call in the child after forking
+     *
+     * The child only has the thread that forked, so the executor's thread and queue are
+     * replaced and the tasks other threads had queued in the parent are dropped. A child
+     * forked from the executor thread gets the executor turned off.
+     */
+    void resetAfterFork();
+
+
+    /**
+     * @brief Check if the executor is on
+     *
+     * @return bool true if CSPICE work runs on the executor thread
+     */
+    bool isEnabled();
+
+
+    /**
+     * @brief Check if the calling thread is the executor thread
+     *
+     * @return bool true when called from a task running on the executor
+     */
+    bool isExecutorThread();
+
+    SpiceExecutor(SpiceExecutor const&) = delete;
+    void operator=(SpiceExecutor const&) = delete;
+
+    private:
+
+    //! queue node, the queue always holds one node that has already been consumed
+    struct Node {
+      std::function<void()> task;
+      std::atomic<Node*> next{nullptr};
+    };
+
+    SpiceExecutor();
+    ~SpiceExecutor();
+
+
+    /**
+     * @brief add a task to the queue and wake the executor thread if it is waiting
+     *
+     * @param task task to queue
+     * @return bool false if the executor is off and the task was not queued
+     */
+    bool push(std::function<void()> task);
+
+
+    /**
+     * @brief take the next task off the queue, only called from the executor thread
+     *
+     * @param task set to the next task
+     * @return bool false if the queue is empty
+     */
+    bool pop(std::function<void()> &task);
+
+
+    /**
+     * @brief run tasks until the executor is turned off and the queue is empty
+     */
+    void work();
+
+    //! last node pushed, producers swap themselves in here
+    std::atomic<Node*> head;
+
+    //! last consumed node, only touched by the executor thread
+    Node *tail;
+
+    //! whether tasks are sent to the executor thread
+    std::atomic<bool> enabled{false};
+
+    //! number of producers in push, setEnabled(false) waits for them before draining the queue
+    std::atomic<int> pushing{0};
+
+    //! whether the executor thread is waiting for tasks
+    std::atomic<bool> sleeping{false};
+
+    //! guards starting and stopping the thread, held while the process forks
+    std::mutex controlLock;
+
+    //! whether the executor thread should stay parked for a fork, and whether it is parked
+    bool paused = false;
+    bool parked = false;
+
+    //! used to park the executor thread while the process forks
+    std::mutex pauseLock;
+    std::condition_variable pauseReady;
+
+    //! used to wait for tasks when the queue is empty
+    std::mutex sleepLock;
+    std::condition_variable wake;
+
+    //! the executor thread
+    std::thread worker;
+  };
+
+
+  /**
+   * @brief Run a task on the SPICE executor and wait for its result
+   *
+   * Shorthand for SpiceExecutor::getInstance().run(task).
+   *
+   * @param task callable with no arguments
+   * @return the task's result
+   */
+  template <typename F>
+  std::invoke_result_t<F> runOnSpiceExecutor(F task) {
+    return SpiceExecutor::getInstance().run(std::move(task));
+  }
+}
@@ -0,0 +1,76 @@
+#pragma once
+/**
+ * @file
+ *
+ * Hooks for forking a process that uses SpiceQL.
+ *
+ * A prefork server can warm the config, kernel inventory and pinned kernels once in the parent
+ * and fork children that start with all of it. Some state can't be shared with a child as is:
+ * the executor thread doesn't exist in the child, furnished kernel files share their file offsets
+ * with the parent, the Redis connection's sockets would be shared and the log file would be
+ * rotated by every process. These hooks fix that state up around a fork.
+ *
+ **/
+
+#include <sys/types.h>
+
+namespace SpiceQL {
+
+  /**
+   * @brief Get SpiceQL ready to fork, call in the parent right before fork()
+   *
+   * Settles the cache directory so every child uses the parent's, also exporting it as
+   * $SPICEQL_CACHE_DIR for children that exec, flushes the logs, parks the SpiceExecutor
+   * between tasks and holds the kernel prefetch queue. Other threads can keep querying, their CSPICE work waits until the fork is over.
+   * With the executor off, other threads should not be using SpiceQL while the process forks.
+   * Every call must be followed by parentAfterFork in the parent and childAfterFork in the child.
+   */
+  void prepareFork();
+
+
+  /**
+   * @brief Resume SpiceQL in the parent, call in the parent right after fork()
+   *
+   * Lets the SpiceExecutor run the work queued during the fork and releases the prefetch queue.
+   */
+  void parentAfterFork();
+
+
+  /**
+   * @brief Isolate the child from its parent, call in the child right after fork()
+   *
+   * Starts a new SpiceExecutor thread if the executor is on, drops the parent's prefetch queue, furnishes every kernel in the KernelPool
+   * again so the child has its own kernel files and moves the file log to spiceql_logs.<pid>.txt.
+   * The Redis connection is replaced the next time it is used.
+   */
+  void childAfterFork();
+
+
+  /**
+   * @brief Run the fork hooks on every fork() with pthread_atfork
+   *
+   * With the handlers registered, processes forked by anything, e.g. os.fork, multiprocessing
+   * or a gunicorn master, are isolated without calling the hooks by hand. Registering more than once
+   * has no effect. Handlers are registered when SpiceQL is loaded if $SPICEQL_FORK_HANDLERS is true.
+   */
+  void registerForkHandlers();
+
+
+  /**
+   * @brief Check if the fork hooks run on every fork()
+   *
+   * @return bool true if registerForkHandlers has been called
+   */
+  bool isForkHandlersRegistered();
+
+
+  /**
+   * @brief fork() with the fork hooks
+   *
+   * The hooks are called around the fork unless they are registered to run on every fork.
+   *
+   * @return pid_t the child's process id in the parent, 0 in the child
+   * @throws std::runtime_error if the process can't fork
+   */
+  pid_t forkProcess();
+}
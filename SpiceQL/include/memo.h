@@ -16,11 +16,14 @@
 #include <chrono>
 #include <iomanip>
 
+#include <unistd.h>
+
 #include <ghc/fs_std.hpp>
 #include <spdlog/spdlog.h>
 
 #include <cereal/archives/binary.hpp>
 #include <cereal/archives/portable_binary.hpp>
+#include <cereal/types/map.hpp>
 #include <cereal/types/vector.hpp>
 #include <cereal/types/string.hpp>
 #include <cereal/types/utility.hpp>
@@ -99,23 +102,15 @@ namespace Memo {
 
 
     inline bool isRedisEnabled() { 
-        const char* env_redis_enabled = getenv("SPICEQL_ENABLE_REDIS");
-        bool is_redis_enabled = !(env_redis_enabled == NULL);
-
-        if (env_redis_enabled != NULL) {
-            SPDLOG_TRACE("$SPICEQL_ENABLE_REDIS {}", env_redis_enabled);
-            std::istringstream(toLower(std::string(env_redis_enabled))) >> std::boolalpha >> is_redis_enabled;
-        }
-
+        bool is_redis_enabled = getEnvBool("SPICEQL_ENABLE_REDIS");
         SPDLOG_TRACE("Is Redis enabled? {}", is_redis_enabled);
         return is_redis_enabled;
     }
 
 
     inline std::string getCacheDir() { 
-        static std::string  CACHE_DIRECTORY = "";
-
-        if (CACHE_DIRECTORY == "") { 
+        // initialized once, the first caller creates the directory while any others wait on it
+        static const std::string CACHE_DIRECTORY = []() -> std::string {
             const char* cache_dir_char = getenv("SPICEQL_CACHE_DIR");
         
             std::string  cache_dir; 
@@ -133,13 +128,11 @@ namespace Memo {
                 fs::create_directories(cache_dir); 
             }
         
-            CACHE_DIRECTORY = cache_dir;
-            SPDLOG_DEBUG("Setting cache directory to: {}", CACHE_DIRECTORY);  
-        } 
-        else { 
-            SPDLOG_TRACE("Cache Directory Already Set: {}", CACHE_DIRECTORY);  
-        }
+            SPDLOG_DEBUG("Setting cache directory to: {}", cache_dir);  
+            return cache_dir;
+        }();
 
+        SPDLOG_TRACE("Cache Directory Already Set: {}", CACHE_DIRECTORY);  
         return CACHE_DIRECTORY;
     }
 
@@ -147,6 +140,7 @@ namespace Memo {
     inline sw::redis::RedisCluster* getRedisConnection() { 
         static std::string REDIS_URI = "";
         static sw::redis::RedisCluster *cluster = NULL; 
+        static pid_t clusterPid = 0;
 
         if(!Memo::isRedisEnabled()) {
           throw std::runtime_error("Redis is not enabled, set $SPICEQL_ENABLE_REDIS=true to enable redis support");
@@ -168,8 +162,11 @@ namespace Memo {
     
         SPDLOG_TRACE("Redis URI: {}", REDIS_URI); 
         
-        if(cluster == NULL) { 
+        // a forked child can't share its parent's sockets, it gets its own connection.
+        // The inherited one is left alone, another thread could have held its locks during the fork.
+        if(cluster == NULL || clusterPid != getpid()) { 
             cluster = new sw::redis::RedisCluster(REDIS_URI);
+            clusterPid = getpid();
         }
 
         return cluster; 
@@ -399,4 +396,18 @@ struct std::hash<std::vector<std::string>>
     }
 };
 
+template<>
+struct std::hash<std::vector<std::vector<std::string>>>
+{
+    std::size_t operator()(std::vector<std::vector<std::string>> const& vec) const noexcept {
+        std::size_t seed = 0;
+        std::hash<std::vector<std::string>> hasher;
+
+        for(auto &e : vec) {
+           seed = SpiceQL::Memo::hash_combine(seed, hasher(e));
+        }
+        return seed;
+    }
+};
+
 #endif
\ No newline at end of file
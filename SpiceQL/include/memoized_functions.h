@@ -1,6 +1,7 @@
 
 #pragma once
 
+#include <map>
 #include <vector>
 #include <string>
 
@@ -25,9 +26,36 @@ namespace SpiceQL {
     **/
   std::vector<std::string> ls(std::string const & root, bool recursive);
 
+
+  /**
+    * @brief Memoized wrapper for getKernelTypes
+    *
+    * Kernel types are cached with the directory listing, so classifying a directory
+    * again only sniffs the files when the directory changes.
+    *
+    * @see SpiceQL::getKernelTypes
+    *
+    * @param root directory to classify
+    * @param recursive recursively iterates through directories if true
+    * @returns map of kernel path to Kernel type
+   **/
+  std::map<std::string, std::string> getKernelTypes(std::string const & root, bool recursive);
+
   
   std::vector<std::vector<std::string>> getPathsFromRegex (std::string root, std::vector<std::string> regexes);
 
+
+  /**
+    * @brief Memoized wrapper for getPathsFromRegexGroups
+    *
+    * @see SpiceQL::getPathsFromRegexGroups
+    *
+    * @param root root path to search
+    * @param regexGroups list of regex lists
+    * @returns vector of results, one per input group
+   **/
+  std::vector<std::vector<std::vector<std::string>>> getPathsFromRegexGroups(std::string root, std::vector<std::vector<std::string>> regexGroups);
+
   /**
     * @brief Get start and stop times a kernel.
     *
@@ -35,6 +63,7 @@ namespace SpiceQL {
     * This gets all start and stop times regardless of the frame associated with it.
     *
     * Input kernel is assumed to be a binary kernel with time dependant external orientation data.
+    * CK coverage is read at getCkCoverageLevel() with getCkCoverageTolerance().
     *
     * @param kpath Path to the kernel
     * @returns std::vector of start and stop times
@@ -42,6 +71,17 @@ namespace SpiceQL {
   std::vector<std::pair<double, double>> getTimeIntervals(std::string kpath);
 
 
+  /**
+    * @brief Memoized wrapper for getBodyCoverage
+    *
+    * @see SpiceQL::getBodyCoverage
+    *
+    * @param kpath Path to the kernel
+    * @returns string json map of NAIF ID to coverage
+   **/
+  std::string getBodyCoverage(std::string kpath);
+
+
   /**
    * @brief Get start and stop times for all kernels
    * 
@@ -30,6 +30,18 @@ namespace SpiceQL {
   std::vector<std::string> getLatestKernel(std::vector<std::string> kernels);
 
 
+  /**
+    * @brief get the key used to order versions of a kernel
+    *
+    * The key is the kernel's file name with every number zero padded to the same width,
+    * so comparing keys orders numbers by value, e.g. v9 comes before v10.
+    *
+    * @param kernel path to the kernel
+    * @returns std::string the version key
+   **/
+  std::string getKernelVersionKey(std::string kernel);
+
+
    /**
     * @brief returns a JSON object of only the latest version of each kernel type
     *
@@ -105,10 +117,14 @@ namespace SpiceQL {
    *
    * TODO: Add a "See Also" on json format after the format matures a bit more.
    *
+   * Without cachedTimes, coverage is read per kernel and kernels whose file name dates, see the "dates"
+   * key of a quality group and getFilenameDateRange, are outside of the times are skipped without reading them.
+   *
    * @param kernels kernels to search
    * @param times vector of times to match
    * @param isContiguous if true, all times need to be in the kernel to match the query, else, any kernel that
    *                     is in any of the times inputed get returned
+   * @param cachedTimes json map of kernel path to time intervals, e.g. the mission's coverage from globTimeIntervals
    * @returns json object with new kernels
   **/
   nlohmann::json searchEphemerisKernels(nlohmann::json kernels, std::vector<double> times, bool isContiguous = false, nlohmann::json cachedTimes = {});
@@ -151,6 +167,122 @@ namespace SpiceQL {
    */
   std::set<std::string> getKernelsAsSet(nlohmann::json kernels);
 
+
+  /**
+   * @brief Get the qualities to search for a requested quality
+   *
+   * Returns the requested quality followed by every lower quality in the
+   * order they should be tried when no kernels of the requested quality are found,
+   * lowest to highest is the order of Kernel::QUALITIES after "na".
+   * "na" returns an empty list, meaning any quality is acceptable.
+   *
+   * @param quality the requested quality name, one of Kernel::QUALITIES
+   * @return vector<string> quality names from the requested quality down to the lowest
+   * @throws std::invalid_argument if quality isn't one of Kernel::QUALITIES
+   */
+  std::vector<std::string> getQualityFallbacks(std::string quality);
+
+
+  /**
+   * @brief Remove SPK and TSPK kernels that can't contribute to the requested bodies
+   *
+   * Starting from the requested bodies, the centers of every SPK segment that covers one of
+   * them during the times are added until every body in the chain is known. SPK and TSPK kernels
+   * with none of those bodies over the times are removed, e.g. planetary ephemerides
+   * when only a spacecraft relative to its target is needed.
+   *
+   * Body coverage comes from bodyCoverage, e.g. from getStoredBodyCoverage, and Memo::getBodyCoverage
+   * for kernels that aren't in it. Kernels without known coverage are always kept.
+   * All other kernel types are returned as is.
+   *
+   * @param kernels json object with kernel query results, e.g. from searchAndRefineKernels
+   * @param bodies NAIF IDs of the bodies that will be looked up
+   * @param times ephemeris times that will be looked up
+   * @param bodyCoverage json map of kernel path to body coverage that is already known
+   * @return json kernels without the SPKs that don't contain any needed body
+   */
+  nlohmann::json filterKernelsByBodies(nlohmann::json kernels, std::vector<int> bodies, std::vector<double> times,
+                                       nlohmann::json bodyCoverage = nlohmann::json::object());
+
+
+  /**
+   * @brief Remove SPK, TSPK and CK kernels that are shadowed by later kernels over a time window
+   *
+   * CSPICE gives precedence to the last loaded kernel that covers a body, kernels are furnished
+   * in list order so later kernels in a list win. The times are treated as the window from the
+   * earliest to the latest, and a kernel is kept if it is the last loaded kernel covering some body
+   * anywhere in it. This gives the same answers at every time in the window while loading fewer kernels.
+   *
+   * CK lists are only reduced when getCkCoverageLevel() is INTERVAL, since segment level coverage
+   * can hide gaps where CSPICE would fall through to an earlier kernel.
+   * Body coverage comes from bodyCoverage, e.g. from getStoredBodyCoverage, and Memo::getBodyCoverage
+   * for kernels that aren't in it. Kernels without known coverage are always kept.
+   *
+   * @param kernels json object with kernel query results, e.g. from searchAndRefineKernels
+   * @param times ephemeris times that will be looked up, only the earliest and latest are used
+   * @param bodyCoverage json map of kernel path to body coverage that is already known
+   * @return json kernels with only the kernels that provide data somewhere in the window
+   */
+  nlohmann::json getMinimalCoveringKernels(nlohmann::json kernels, std::vector<double> times,
+                                           nlohmann::json bodyCoverage = nlohmann::json::object());
+
+
+  /**
+   * @brief Build a timeline of the best kernels to load over time
+   *
+   * The timeline splits time into disjoint ranges, each with the kernels that cover all of it.
+   * Only the best quality with any coverage in a range is kept there, following the order
+   * of the qualities list, the same fallback searchAndRefineKernels uses. Adjacent ranges with
+   * the same kernels are merged.
+   *
+   * The result has "kernels", a list of {"path", "quality", "group"} objects best quality first and in load
+   * order within a quality, where "group" is the index of the kernel's version group in its quality's
+   * kernel list, "ranges", a list of {"start", "stop", "kernels"} objects sorted on time where "kernels"
+   * are indices into the kernel list, and a format "version". A group without any of the qualities
+   * gives a timeline without kernels.
+   *
+   * @param kernels a CK or SPK group with quality keys, e.g. a mission's "ck" group
+   * @param coverage json map of kernel path to coverage intervals, as from globTimeIntervals
+   * @param qualities qualities to use, best first, see getQualityFallbacks
+   * @return json the timeline
+   */
+  nlohmann::json buildKernelTimeline(nlohmann::json kernels, nlohmann::json coverage, std::vector<std::string> qualities);
+
+
+  /**
+   * @brief Get the kernels a timeline has for a set of times
+   *
+   * Each time is found with a binary search over the timeline's ranges, times outside of
+   * every range add no kernels.
+   *
+   * @param timeline timeline from buildKernelTimeline
+   * @param times ephemeris times to search
+   * @return json object with "kernels", a kernel list with one sub-array per version group like the config's,
+   *         the worst quality first so the best quality is loaded last, and the best "quality" found
+   */
+  nlohmann::json searchKernelTimeline(nlohmann::json timeline, std::vector<double> times);
+
+
+  /**
+   * @brief Get a mission's persisted kernel timeline
+   *
+   * Timelines are written to the cache directory by globTimeIntervals for the mission's top level
+   * CK and SPK groups, one per quality with the quality's fallbacks, along with a hash of the coverage
+   * they were built from. The mission's coverage is brought up to date with Memo::globTimeIntervals
+   * first, even with $SPICEQL_LAZY_COVERAGE, and the timeline is rebuilt if it is missing or was built
+   * from different coverage, e.g. before kernels were added. Parsed timelines are kept in memory
+   * until the coverage changes.
+   *
+   * @param mission mission name in the config
+   * @param kernelType "ck" or "spk"
+   * @param quality the best quality to use
+   * @param coverageHash getCoverageHash of the mission's current coverage, computed from
+   *                     Memo::globTimeIntervals when empty
+   * @return json the timeline, or an empty json if the mission has no kernels for the quality or its fallbacks
+   */
+  nlohmann::json getKernelTimeline(std::string mission, std::string kernelType, std::string quality, std::string coverageHash = "");
+
+
   nlohmann::json searchAndRefineKernels(std::string mission,
                                         std::vector<double> times = {},
                                         std::string ckQuality = "reconstructed",
@@ -6,6 +6,7 @@
  **/
 
 #include <iostream>
+#include <list>
 #include <unordered_map>
 
 #include <nlohmann/json.hpp>
@@ -101,12 +102,14 @@ namespace SpiceQL {
        *
        * Load a kernel into memory by opening the kernel and furnishing.
        * This also increases the reference count of the kernel. If the kernel
-       * has alrady been furnished, it is refurnshed.  
+       * has alrady been furnished, it is refurnshed if a kernel of the same kind was
+       * loaded after it, unless force_refurnsh is false.
        *
        * @param path path to a kernel.
+       * @param force_refurnsh If true, make sure the kernel takes precedence over kernels already in the pool.
        *
       **/
-      Kernel(std::string path);
+      Kernel(std::string path, bool force_refurnsh = true);
 
 
       /**
@@ -219,8 +222,11 @@ namespace SpiceQL {
      * This should be called for furnshing kernel instead of furnsh_c directly 
      * so that they are tracked throughout the process. 
      *
+     * A kernel that is already in the pool is only furnished again when force_refurnsh is true
+     * and it has to be promoted above a kernel loaded after it, see promote.
+     *
      * @param kernelPath Path to the kernel to load 
-     * @param force_refurnsh If true, call furnsh on the kernel even if the kernel is already in the pool. Default is True. 
+     * @param force_refurnsh If true, make sure the kernel takes precedence over kernels already in the pool. Default is True. 
      */
     int load(std::string kernelPath, bool force_refurnsh=true);
 
@@ -244,8 +250,207 @@ namespace SpiceQL {
      */
     void loadClockKernels();
 
+
+    /**
+     * @brief keep released kernels furnished for reuse
+     *
+     * With retention on, a kernel whose reference count drops to 0 is not unloaded but kept
+     * in a least recently used list, and loading it again takes it off the list without calling
+     * furnsh_c. The least recently used kernels are unloaded once there are more than maxKernels,
+     * more than maxBytes of retained files or the CSPICE kernel database is close to full.
+     * If a furnsh fails because CSPICE's tables are full, the retained kernels are unloaded
+     * and the furnsh is tried again.
+     *
+     * Retained kernels keep their place in the load order and still take part in lookups,
+     * so this is meant for repeated queries that use the same kernels.
+     *
+     * The defaults come from $SPICEQL_KERNEL_RETENTION and $SPICEQL_KERNEL_RETENTION_BYTES.
+     *
+     * @param maxKernels number of kernels to retain, 0 turns retention off and unloads every retained kernel
+     * @param maxBytes total size of the retained files, 0 means no limit
+     */
+    void setRetention(size_t maxKernels, uintmax_t maxBytes = 0);
+
+
+    /**
+     * @brief Get every kernel furnished by the pool in load order
+     *
+     * Unlike getLoadedKernels, kernels furnished more than once show up once per copy.
+     * Later kernels take precedence over earlier ones.
+     *
+     * @return std::vector<std::pair<std::string, std::string>> kernel paths and their kinds, e.g. "SPK" or "TEXT"
+     */
+    std::vector<std::pair<std::string, std::string>> getLoadOrder();
+
+
+    /**
+     * @brief Make a loaded kernel take precedence over the kernels loaded before it
+     *
+     * CSPICE uses the last loaded kernel with the data it needs, but only kernels of the
+     * same kind (SPK, CK, PCK, text, ...) can shadow each other. The kernel is only furnished
+     * again if a kernel of its kind was loaded after it. Meta-kernels count as every kind.
+     *
+     * @param kernelPath path to a kernel in the pool
+     * @return bool true if the kernel had to be furnished again
+     * @throws std::out_of_range if the kernel is not loaded
+     */
+    bool promote(std::string kernelPath);
+
+
+    /**
+     * @brief only furnish the kernels a KernelSet is missing
+     *
+     * With delta loading on, a new KernelSet compares its kernels against what is currently
+     * furnished and only furnishes what is missing or out of order, see KernelSet.
+     * The default comes from $SPICEQL_DELTA_KERNELS.
+     *
+     * @param enabled true to turn delta loading on
+     */
+    void setDeltaLoading(bool enabled);
+
+
+    /**
+     * @brief Check if delta loading is on
+     *
+     * @return bool true if KernelSets only furnish the kernels they are missing
+     */
+    bool getDeltaLoading();
+
+
+    /**
+     * @brief Get the kernels that are retained with no references
+     *
+     * @return std::vector<std::string> retained kernels, most recently released first
+     */
+    std::vector<std::string> getRetainedKernels();
+
+
+    /**
+     * @brief Unload every retained kernel
+     */
+    void releaseRetainedKernels();
+
+    /**
+     * @brief keep a kernel furnished for the life of the process
+     *
+     * The pool holds a reference to the kernel until it is unpinned. Pinning a kernel
+     * more than once has no effect.
+     *
+     * @param kernelPath path to the kernel
+     */
+    void pin(std::string kernelPath);
+
+
+    /**
+     * @brief release the reference held by pin
+     *
+     * @param kernelPath path to a pinned kernel
+     * @throws std::out_of_range if the kernel is not pinned
+     */
+    void unpin(std::string kernelPath);
+
+
+    /**
+     * @brief unpin every pinned kernel
+     *
+     * This also stops $SPICEQL_PIN_BASE_KERNELS from pinning the base kernels if it hasn't already.
+     */
+    void unpinAll();
+
+
+    /**
+     * @brief Get the pinned kernels
+     *
+     * @return std::vector<std::string> pinned kernels in the order they were pinned
+     */
+    std::vector<std::string> getPinnedKernels();
+
+
+    /**
+     * @brief Check if a kernel is pinned
+     *
+     * KernelSets skip pinned kernels, they are already furnished for the life of the pin.
+     *
+     * @param kernelPath path to the kernel
+     * @return bool true if the kernel is pinned
+     */
+    bool isPinned(std::string kernelPath);
+
+
+    /**
+     * @brief pin the latest base kernels of some kernel types
+     *
+     * The kernels are resolved from the "base" config once and pinned. utcToEt, etToUtc and the
+     * target keyword lookups skip resolving base kernels of pinned types, e.g. utcToEt no longer
+     * reads the config or furnishes an LSK when the base LSK is pinned. searchAndRefineKernels still
+     * returns them, and KernelSets skip furnishing them.
+     *
+     * With $SPICEQL_PIN_BASE_KERNELS set to true, the default types are pinned the first time
+     * a query checks isBasePinned.
+     *
+     * @param kernelTypes base kernel types to pin, types without base kernels are skipped
+     */
+    void pinBaseKernels(std::vector<std::string> kernelTypes = {"lsk", "pck", "fk"});
+
+
+    /**
+     * @brief Check if the base kernels of a type are pinned
+     *
+     * @param kernelType kernel type, e.g. "lsk"
+     * @return bool true if every base kernel of the type is pinned
+     */
+    bool isBasePinned(std::string kernelType);
+
+
+    /**
+     * @brief Unload and furnish again every kernel in the pool, in load order
+     *
+     * A forked child shares its parent's open kernel files, including their file offsets,
+     * so reading binary kernels in both processes at once returns garbage. Furnishing them
+     * again gives this process its own files. Reference counts, retained and pinned kernels
+     * and the load order are unchanged. This is called by childAfterFork.
+     */
+    void reopenKernels();
+
     private: 
 
+    /**
+     * @brief furnish a copy of a kernel and add it to the end of the load order
+     *
+     * The kernels a meta-kernel loads get a reference for each copy of the meta-kernel,
+     * so they are counted like any other furnished kernel.
+     *
+     * @param kernelPath path to the kernel
+     */
+    void furnish(std::string kernelPath);
+
+
+    /**
+     * @brief unload the most recently furnished copy of a kernel
+     *
+     * Kernels loaded through a meta-kernel lose the copy's reference, ones that are still
+     * referenced elsewhere are furnished on their own so they stay loaded.
+     *
+     * @param kernelPath path to the kernel
+     */
+    void unfurnish(std::string kernelPath);
+
+
+    /**
+     * @brief get the number of copies of a kernel that are furnished
+     *
+     * @param kernelPath path to the kernel
+     * @return size_t number of copies, can be less than the kernel's ref count
+     */
+    size_t getFurnishCount(std::string kernelPath);
+
+
+    /**
+     * @brief unload retained kernels until the retention limits are met
+     */
+    void evictRetainedKernels();
+
+
     /**
      * @brief load leapsecond kernels
      * 
@@ -263,6 +468,45 @@ namespace SpiceQL {
     //! map for tracking what kernels have been furnished and how often. 
     std::unordered_map<std::string, int> refCounts;
 
+    //! every furnished copy of a kernel and its kind, in load order
+    std::list<std::pair<std::string, std::string>> loadOrder;
+
+    //! each kernel's copies in loadOrder, oldest first
+    std::unordered_map<std::string, std::vector<std::list<std::pair<std::string, std::string>>::iterator>> furnishedCopies;
+
+    //! whether KernelSets only furnish the kernels they are missing
+    bool deltaLoading = false;
+
+    //! kernels the pool holds a reference to, in the order they were pinned
+    std::vector<std::string> pinned;
+
+    //! pinned base kernels of each kernel type
+    std::unordered_map<std::string, std::vector<std::string>> pinnedBase;
+
+    //! whether the base kernels get pinned the first time isBasePinned is called
+    bool pinBaseOnUse = false;
+
+    //! maximum number of retained kernels, 0 if retention is off
+    size_t retainCount = 0;
+
+    //! maximum total size of retained kernels in bytes, 0 for no limit
+    uintmax_t retainBytes = 0;
+
+    //! total size of the retained kernels in bytes
+    uintmax_t retainedBytes = 0;
+
+    //! retained kernels and their sizes, most recently released first
+    std::list<std::pair<std::string, uintmax_t>> retained;
+
+    //! lookup of retained kernels into the retained list
+    std::unordered_map<std::string, std::list<std::pair<std::string, uintmax_t>>::iterator> retainedIndex;
+
+    //! kernels CSPICE loaded through each furnished meta-kernel, every copy of the meta-kernel holds a reference to them
+    std::unordered_map<std::string, std::vector<std::string>> metaKernelContents;
+
+    //! descriptors holding a shared lock on each furnished meta-kernel, so pruneMetaKernels in other processes skips them
+    std::unordered_map<std::string, int> metaKernelLocks;
+
   };
 
 
@@ -273,6 +517,14 @@ namespace SpiceQL {
    * "kernels" key. The kernels are unloaded as soon as the object 
    * goes out of scope. 
    *
+   * With KernelPool delta loading on, kernels that are already the last furnished
+   * kernels of their kind (SPK, CK, PCK, text, ...) in the set's order are only referenced,
+   * and the rest of the set is furnished on top of them. The set gets the same precedence
+   * as furnishing every kernel again, without the furnsh_c calls.
+   *
+   * Sets with at least getMetaKernelThreshold() kernels are instead written to a meta-kernel
+   * in the cache directory, see writeMetaKernel, and furnished with a single call.
+   *
    * Generally used on results from a kernel query. 
    */
   class KernelSet {
@@ -286,11 +538,32 @@ namespace SpiceQL {
     KernelSet(nlohmann::json kernels);
     ~KernelSet() = default;
 
+
+    /**
+     * @brief Switch the set to a new list of kernels
+     *
+     * The new kernels are loaded before the current ones are released, so kernels
+     * in both lists stay furnished and only kernels that are no longer needed are unloaded.
+     *
+     * @param kernels json object with the new kernels
+     */
+    void activate(nlohmann::json kernels);
+
     //! map of path to kernel pointers
     std::vector<SharedKernel> loadedKernels;
     
     //! json used to populate the loadedKernels
     nlohmann::json kernels; 
+
+    private:
+
+    /**
+     * @brief Load a list of kernels in order, only furnishing what is needed with delta loading on
+     *
+     * @param kernels kernel paths in load order
+     * @return std::vector<SharedKernel> references to the kernels
+     */
+    static std::vector<SharedKernel> furnishKernels(std::vector<std::string> kernels);
   };
 
 
@@ -299,6 +572,7 @@ namespace SpiceQL {
    *
    * Basically a wrapper around NAIF's cspice str2et function except it also temporarily loads the required kernels.
    * See Also: https://naif.jpl.nasa.gov/pub/naif/toolkit_docs/C/cspice/str2et_c.html
+   * If the base LSK is pinned, see KernelPool::pinBaseKernels, nothing is loaded.
    *
    * @param et UTC string, e.g. "1988 June 13, 12:29:48 TDB"
    * @param searchKernels bool Whether to search the kernels for the user
@@ -312,6 +586,7 @@ namespace SpiceQL {
    *
    * Basically a wrapper around NAIF's cspice et2utc_c function except it also temporarily loads the required kernels.
    * See Also: https://naif.jpl.nasa.gov/pub/naif/toolkit_docs/C/cspice/et2utc_c.html
+   * If the base LSK is pinned, see KernelPool::pinBaseKernels, nothing is loaded.
    *
    * @param et ephemeris time
    * @param precision number of decimal 
@@ -11,3 +11,6 @@
 #include "spice_types.h"
 #include "io.h"
 #include "query.h"
+#include "executor.h"
+#include "fork.h"
+#include "workers.h"
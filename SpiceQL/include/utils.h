@@ -11,6 +11,8 @@
 #include <regex>
 #include <optional>
 #include <array>
+#include <functional>
+#include <map>
 #include <vector>
 
 #include <nlohmann/json.hpp>
@@ -75,6 +77,39 @@ namespace SpiceQL {
   std::vector<std::vector<std::string>> getPathsFromRegex (std::string root, std::vector<std::string> regexes);
 
 
+  /**
+    * @brief glob multiple groups of regexes in a single pass
+    *
+    * Batch version of getPathsFromRegex. The file listing under root is fetched
+    * once and scanned once, every distinct regex across all groups is compiled once,
+    * and each group is filled in from that one pass. The result for each group has the
+    * same shape as getPathsFromRegex would return for it.
+    *
+    * @param root root path to search
+    * @param regexGroups list of regex lists, usually one per "kernels" key in a config
+    * @returns vector of results, one per input group, in the same order
+   **/
+  std::vector<std::vector<std::vector<std::string>>> getPathsFromRegexGroups(std::string root, std::vector<std::vector<std::string>> regexGroups);
+
+
+  /**
+    * @brief get the literal text every match of a regex has to start with
+    *
+    * Walks the start of an ECMAScript regex and returns the literal characters
+    * before the first metacharacter, e.g. "mro_sc_psp_" for "mro_sc_psp_[0-9]{6}_[0-9]{6}.bc".
+    * Escaped punctuation (e.g. "\\.") counts as literal, a character followed by an
+    * optional quantifier is dropped and any alternation ("|") means there is no usable prefix.
+    *
+    * The second value is true if the regex is anchored to the start of the string with "^",
+    * in which case every match begins with the prefix. Otherwise the prefix is only
+    * guaranteed to appear somewhere in the match.
+    *
+    * @param regex regular expression to inspect
+    * @returns pair of the literal prefix (possibly empty) and whether the regex is anchored
+   **/
+  std::pair<std::string, bool> getRegexLiteralPrefix(std::string regex);
+
+
   /**
    * @brief Merge two json configs
    *
@@ -124,20 +159,167 @@ namespace SpiceQL {
     *
     * Input kernel is assumed to be a binary kernel with time dependant external orientation data.
     *
+    * CK coverage is at SEGMENT level by default, which includes any gaps in pointing inside a segment.
+    * INTERVAL level only gives the times pointing is actually available, at the cost of reading
+    * the segments' data with ckcov_c. The tolerance widens each interval on both sides, closing small gaps.
+    *
     * @param kpath Path to the kernel
+    * @param ckLevel CK coverage level, "SEGMENT" or "INTERVAL"
+    * @param ckTolerance CK tolerance in encoded SCLK ticks, coverage intervals are expanded by it
     * @returns std::vector of start and stop times
    **/
-  std::vector<std::pair<double, double>> getTimeIntervals(std::string kpath);
+  std::vector<std::pair<double, double>> getTimeIntervals(std::string kpath, std::string ckLevel = "SEGMENT", double ckTolerance = 0);
+
+
+  /**
+    * @brief Get the approximate coverage of a kernel from the dates in its file name
+    *
+    * Many CK and SPK file names embed their coverage, e.g. mro_sc_psp_060101_060107.bc.
+    * Each date extractor is a JSON object with a "regex" with two capture groups for the
+    * start and stop dates, a strftime style "format" for both captures (e.g. "%y%m%d", fixed
+    * width %Y, %y, %j, %m, %d, %H, %M and %S are supported)
+    * and an optional "margin" in seconds (default two days). The first extractor whose regex
+    * matches the file name is used.
+    *
+    * No kernels are read and no leapseconds are applied, the returned range is an approximate
+    * ephemeris time range widened by the margin. It is only meant to rule kernels out, true
+    * coverage should still be checked for kernels that overlap the range.
+    *
+    * @param kpath path to the kernel
+    * @param dateExtractors JSON list of date extractors, usually the "dates" key of a config quality group
+    * @returns the start and stop ephemeris times, or std::nullopt if no extractor applies to the file
+   **/
+  std::optional<std::pair<double, double>> getFilenameDateRange(std::string kpath, nlohmann::json dateExtractors);
+
+
+  /**
+    * @brief A file name date extractor with its regex compiled, see getFilenameDateRange
+   **/
+  struct FilenameDateExtractor {
+    std::regex regex;
+    std::string format;
+    double margin;
+  };
+
+
+  /**
+    * @brief Compile date extractors once for matching many file names
+    *
+    * @param dateExtractors JSON list of date extractors, usually the "dates" key of a config quality group
+    * @returns the compiled extractors, extractors without a "regex" or "format" are skipped
+   **/
+  std::vector<FilenameDateExtractor> compileDateExtractors(nlohmann::json dateExtractors);
+
+
+  /**
+    * @brief Get the approximate coverage of a kernel from the dates in its file name with compiled extractors
+    *
+    * @param kpath path to the kernel
+    * @param dateExtractors extractors from compileDateExtractors
+    * @returns the start and stop ephemeris times, or std::nullopt if no extractor applies to the file
+   **/
+  std::optional<std::pair<double, double>> getFilenameDateRange(std::string kpath, const std::vector<FilenameDateExtractor> &dateExtractors);
+
+
+  /**
+    * @brief Get the coverage of every body in a kernel
+    *
+    * Unlike getTimeIntervals, every body is kept and bodies are not merged together.
+    * The result is a JSON object keyed on NAIF ID, SPK target, CK instrument or PCK frame class ID,
+    * where each value has the body's "intervals" as ephemeris time start and stop pairs.
+    * SPK bodies also list the "centers" their segments are relative to.
+    *
+    * Kernels are read with the native DAF reader, CKs need their SCLK loaded to convert
+    * times. Kernels that are not SPK, CK or binary PCK files give an empty object.
+    *
+    * @param kpath Path to the kernel
+    * @param ckLevel CK coverage level, see getTimeIntervals
+    * @param ckTolerance CK tolerance in encoded SCLK ticks, see getTimeIntervals
+    * @returns string json map of NAIF ID to coverage
+   **/
+  std::string getBodyCoverage(std::string kpath, std::string ckLevel = "SEGMENT", double ckTolerance = 0);
 
 
   /**
    * @brief Get start and stop times for all kernels
+   *
+   * Coverage is kept in a per mission store in the cache directory, see updateTimeIntervals.
+   * Only kernels that are new or have changed since the last call are read.
    * 
    * @return string json map of kernel names to list of time segments
    */
   std::string globTimeIntervals(std::string mission);
 
 
+  /**
+   * @brief Bring a coverage store up to date with a list of kernels
+   *
+   * The store is a JSON object keyed on kernel path, each entry has the kernel's
+   * "size", "mtime", "inode" and the "ckLevel" and "ckTolerance" it was read with,
+   * along with its "intervals" and per body coverage in "bodies" (see getBodyCoverage).
+   * Entries for kernels whose identity still matches are kept as is, new or changed
+   * kernels get their intervals read and kernels not in the list are dropped.
+   * The CK level and tolerance come from getCkCoverageLevel and getCkCoverageTolerance.
+   *
+   * New and changed kernels are indexed in parallel with parallelForEach, largest files first.
+   * Each kernel is read start to finish on a worker thread, SPK and CK summaries come from the
+   * thread safe native DAF reader and only the CSPICE calls (CK clock conversion, ckcov_c and
+   * non-DAF kernels) are serialized, on the SPICE executor when it is on. Called from the
+   * executor thread, everything runs on that thread.
+   *
+   * @param store coverage store from a previous call, or an empty object
+   * @param kernels every kernel that should be in the store
+   * @param threads number of worker threads, 0 uses $SPICEQL_COVERAGE_THREADS or the number of cores
+   * @param progress optional callback called with the number of kernels read so far and the total
+   *                 as each kernel's coverage is done, calls are serialized but come from the worker threads
+   * @returns the updated store
+   */
+  nlohmann::json updateTimeIntervals(nlohmann::json store, std::vector<std::string> kernels,
+                                     unsigned int threads = 0,
+                                     std::function<void(size_t, size_t)> progress = nullptr);
+
+
+  /**
+   * @brief Get the hash timelines use to tell which coverage they were built from
+   *
+   * @param coverage json map of kernel names to time intervals, as returned by globTimeIntervals
+   * @returns std::string hex hash of the coverage
+   */
+  std::string getCoverageHash(std::string coverage);
+
+
+  /**
+   * @brief Get per body coverage for kernels from a mission's coverage store
+   *
+   * Reads the store written by globTimeIntervals, the parsed store is kept in memory
+   * until the file is replaced. Only kernels whose store entry still matches the file
+   * and the current CK coverage settings are returned, see updateTimeIntervals.
+   *
+   * @param mission mission name in the config
+   * @param kernels kernels to look up
+   * @returns json map of kernel path to its "bodies" coverage (see getBodyCoverage), empty if there is no store
+   */
+  nlohmann::json getStoredBodyCoverage(std::string mission, std::vector<std::string> kernels);
+
+
+  /**
+   * @brief Run a task for every index in [0, count) on a work stealing thread pool
+   *
+   * Indices are dealt round robin to per thread queues in order, so callers should put
+   * the most expensive work first. Each thread takes work from the front of its own queue
+   * and, once that is empty, steals from the back of the other queues, so a few large
+   * tasks don't leave the other threads idle.
+   *
+   * The first exception thrown by a task is rethrown on the calling thread once every
+   * thread has stopped.
+   *
+   * @param count number of tasks
+   * @param threads number of threads to use, 0 uses the number of cores
+   * @param task function run with each index
+   */
+  void parallelForEach(size_t count, unsigned int threads, std::function<void(size_t)> task);
+
+
   /**
    * @brief Gives the position and velocity for a given frame at some ephemeris time
    *
@@ -315,6 +497,33 @@ namespace SpiceQL {
    std::string getKernelType(std::string kernelPath);
 
 
+  /**
+    * @brief get the Kernel type from the ID word at the start of the file
+    *
+    * Reads only the first 8 bytes of the file (e.g. "DAF/SPK ", "DAF/CK  " or "KPL/FK  "),
+    * nothing is furnished and no CSPICE routines are called, so this is safe to call from any thread.
+    * Types are reported the same way kinfo_c does, DAF and DAS files give their architecture
+    * (SPK, CK, PCK, EK, DSK), meta kernels give META and other text kernels give TEXT.
+    *
+    * @param kernelPath path to kernel
+    * @returns Kernel type as a string, or an empty string if the file has no recognizable ID word
+   **/
+   std::string getKernelTypeFromHeader(std::string kernelPath);
+
+
+  /**
+    * @brief get the Kernel type of every kernel in a directory
+    *
+    * Lists the directory and classifies each file with getKernelTypeFromHeader.
+    * Files without a recognizable ID word are left out.
+    *
+    * @param root directory to classify
+    * @param recursive recursively iterates through directories if true
+    * @returns map of kernel path to Kernel type
+   **/
+   std::map<std::string, std::string> getKernelTypes(std::string const & root, bool recursive);
+
+
   /**
    * @brief Get the directory pointing to the db files
    * 
@@ -326,6 +535,171 @@ namespace SpiceQL {
    * @return std::string directory containing db files
    */
    std::string getConfigDirectory();
+
+
+  /**
+   * @brief Read a boolean option from an environment variable
+   *
+   * Values are "true"/"false" in any case or a number where non-zero is true, $SPICEQL_ENABLE_REDIS
+   * and the other boolean options are all read with it. Unset or unparsable variables return the default.
+   *
+   * @param var name of the environment variable
+   * @param defaultValue value to use if the variable is unset
+   * @return bool the option's value
+   */
+   bool getEnvBool(std::string var, bool defaultValue = false);
+
+
+  /**
+   * @brief Read a non-negative integer option from an environment variable
+   *
+   * Only plain digits are accepted, anything else logs a warning and returns the default.
+   *
+   * @param var name of the environment variable
+   * @param defaultValue value to use if the variable is unset or invalid
+   * @return size_t the option's value
+   */
+   size_t getEnvUnsigned(std::string var, size_t defaultValue = 0);
+
+
+  /**
+   * @brief Get the CK coverage level used to index kernels
+   *
+   * Read from $SPICEQL_CK_COVERAGE_LEVEL, either SEGMENT (the default) or INTERVAL.
+   * INTERVAL leaves out CKs whose segments span a time without pointing for it.
+   *
+   * @see getTimeIntervals
+   *
+   * @return std::string "SEGMENT" or "INTERVAL"
+   */
+   std::string getCkCoverageLevel();
+
+
+  /**
+   * @brief Get the CK coverage tolerance used to index kernels
+   *
+   * Read from $SPICEQL_CK_COVERAGE_TOLERANCE in encoded SCLK ticks, defaults to 0.
+   *
+   * @see getTimeIntervals
+   *
+   * @return double non-negative tolerance in ticks
+   */
+   double getCkCoverageTolerance();
+
+
+  /**
+   * @brief Get the number of kernels at which a KernelSet is furnished through a meta-kernel
+   *
+   * Read from $SPICEQL_META_KERNEL_THRESHOLD, defaults to 0 which never uses meta-kernels.
+   *
+   * @see writeMetaKernel
+   *
+   * @return size_t minimum number of kernels in a set, 0 if meta-kernels are off
+   */
+   size_t getMetaKernelThreshold();
+
+
+  /**
+   * @brief Write a meta-kernel that loads a list of kernels
+   *
+   * The meta-kernel is named after a hash of the kernel list, spiceql_<hash>.tm, so the same
+   * list always maps to the same file. If the file already exists it is reused and its modification
+   * time is updated, otherwise it is written to a temporary file and renamed into place. Paths longer
+   * than a kernel pool string are split with the + continuation marker.
+   *
+   * Nothing is removed here, see pruneMetaKernels.
+   *
+   * @param kernels kernel paths in load order
+   * @param dir directory to write the meta-kernel to
+   * @return std::string path to the meta-kernel
+   */
+   std::string writeMetaKernel(std::vector<std::string> kernels, std::string dir);
+
+
+  /**
+   * @brief Get the number of meta-kernels kept in the cache directory
+   *
+   * Read from $SPICEQL_META_KERNEL_LIMIT, defaults to 256. 0 keeps every meta-kernel.
+   *
+   * @see pruneMetaKernels
+   *
+   * @return size_t maximum number of meta-kernels
+   */
+   size_t getMetaKernelLimit();
+
+
+  /**
+   * @brief Remove the least recently used meta-kernels written by writeMetaKernel
+   *
+   * Every distinct kernel list gets its own meta-kernel, so KernelSet prunes the directory
+   * every 32 meta-kernels it writes. The spiceql_*.tm files in the directory are ordered on their
+   * modification time, which writeMetaKernel updates on reuse, and the oldest beyond maxKernels are removed.
+   * The directory can be shared between processes, so files modified in the last minute and files
+   * locked by a KernelPool that furnished them are skipped, as are files that can't be removed.
+   *
+   * @param dir directory the meta-kernels were written to
+   * @param maxKernels number of meta-kernels to keep, 0 keeps all of them
+   * @param keep meta-kernels that are never removed, e.g. ones that are furnished
+   * @return size_t number of meta-kernels removed
+   */
+   size_t pruneMetaKernels(std::string dir, size_t maxKernels, std::vector<std::string> keep = {});
+
+
+  /**
+   * @brief Get the number of threads used to prefetch kernels before they are furnished
+   *
+   * Read from $SPICEQL_PREFETCH_THREADS, defaults to 0 which turns prefetching off.
+   *
+   * @see prefetchKernels
+   *
+   * @return unsigned int number of prefetch threads, 0 if prefetching is off
+   */
+   unsigned int getPrefetchThreads();
+
+
+  /**
+   * @brief Ask the OS to read kernels into the page cache
+   *
+   * Each kernel is opened and advised with posix_fadvise(POSIX_FADV_WILLNEED), or F_RDADVISE on macOS,
+   * by background prefetch threads, so the reads of many kernels are in flight at once instead of
+   * furnsh_c reading them one at a time. Kernels that can't be opened are skipped.
+   *
+   * Every call shares the same queue and threads, which are started on first use and added up to
+   * the most threads asked for, so callers never start threads of their own. Kernels already queued
+   * are not queued again. Async prefetches return right away and kernels past 4096 waiting ones are
+   * dropped, other prefetches go ahead of the async ones and wait until their kernels are advised.
+   *
+   * With prefetching on, see getPrefetchThreads, searchAndRefineKernels starts an async prefetch of
+   * the kernels in its result that aren't furnished yet and KernelSet prefetches the kernels it is
+   * about to furnish for the first time.
+   *
+   * @param kernels kernel paths, in the order they will be read
+   * @param threads number of threads to use, 0 uses the number of cores
+   * @param async if true, queue the kernels for the background prefetch thread and return right away
+   */
+   void prefetchKernels(std::vector<std::string> kernels, unsigned int threads = 0, bool async = false);
+
+
+  /**
+   * @brief Keep the prefetch queue from being created or replaced while the process forks
+   *
+   * Called by prepareFork, so a child never inherits the queue's guard locked by another thread.
+   */
+   void pausePrefetchForFork();
+
+
+  /**
+   * @brief Let the prefetch queue be used again, call in the parent after forking
+   */
+   void resumePrefetchAfterFork();
+
+
+  /**
+   * @brief Drop the parent's prefetch queue in a forked child, call in the child after forking
+   *
+   * Its threads don't exist in the child, the child's first prefetch starts new ones.
+   */
+   void resetPrefetchAfterFork();
   
 
   /**
@@ -0,0 +1,241 @@
+#pragma once
+/**
+ * @file
+ *
+ * Pool of pre-forked worker processes for running SPICE queries in parallel.
+ *
+ * CSPICE state is global to a process, so a process can only run one query at a time.
+ * Each worker is a separate process with its own CSPICE state and KernelPool, so a pool
+ * of N workers runs up to N queries at once. Requests and results are passed as JSON
+ * through a shared memory slot per worker.
+ *
+ **/
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <sys/types.h>
+
+#include <nlohmann/json.hpp>
+
+namespace SpiceQL {
+
+  /**
+   * @brief Pool of worker processes that run SpiceQL queries
+   *
+   * Workers are forked when the pool is created, before the caller starts other threads
+   * is the safest time to create it. Calls from any number of threads are sent to an
+   * idle worker and block until it replies. A worker that dies is forked again and the call
+   * it was running throws.
+   *
+   * Exceptions thrown by the query in the worker are rethrown by the caller as
+   * std::invalid_argument, std::out_of_range or std::runtime_error.
+   *
+   * Calls for a mission are routed with consistent hashing on the mission and the time bucket
+   * of their first time, so the same worker keeps getting the same kernels. When that worker is busy
+   * the call spills over to the next idle worker on the hash ring. Buckets are $SPICEQL_WORKER_TIME_BUCKET
+   * seconds, a day by default. Pair this with kernel retention, see KernelPool::setRetention, so
+   * workers keep their kernels furnished between calls.
+   *
+   * Workers are forked with forkProcess, so they start with the parent's furnished kernels
+   * and caches, each with their own kernel files.
+   */
+  class SpiceWorkerPool {
+    public:
+
+    /**
+     * @brief Fork the worker processes
+     *
+     * @param workers number of workers, 0 uses $SPICEQL_WORKERS or the number of cores
+     * @param slotBytes size of each worker's request and result buffer, 0 uses $SPICEQL_WORKER_SLOT_BYTES or 64 MiB
+     * @throws std::runtime_error if a worker can't be started, the workers already started are stopped
+     */
+    SpiceWorkerPool(size_t workers = 0, size_t slotBytes = 0);
+
+
+    /**
+     * @brief Stop the workers and wait for them to exit
+     */
+    ~SpiceWorkerPool();
+
+    SpiceWorkerPool(SpiceWorkerPool const&) = delete;
+    void operator=(SpiceWorkerPool const&) = delete;
+
+
+    /**
+     * @brief Run a SpiceQL function on an idle worker
+     *
+     * @param function name of the function, see getFunctions
+     * @param args json array of the function's arguments, in order and including defaults
+     * @return nlohmann::json the function's return value
+     * @throws std::invalid_argument if the function is unknown or the request doesn't fit in a slot
+     * @throws std::runtime_error if the worker died while running the call
+     */
+    nlohmann::json call(std::string function, nlohmann::json args);
+
+
+    /**
+     * @brief Get the functions workers can run
+     *
+     * @return std::vector<std::string> function names accepted by call
+     */
+    static std::vector<std::string> getFunctions();
+
+
+    /**
+     * @brief Get the number of workers
+     *
+     * @return size_t number of worker processes
+     */
+    size_t size();
+
+
+    /**
+     * @brief Get the worker calls for a mission and time are routed to when it is idle
+     *
+     * @param mission mission name in the config
+     * @param et ephemeris time
+     * @return size_t index of the worker
+     */
+    size_t getPreferredWorker(std::string mission, double et);
+
+
+    /**
+     * @brief Get a worker's process id
+     *
+     * @param index index of the worker
+     * @return pid_t process id of the worker, it changes if the worker dies and is forked again
+     * @throws std::out_of_range if there is no worker at index
+     */
+    pid_t getWorkerPid(size_t index);
+
+
+    //! getTargetStates on a worker, see SpiceQL::getTargetStates
+    std::vector<std::vector<double>> getTargetStates(std::vector<double> ets, std::string target, std::string observer,
+                                                     std::string frame="J2000", std::string abcorr="NONE", std::string mission="",
+                                                     std::string ckQuality="reconstructed", std::string spkQuality="reconstructed",
+                                                     bool searchKernels=true);
+
+    //! getTargetOrientations on a worker, see SpiceQL::getTargetOrientations
+    std::vector<std::vector<double>> getTargetOrientations(std::vector<double> ets, int toFrame, int refFrame=1, std::string mission="",
+                                                           std::string ckQuality="reconstructed", bool searchKernels=true);
+
+    //! frameTrace on a worker, see SpiceQL::frameTrace
+    std::vector<std::vector<int>> frameTrace(double et, int initialFrame, std::string mission="", std::string ckQuality="reconstructed",
+                                             bool searchKernels=true);
+
+    //! translateNameToCode on a worker, see SpiceQL::translateNameToCode
+    int translateNameToCode(std::string frame, std::string mission="", bool searchKernels=true);
+
+    //! translateCodeToName on a worker, see SpiceQL::translateCodeToName
+    std::string translateCodeToName(int frame, std::string mission="", bool searchKernels=true);
+
+    //! utcToEt on a worker, see SpiceQL::utcToEt
+    double utcToEt(std::string utc, bool searchKernels=true);
+
+    //! etToUtc on a worker, see SpiceQL::etToUtc
+    std::string etToUtc(double et, std::string format="C", double precision=8, bool searchKernels=true);
+
+    protected:
+
+    /**
+     * @brief Add a function workers can run, for tests that need to see where calls go
+     *
+     * Workers get the functions added before they are forked, so this has to be called
+     * before the pool is created.
+     *
+     * @param name name to call the function with
+     * @param run the function, called with the json array of arguments
+     * @param missionArg position of the mission argument calls are routed on, -1 if there is none
+     * @param timeArg position of the time argument calls are routed on, -1 if there is none
+     */
+    static void addHandler(std::string name, std::function<nlohmann::json(nlohmann::json &)> run, int missionArg, int timeArg);
+
+    private:
+
+    //! shared memory header of a worker's slot, followed by the request and result buffer
+    struct Slot;
+
+    /**
+     * @brief fork a worker for a slot
+     *
+     * @param index worker index
+     */
+    void spawn(size_t index);
+
+
+    /**
+     * @brief kill a slot's worker, even if it is still running a call, and fork a new one
+     *
+     * @param index worker index
+     */
+    void respawn(size_t index);
+
+
+    /**
+     * @brief tell the workers to exit, wait for them and release their slots
+     */
+    void stopWorkers();
+
+
+    /**
+     * @brief serve requests in a forked worker, never returns
+     *
+     * @param slot the worker's slot
+     * @param slotBytes size of the slot's buffer
+     */
+    [[noreturn]] static void serve(Slot *slot, size_t slotBytes);
+
+
+    /**
+     * @brief hash a mission and the bucket of a time
+     *
+     * @param mission mission name
+     * @param et ephemeris time, if the call has one
+     * @return size_t routing key
+     */
+    size_t getAffinityKey(std::string mission, std::optional<double> et);
+
+
+    /**
+     * @brief find the first point on the hash ring at or after a key
+     *
+     * @param key routing key
+     * @return size_t index into ring
+     */
+    size_t ringPosition(size_t key);
+
+    //! size of each slot's buffer
+    size_t slotBytes;
+
+    //! shared memory slot of each worker
+    std::vector<Slot*> slots;
+
+    //! process id of each worker
+    std::vector<pid_t> pids;
+
+    //! hash ring of (point, worker index), sorted on point
+    std::vector<std::pair<size_t, size_t>> ring;
+
+    //! seconds per time bucket used for routing
+    double timeBucket = 86400;
+
+    //! whether each worker is running a call
+    std::vector<bool> busy;
+
+    //! number of workers waiting for a call
+    size_t idleCount = 0;
+
+    //! where calls without a mission start looking on the ring, so they are spread out
+    size_t nextStart = 0;
+
+    //! guards busy, idleCount, nextStart and pids
+    std::mutex idleLock;
+    std::condition_variable idleReady;
+  };
+}
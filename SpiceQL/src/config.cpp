@@ -124,6 +124,10 @@ namespace SpiceQL {
 
     vector<json::json_pointer> json_to_eval = SpiceQL::findKeyInJson(eval_json, "kernels", true);
 
+    // group the regexes by the directory they are searched in, so each directory is scanned once
+    map<string, vector<json::json_pointer>> pointersByRoot;
+    map<string, vector<vector<string>>> regexesByRoot;
+
     for (auto json_pointer:json_to_eval) {
       json::json_pointer full_pointer = pointer / json_pointer;
 
@@ -139,8 +143,17 @@ namespace SpiceQL {
         }
       }
 
-      vector<vector<string>> res = Memo::getPathsFromRegex(fsDataPath, jsonArrayToVector(eval_json[json_pointer]));
-      eval_json[json_pointer] = res;
+      pointersByRoot[fsDataPath].push_back(json_pointer);
+      regexesByRoot[fsDataPath].push_back(jsonArrayToVector(eval_json[json_pointer]));
+    }
+
+    for (auto &[root, regexGroups] : regexesByRoot) {
+      vector<vector<vector<string>>> res = Memo::getPathsFromRegexGroups(root, regexGroups);
+      vector<json::json_pointer> &pointers = pointersByRoot[root];
+
+      for (size_t i = 0; i < res.size(); i++) {
+        eval_json[pointers[i]] = res[i];
+      }
     }
     copyConfig[pointer] = eval_json;
 
@@ -200,6 +213,60 @@ namespace SpiceQL {
   }
 
 
+  json Config::get(string pointer, vector<string> kernelTypes, map<string, vector<string>> qualities) {
+    json::json_pointer getConfPointer(confPointer);
+
+    if (pointer != "") {
+      if (pointer.at(0) != '/')
+      {
+        pointer = "/" + pointer;
+      }
+      json::json_pointer p(pointer);
+      json::json_pointer pbase(confPointer);
+      getConfPointer = (pbase / p);
+    }
+
+    if (!config.contains(getConfPointer)) {
+      return {};
+    }
+
+    // prune the unevaluated config so only the requested regex groups get expanded
+    json prunedConfig(config);
+    json &subConf = prunedConfig[getConfPointer];
+    vector<string> typesToErase;
+
+    for (auto &[key, value] : subConf.items()) {
+      bool isKernelType = find(Kernel::TYPES.begin(), Kernel::TYPES.end(), key) != Kernel::TYPES.end();
+      bool isRequested = find(kernelTypes.begin(), kernelTypes.end(), key) != kernelTypes.end();
+
+      if (isKernelType && !isRequested) {
+        typesToErase.push_back(key);
+        continue;
+      }
+
+      auto qualIt = qualities.find(key);
+      if (!isKernelType || qualIt == qualities.end() || !value.is_object()) {
+        continue;
+      }
+
+      for (auto &qual : Kernel::QUALITIES) {
+        if (value.contains(qual) && find(qualIt->second.begin(), qualIt->second.end(), qual) == qualIt->second.end()) {
+          SPDLOG_TRACE("Skipping {} {} kernels in {}", qual, key, getConfPointer.to_string());
+          value.erase(qual);
+        }
+      }
+    }
+
+    for (auto &key : typesToErase) {
+      SPDLOG_TRACE("Skipping {} kernels in {}", key, getConfPointer.to_string());
+      subConf.erase(key);
+    }
+
+    Config prunedConf(prunedConfig, confPointer);
+    return prunedConf.get(pointer);
+  }
+
+
   json Config::getLatest(string pointer) {
     json res;
     res[pointer] = get(pointer);
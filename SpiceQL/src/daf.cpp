@@ -0,0 +1,233 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <fmt/format.h>
+#include <spdlog/spdlog.h>
+
+#include "daf.h"
+
+
+using namespace std;
+
+namespace SpiceQL {
+
+  namespace {
+    // DAF files are made of 1024 byte records, 128 doubles each
+    const size_t RECORD_BYTES = 1024;
+    const size_t RECORD_DOUBLES = RECORD_BYTES / sizeof(double);
+
+    // file record layout
+    const size_t IDWORD_OFFSET = 0;
+    const size_t ND_OFFSET = 8;
+    const size_t NI_OFFSET = 12;
+    const size_t FWARD_OFFSET = 76;
+    const size_t FORMAT_OFFSET = 88;
+
+    /**
+     * Read only memory map of a whole file, unmapped when it goes out of scope
+     */
+    class MappedFile {
+      public:
+        MappedFile(const string &path) {
+          int fd = open(path.c_str(), O_RDONLY);
+          if (fd < 0) {
+            throw invalid_argument(fmt::format("Unable to open {}", path));
+          }
+
+          struct stat info;
+          if (fstat(fd, &info) != 0) {
+            close(fd);
+            throw invalid_argument(fmt::format("Unable to stat {}", path));
+          }
+          size = static_cast<size_t>(info.st_size);
+
+          if (size > 0) {
+            void *mapped = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapped == MAP_FAILED) {
+              close(fd);
+              throw invalid_argument(fmt::format("Unable to map {}", path));
+            }
+            data = static_cast<const unsigned char*>(mapped);
+          }
+          close(fd);
+        }
+
+        ~MappedFile() {
+          if (data != nullptr) {
+            munmap(const_cast<unsigned char*>(data), size);
+          }
+        }
+
+        MappedFile(const MappedFile &) = delete;
+        MappedFile &operator=(const MappedFile &) = delete;
+
+        const unsigned char *data = nullptr;
+        size_t size = 0;
+    };
+
+
+    bool isHostLittleEndian() {
+      uint16_t probe = 1;
+      unsigned char first;
+      memcpy(&first, &probe, 1);
+      return first == 1;
+    }
+
+
+    template <typename T>
+    T readValue(const unsigned char *bytes, bool swap) {
+      unsigned char buffer[sizeof(T)];
+      memcpy(buffer, bytes, sizeof(T));
+      if (swap) {
+        reverse(buffer, buffer + sizeof(T));
+      }
+      T value;
+      memcpy(&value, buffer, sizeof(T));
+      return value;
+    }
+
+
+    /**
+     * Converts a count stored as a double, false if it isn't a whole number from 0 to max.
+     * Casting a double out of size_t's range is undefined, so corrupt values are checked first.
+     */
+    bool toCount(double value, size_t max, size_t &count) {
+      if (!(value >= 0 && value <= static_cast<double>(max)) || value != static_cast<double>(static_cast<size_t>(value))) {
+        return false;
+      }
+      count = static_cast<size_t>(value);
+      return true;
+    }
+
+
+    string trim(string s) {
+      s.erase(find_if(s.rbegin(), s.rend(), [](unsigned char c) { return !isspace(c) && c != '\0'; }).base(), s.end());
+      return s;
+    }
+  }
+
+
+  DafSummaries readDafSummaries(string path) {
+    MappedFile file(path);
+
+    if (file.size < RECORD_BYTES) {
+      throw invalid_argument(fmt::format("{} is too small to be a DAF", path));
+    }
+
+    // ID word is "DAF/<type>", e.g. "DAF/SPK " or "DAF/CK  "
+    string idWord = trim(string(reinterpret_cast<const char*>(file.data + IDWORD_OFFSET), 8));
+    if (idWord.rfind("DAF/", 0) != 0) {
+      throw invalid_argument(fmt::format("{} is not a DAF, ID word is \"{}\"", path, idWord));
+    }
+
+    string format = trim(string(reinterpret_cast<const char*>(file.data + FORMAT_OFFSET), 8));
+    bool hostLittle = isHostLittleEndian();
+    bool swap;
+    if (format == "LTL-IEEE") {
+      swap = !hostLittle;
+    }
+    else if (format == "BIG-IEEE") {
+      swap = hostLittle;
+    }
+    else if (format.empty()) {
+      // files older than the binary format ID are in the native format of the writer
+      swap = false;
+    }
+    else {
+      throw invalid_argument(fmt::format("{} has unsupported binary format \"{}\"", path, format));
+    }
+
+    DafSummaries summaries;
+    summaries.type = idWord.substr(4);
+    summaries.nd = readValue<int32_t>(file.data + ND_OFFSET, swap);
+    summaries.ni = readValue<int32_t>(file.data + NI_OFFSET, swap);
+    int32_t fward = readValue<int32_t>(file.data + FWARD_OFFSET, swap);
+
+    if (summaries.nd < 0 || summaries.nd > 124 || summaries.ni < 2 || summaries.ni > 250) {
+      throw invalid_argument(fmt::format("{} has invalid summary sizes ND={} NI={}", path, summaries.nd, summaries.ni));
+    }
+
+    // summary size in doubles, integers are packed two to a double
+    size_t summarySize = summaries.nd + (summaries.ni + 1) / 2;
+    size_t maxSummaries = (RECORD_DOUBLES - 3) / summarySize;
+    size_t totalRecords = file.size / RECORD_BYTES;
+
+    size_t record = fward;
+    size_t visited = 0;
+    while (record != 0) {
+      // a record past the end or more records than the file has means the list is corrupt
+      if (record > totalRecords || ++visited > totalRecords) {
+        throw invalid_argument(fmt::format("{} has a corrupt summary record list", path));
+      }
+
+      const unsigned char *rec = file.data + (record - 1) * RECORD_BYTES;
+      size_t next;
+      size_t nsum;
+      if (!toCount(readValue<double>(rec, swap), totalRecords, next)
+          || !toCount(readValue<double>(rec + 2 * sizeof(double), swap), RECORD_DOUBLES, nsum)) {
+        throw invalid_argument(fmt::format("{} has a corrupt summary record {}", path, record));
+      }
+      nsum = min(nsum, maxSummaries);
+
+      for (size_t i = 0; i < nsum; i++) {
+        const unsigned char *summary = rec + (3 + i * summarySize) * sizeof(double);
+        DafSegment segment;
+        segment.dc.reserve(summaries.nd);
+        segment.ic.reserve(summaries.ni);
+
+        for (int d = 0; d < summaries.nd; d++) {
+          segment.dc.push_back(readValue<double>(summary + d * sizeof(double), swap));
+        }
+
+        const unsigned char *ints = summary + summaries.nd * sizeof(double);
+        for (int n = 0; n < summaries.ni; n++) {
+          segment.ic.push_back(readValue<int32_t>(ints + n * sizeof(int32_t), swap));
+        }
+
+        summaries.segments.push_back(segment);
+      }
+
+      record = next;
+    }
+
+    SPDLOG_TRACE("Read {} {} segment summaries from {}", summaries.segments.size(), summaries.type, path);
+    return summaries;
+  }
+
+
+  map<int, vector<pair<double, double>>> getDafCoverage(const DafSummaries &summaries) {
+    if (summaries.nd < 2 || summaries.ni < 1) {
+      throw invalid_argument(fmt::format("{} summaries have no time bounds", summaries.type));
+    }
+
+    map<int, vector<pair<double, double>>> coverage;
+    for (auto &segment : summaries.segments) {
+      coverage[segment.ic[0]].push_back({segment.dc[0], segment.dc[1]});
+    }
+
+    // union of each body's segments, overlapping or touching intervals are merged
+    for (auto &[body, intervals] : coverage) {
+      sort(intervals.begin(), intervals.end());
+
+      vector<pair<double, double>> merged;
+      for (auto &interval : intervals) {
+        if (!merged.empty() && interval.first <= merged.back().second) {
+          merged.back().second = max(merged.back().second, interval.second);
+        }
+        else {
+          merged.push_back(interval);
+        }
+      }
+      intervals = merged;
+    }
+
+    return coverage;
+  }
+}
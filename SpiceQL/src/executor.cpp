@@ -0,0 +1,215 @@
+#include <new>
+
+#include <spdlog/spdlog.h>
+
+#include "executor.h"
+#include "utils.h"
+
+using namespace std;
+
+namespace SpiceQL {
+
+  namespace {
+    //! set on the executor thread so nested tasks run inline
+    thread_local bool onExecutorThread = false;
+  }
+
+
+  SpiceExecutor &SpiceExecutor::getInstance() {
+    static SpiceExecutor instance;
+    return instance;
+  }
+
+
+  SpiceExecutor::SpiceExecutor() {
+    Node *stub = new Node();
+    head.store(stub);
+    tail = stub;
+
+    if (getEnvBool("SPICEQL_SPICE_EXECUTOR")) {
+      setEnabled(true);
+    }
+  }
+
+
+  SpiceExecutor::~SpiceExecutor() {
+    setEnabled(false);
+    delete tail;
+  }
+
+
+  void SpiceExecutor::setEnabled(bool enable) {
+    lock_guard<mutex> lock(controlLock);
+    if (enable == enabled.load()) {
+      return;
+    }
+
+    if (enable) {
+      SPDLOG_DEBUG("Starting the SPICE executor thread");
+      enabled.store(true);
+      worker = thread(&SpiceExecutor::work, this);
+      return;
+    }
+
+    SPDLOG_DEBUG("Stopping the SPICE executor thread");
+    enabled.store(false);
+    {
+      lock_guard<mutex> sleep(sleepLock);
+      wake.notify_one();
+    }
+    worker.join();
+
+    // a producer that saw the executor on may still be queueing, run what it queued here
+    while (pushing.load() > 0) {
+      this_thread::yield();
+    }
+    function<void()> task;
+    while (pop(task)) {
+      task();
+    }
+  }
+
+
+  void SpiceExecutor::pauseForFork() {
+    controlLock.lock();
+    if (!enabled.load() || isExecutorThread()) {
+      return;
+    }
+
+    {
+      lock_guard<mutex> lock(pauseLock);
+      paused = true;
+      parked = false;
+    }
+
+    // holding controlLock keeps the executor on, so the park task is queued
+    push([this]() {
+      unique_lock<mutex> lock(pauseLock);
+      parked = true;
+      pauseReady.notify_all();
+      pauseReady.wait(lock, [&]() { return !paused; });
+    });
+
+    unique_lock<mutex> lock(pauseLock);
+    pauseReady.wait(lock, [&]() { return parked; });
+  }
+
+
+  void SpiceExecutor::resumeAfterFork() {
+    {
+      lock_guard<mutex> lock(pauseLock);
+      paused = false;
+      parked = false;
+    }
+    pauseReady.notify_all();
+    controlLock.unlock();
+  }
+
+
+  void SpiceExecutor::resetAfterFork() {
+    // the executor thread and any thread holding these doesn't exist in the child,
+    // so they are rebuilt in place instead of being released or joined
+    new (&sleepLock) mutex();
+    new (&wake) condition_variable();
+    new (&pauseLock) mutex();
+    new (&pauseReady) condition_variable();
+    new (&worker) thread();
+
+    // nobody in the child is waiting on the parent's queued tasks, their nodes are left behind
+    Node *stub = new Node();
+    head.store(stub);
+    tail = stub;
+    sleeping.store(false);
+    pushing.store(0);
+    paused = false;
+    parked = false;
+
+    if (isExecutorThread()) {
+      // the forking thread was running a task, the child runs everything inline on it
+      onExecutorThread = false;
+      enabled.store(false);
+    }
+    else if (enabled.load()) {
+      worker = thread(&SpiceExecutor::work, this);
+    }
+    controlLock.unlock();
+  }
+
+
+  bool SpiceExecutor::isEnabled() {
+    return enabled.load();
+  }
+
+
+  bool SpiceExecutor::isExecutorThread() {
+    return onExecutorThread;
+  }
+
+
+  bool SpiceExecutor::push(function<void()> task) {
+    // counted before checking enabled so setEnabled(false) either sees this push or is seen by it
+    pushing.fetch_add(1);
+    if (!enabled.load()) {
+      pushing.fetch_sub(1);
+      return false;
+    }
+
+    Node *node = new Node();
+    node->task = move(task);
+
+    // the swap orders producers, the previous node is linked to the new one after
+    Node *prev = head.exchange(node);
+    prev->next.store(node, memory_order_release);
+
+    if (sleeping.load()) {
+      lock_guard<mutex> lock(sleepLock);
+      wake.notify_one();
+    }
+    pushing.fetch_sub(1);
+    return true;
+  }
+
+
+  bool SpiceExecutor::pop(function<void()> &task) {
+    Node *next = tail->next.load(memory_order_acquire);
+    if (next == nullptr) {
+      if (head.load() == tail) {
+        return false;
+      }
+
+      // a producer swapped in a node but hasn't linked it yet
+      while ((next = tail->next.load(memory_order_acquire)) == nullptr) {
+        this_thread::yield();
+      }
+    }
+
+    task = move(next->task);
+    delete tail;
+    tail = next;
+    return true;
+  }
+
+
+  void SpiceExecutor::work() {
+    onExecutorThread = true;
+
+    function<void()> task;
+    while (true) {
+      while (pop(task)) {
+        task();
+      }
+
+      if (!enabled.load() && head.load() == tail) {
+        break;
+      }
+
+      // producers only take the lock when they see the executor is sleeping
+      unique_lock<mutex> lock(sleepLock);
+      sleeping.store(true);
+      wake.wait(lock, [&]() { return head.load() != tail || !enabled.load(); });
+      sleeping.store(false);
+    }
+
+    onExecutorThread = false;
+  }
+}
@@ -0,0 +1,159 @@
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+
+#include <pthread.h>
+#include <unistd.h>
+
+#include <fmt/format.h>
+#include <ghc/fs_std.hpp>
+#include <spdlog/spdlog.h>
+#include <spdlog/sinks/rotating_file_sink.h>
+
+#include "executor.h"
+#include "fork.h"
+#include "memo.h"
+#include "spice_types.h"
+#include "utils.h"
+
+using namespace std;
+
+namespace SpiceQL {
+
+  namespace {
+    //! held from prepareFork until the fork is over, so only one thread forks at a time
+    mutex forkLock;
+
+    //! whether the hooks are registered with pthread_atfork
+    bool handlersRegistered = false;
+
+
+    /**
+     * @brief move the file log to a file for this process
+     */
+    void reopenFileLog() {
+      shared_ptr<spdlog::logger> fileLog = spdlog::get("spiceql_file_log");
+      if (!fileLog) {
+        return;
+      }
+
+      fs::path logDir;
+      for (auto &sink : fileLog->sinks()) {
+        auto fileSink = dynamic_pointer_cast<spdlog::sinks::rotating_file_sink_mt>(sink);
+        if (fileSink) {
+          logDir = fs::path(fileSink->filename()).parent_path();
+        }
+      }
+      if (logDir.empty()) {
+        return;
+      }
+
+      // processes rotating the same file would rotate each other's logs away, same limits as the parent's log
+      spdlog::drop("spiceql_file_log");
+      try {
+        spdlog::rotating_logger_mt("spiceql_file_log", logDir / fmt::format("spiceql_logs.{}.txt", getpid()), 1048576 * 10, 5);
+      }
+      catch (const spdlog::spdlog_ex &ex) {
+        SPDLOG_ERROR("file log init failed: {}", ex.what());
+      }
+    }
+  }
+
+
+  void prepareFork() {
+    forkLock.lock();
+
+    // an unset cache directory would be picked at random by each child
+    try {
+      string cacheDir = Memo::getCacheDir();
+      setenv("SPICEQL_CACHE_DIR", cacheDir.c_str(), 0);
+    }
+    catch (exception &e) {
+      SPDLOG_WARN("Unable to set the cache directory before forking: {}", e.what());
+    }
+
+    spdlog::apply_all([](shared_ptr<spdlog::logger> logger) { logger->flush(); });
+
+    // CSPICE work goes through the executor, parking it between tasks keeps the kernel pool
+    // consistent in the child without stopping queries running on other threads
+    SpiceExecutor &executor = SpiceExecutor::getInstance();
+    if (executor.isEnabled() && executor.isExecutorThread()) {
+      SPDLOG_WARN("Forking from the SPICE executor thread, the child's executor will be off.");
+    }
+    executor.pauseForFork();
+    pausePrefetchForFork();
+  }
+
+
+  void parentAfterFork() {
+    resumePrefetchAfterFork();
+    SpiceExecutor::getInstance().resumeAfterFork();
+    forkLock.unlock();
+  }
+
+
+  void childAfterFork() {
+    resetPrefetchAfterFork();
+    SpiceExecutor::getInstance().resetAfterFork();
+    reopenFileLog();
+
+    try {
+      KernelPool::getInstance().reopenKernels();
+    }
+    catch (exception &e) {
+      SPDLOG_ERROR("Unable to reopen kernels after forking: {}", e.what());
+    }
+
+    SPDLOG_DEBUG("Set up forked SpiceQL process {}", getpid());
+    forkLock.unlock();
+  }
+
+
+  void registerForkHandlers() {
+    static once_flag registered;
+    call_once(registered, []() {
+      int err = pthread_atfork(prepareFork, parentAfterFork, childAfterFork);
+      if (err != 0) {
+        throw runtime_error(fmt::format("Unable to register SpiceQL fork handlers: {}", strerror(err)));
+      }
+      handlersRegistered = true;
+      SPDLOG_DEBUG("Registered SpiceQL fork handlers");
+    });
+  }
+
+
+  bool isForkHandlersRegistered() {
+    return handlersRegistered;
+  }
+
+
+  pid_t forkProcess() {
+    bool runHooks = !isForkHandlersRegistered();
+
+    if (runHooks) {
+      prepareFork();
+    }
+
+    pid_t pid = fork();
+    if (pid < 0) {
+      int err = errno;
+      if (runHooks) {
+        parentAfterFork();
+      }
+      throw runtime_error(fmt::format("Unable to fork: {}", strerror(err)));
+    }
+
+    if (runHooks) {
+      if (pid == 0) {
+        childAfterFork();
+      }
+      else {
+        parentAfterFork();
+      }
+    }
+    return pid;
+  }
+}
@@ -5,6 +5,7 @@
 
 #include "SpiceUsr.h"
 
+#include "executor.h"
 #include "io.h"
 #include "utils.h"
 
@@ -84,38 +85,40 @@ namespace SpiceQL {
                optional<vector<vector<double>>> angularVelocities,
                optional<string> comment) {
 
-    SpiceInt handle;
+    runOnSpiceExecutor([&]() {
+      SpiceInt handle;
     
-    // convert times, but first, we need SCLK+LSK kernels
-    Kernel sclkKernel(sclk);
-    Kernel lskKernel(lsk);
-
-    for(auto &et : times) {
-      double sclkdp;
+      // convert times, but first, we need SCLK+LSK kernels
+      Kernel sclkKernel(sclk);
+      Kernel lskKernel(lsk);
+
+      for(auto &et : times) {
+        double sclkdp;
+        checkNaifErrors();
+        sce2c_c(bodyCode/1000, et, &sclkdp);
+        checkNaifErrors();
+        et = sclkdp;
+      }
       checkNaifErrors();
-      sce2c_c(bodyCode/1000, et, &sclkdp);
+      ckopn_c(path.c_str(), "CK", comment.value_or("CK Kernel").size(), &handle);
       checkNaifErrors();
-      et = sclkdp;
-    }
-    checkNaifErrors();
-    ckopn_c(path.c_str(), "CK", comment.value_or("CK Kernel").size(), &handle);
-    checkNaifErrors();
-    ckw03_c (handle,
-             times.at(0),
-             times.at(times.size()-1),
-             bodyCode,
-             referenceFrame.c_str(),
-             (bool)angularVelocities,
-             segmentId.c_str(),
-             times.size(),
-             times.data(),
-             quats.data(),
-             (angularVelocities) ? angularVelocities->data() : nullptr,
-             times.size(),
-             times.data());
-    checkNaifErrors();
-    ckcls_c(handle);
-    checkNaifErrors();
+      ckw03_c (handle,
+               times.at(0),
+               times.at(times.size()-1),
+               bodyCode,
+               referenceFrame.c_str(),
+               (bool)angularVelocities,
+               segmentId.c_str(),
+               times.size(),
+               times.data(),
+               quats.data(),
+               (angularVelocities) ? angularVelocities->data() : nullptr,
+               times.size(),
+               times.data());
+      checkNaifErrors();
+      ckcls_c(handle);
+      checkNaifErrors();
+    });
   }
 
 
@@ -130,40 +133,40 @@ namespace SpiceQL {
                  optional<vector<vector<double>>> stateVelocities,
                  optional<string> segmentComment) {
 
-    vector<vector<double>> states;
+    runOnSpiceExecutor([&]() {
+      vector<vector<double>> states;
 
-    if (!stateVelocities) {
-      // init a 0 velocity array
-      vector<vector<double>> velocities;
-      for (int i = 0; i < statePositions.size(); i++) {
-        velocities.push_back({0,0,0});
+      if (!stateVelocities) {
+        // init a 0 velocity array
+        vector<vector<double>> velocities;
+        for (int i = 0; i < statePositions.size(); i++) {
+          velocities.push_back({0,0,0});
+        }
+        stateVelocities = velocities;
       }
-      stateVelocities = velocities;
-    }
 
-    states = concatStates(statePositions, *stateVelocities);
-
-    SpiceInt handle;
-    checkNaifErrors();
-    spkopn_c(fileName.c_str(), "SPK", 512, &handle);
-    checkNaifErrors();
-
-    spkw13_c(handle,
-             bodyCode,
-             centerOfMotion,
-             referenceFrame.c_str(),
-             stateTimes[0],
-             stateTimes[stateTimes.size() - 1],
-             segmentId.c_str(),
-             polyDegree,
-             stateTimes.size(),
-             states.data(),
-             stateTimes.data());
-    checkNaifErrors();
-    spkcls_c(handle);
-    checkNaifErrors();
+      states = concatStates(statePositions, *stateVelocities);
 
-    return;
+      SpiceInt handle;
+      checkNaifErrors();
+      spkopn_c(fileName.c_str(), "SPK", 512, &handle);
+      checkNaifErrors();
+
+      spkw13_c(handle,
+               bodyCode,
+               centerOfMotion,
+               referenceFrame.c_str(),
+               stateTimes[0],
+               stateTimes[stateTimes.size() - 1],
+               segmentId.c_str(),
+               polyDegree,
+               stateTimes.size(),
+               states.data(),
+               stateTimes.data());
+      checkNaifErrors();
+      spkcls_c(handle);
+      checkNaifErrors();
+    });
   }
 
 
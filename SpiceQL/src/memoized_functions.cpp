@@ -12,7 +12,14 @@ namespace SpiceQL {
   vector<pair<double, double>> Memo::getTimeIntervals(string kpath) {
     Cache c({kpath});
     static auto func_memoed = make_memoized(c, "spiceql_getTimeIntervals", SpiceQL::getTimeIntervals);
-    return func_memoed(kpath); 
+    return func_memoed(kpath, getCkCoverageLevel(), getCkCoverageTolerance());
+  }
+
+
+  string Memo::getBodyCoverage(string kpath) {
+    Cache c({kpath});
+    static auto func_memoed = make_memoized(c, "spiceql_getBodyCoverage", SpiceQL::getBodyCoverage);
+    return func_memoed(kpath, getCkCoverageLevel(), getCkCoverageTolerance());
   }
 
 
@@ -32,6 +39,14 @@ namespace SpiceQL {
   }
 
 
+  vector<vector<vector<string>>> Memo::getPathsFromRegexGroups(string root, vector<vector<string>> regexGroups) {
+    Cache c({fs::path(root)});
+    SPDLOG_TRACE("Calling getPathsFromRegexGroups via cache");
+    static auto func_memoed = make_memoized(c, "spiceql_getPathsFromRegexGroups", SpiceQL::getPathsFromRegexGroups);
+    return func_memoed(root, regexGroups);
+  }
+
+
   vector<string> Memo::ls(string const & root, bool recursive) {
     Cache c({root});
     SPDLOG_TRACE("Calling ls via cache");
@@ -40,6 +55,14 @@ namespace SpiceQL {
   }
 
 
+  map<string, string> Memo::getKernelTypes(string const & root, bool recursive) {
+    Cache c({root});
+    SPDLOG_TRACE("Calling getKernelTypes via cache");
+    static auto func_memoed = make_memoized(c, "spiceql_getKernelTypes", SpiceQL::getKernelTypes);
+    return func_memoed(root, recursive);
+  }
+
+
   int Memo::translateNameToCode(string frame, string mission, bool searchKernels) {
     Cache c({getDataDirectory()});
     spdlog::trace("Calling translateNameToCode via cache");
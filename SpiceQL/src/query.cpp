@@ -8,6 +8,11 @@
 #include <algorithm>
 #include <chrono>
 #include <fstream>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <set>
+#include <unordered_map>
 
 #include <SpiceUsr.h>
 
@@ -16,6 +21,8 @@
 
 #include <spdlog/spdlog.h>
 
+#include "executor.h"
+#include "memo.h"
 #include "query.h"
 #include "spice_types.h"
 #include "utils.h"
@@ -28,46 +35,77 @@ using namespace std::chrono;
 
 namespace SpiceQL {
 
+  //! bumped when the timeline format changes so timelines in old caches are rebuilt
+  static const int TIMELINE_VERSION = 2;
+
 
  std::string getKernelStringValue(std::string key) {
-   // check to make sure the key exists when calling findKeyWords(key)
-   if (findKeywords(key).contains(key)){
-      json results = findKeywords(key);
-      std::string keyResult;
-      if (results[key].is_string()) {
-          keyResult = results[key];
+   return runOnSpiceExecutor([&]() -> string {
+     // check to make sure the key exists when calling findKeyWords(key)
+     if (findKeywords(key).contains(key)){
+        json results = findKeywords(key);
+        std::string keyResult;
+        if (results[key].is_string()) {
+            keyResult = results[key];
+        }
+        else {
+            keyResult = results[key].dump();
+        }
+        return keyResult;
       }
-      else {
-          keyResult = results[key].dump();
+      // throw exception
+      else{
+        throw std::invalid_argument("key not in results");
       }
-      return keyResult;
-    }
-    // throw exception
-    else{
-      throw std::invalid_argument("key not in results");
-    }
+   });
   }
 
   std::vector<string> getKernelVectorValue(std::string key) {
+    return runOnSpiceExecutor([&]() -> vector<string> {
+      // check to make sure the key exists when calling findKeyWords(key)
+      if (findKeywords(key).contains(key)){
+
+        // get json results of key
+        json results = findKeywords(key);
+        vector<string> kernelValues;
+
+        // iterate over results @ key
+        for(auto i : results[key]){
+          // push values to vector
+          kernelValues.push_back(to_string(i));
+        }
+        return kernelValues;
+      }
+      // throw exception
+      else{
+        throw std::invalid_argument("key not in results");
+      }
+    });
+  }
 
-    // check to make sure the key exists when calling findKeyWords(key)
-    if (findKeywords(key).contains(key)){
 
-      // get json results of key
-      json results = findKeywords(key);
-      vector<string> kernelValues;
+  string getKernelVersionKey(string kernel) {
+    // zero pad every number so versions compare numerically, e.g. v9 before v10
+    const size_t width = 20;
+    string filename = static_cast<fs::path>(kernel).filename();
+    string key;
+    for (size_t i = 0; i < filename.size();) {
+      if (!isdigit(static_cast<unsigned char>(filename[i]))) {
+        key += filename[i++];
+        continue;
+      }
 
-      // iterate over results @ key
-      for(auto i : results[key]){
-        // push values to vector
-        kernelValues.push_back(to_string(i));
+      size_t end = i;
+      while (end < filename.size() && isdigit(static_cast<unsigned char>(filename[end]))) {
+        end++;
       }
-      return kernelValues;
-    }
-    // throw exception
-    else{
-      throw std::invalid_argument("key not in results");
+      string digits = filename.substr(i, end - i);
+      digits.erase(0, min(digits.find_first_not_of('0'), digits.size() - 1));
+      key += string(width > digits.size() ? width - digits.size() : 0, '0') + digits;
+      i = end;
     }
+
+    return key;
   }
 
 
@@ -75,44 +113,45 @@ namespace SpiceQL {
     if(kernels.empty()) {
       throw invalid_argument("Can't get latest kernel from empty vector");
     }
-    vector<vector<string>> files = {};
 
     string extension = static_cast<fs::path>(kernels.at(0)).extension();
     transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
-    // ensure everything is different versions of the same file
+
+    // kernels are different versions of the same file if their names match up to the first digit
+    vector<vector<string>> files = {};
+    unordered_map<string, size_t> groups;
+
     for(const fs::path &k : kernels) {
       string currentKernelExt = k.extension();
       transform(currentKernelExt.begin(), currentKernelExt.end(), currentKernelExt.begin(), ::tolower);
+      // ensure everything is different versions of the same file
       if (currentKernelExt != extension) {
         throw invalid_argument("The input extensions (" + (string)k.filename() + ") are not different versions of the same file " + kernels.at(0));
       }
-      bool foundList = false;
-      for (int i = 0; i < files.size(); i++) {
-        const fs::path &firstVecElem = files[i][0];
-        string fileName = firstVecElem.filename();
-        string kernelName = k.filename();
-        int findRes = fileName.find_first_of("0123456789");
-        if (findRes != string::npos) {
-          fileName = fileName.erase(findRes);
-        }
-        findRes = kernelName.find_first_of("0123456789");
-        if (findRes != string::npos) {
-          kernelName = kernelName.erase(findRes);
-        }
-        if (fileName == kernelName) {
-          files[i].push_back(k);
-          foundList = true;
-        }
-      }
-      if (!foundList) {
-        files.push_back({k});
+
+      string kernelName = k.filename();
+      kernelName = kernelName.substr(0, kernelName.find_first_of("0123456789"));
+
+      auto [group, added] = groups.emplace(kernelName, files.size());
+      if (added) {
+        files.push_back({});
       }
-      foundList = false;
+      files[group->second].push_back(k);
     }
 
     vector<string> outKernels = {};
-    for (auto kernelList : files) {
-      outKernels.push_back(*(max_element(kernelList.begin(), kernelList.end())));
+    for (auto &kernelList : files) {
+      // each key is computed once per call rather than on every comparison
+      size_t latest = 0;
+      string latestKey = getKernelVersionKey(kernelList[0]);
+      for (size_t i = 1; i < kernelList.size(); i++) {
+        string key = getKernelVersionKey(kernelList[i]);
+        if (key > latestKey || (key == latestKey && kernelList[i] > kernelList[latest])) {
+          latest = i;
+          latestKey = key;
+        }
+      }
+      outKernels.push_back(kernelList[latest]);
     }
 
     return outKernels;
@@ -147,24 +186,39 @@ namespace SpiceQL {
 
     json ret;
 
+    // every regex group is gathered first so the kernel directory is only scanned once
+    vector<vector<string>> regexGroups;
+    vector<json::json_pointer> groupPointers;
+    vector<bool> keepEmpty;
+
+    auto addGroup = [&](json::json_pointer dest, json regexes, bool keepIfEmpty) {
+      regexGroups.push_back(jsonArrayToVector(regexes));
+      groupPointers.push_back(dest);
+      keepEmpty.push_back(keepIfEmpty);
+    };
+
+    auto addDeps = [&](json::json_pointer dest, json &deps) {
+      if (deps.contains("sclk")) {
+        addGroup(dest / "deps" / "sclk", deps.at("sclk"), true);
+      }
+      if (deps.contains("pck")) {
+        addGroup(dest / "deps" / "pck", deps.at("pck"), true);
+      }
+      if (deps.contains("objs")) {
+        ret[dest / "deps" / "objs"] = deps.at("objs");
+      }
+    };
+
     // iterate pointers
     for(auto pointer : pointers) {
       json category = conf[pointer];
 
       if (category.contains("kernels")) {
-        ret[pointer]["kernels"] = getPathsFromRegex(root, jsonArrayToVector(category.at("kernels")));
+        addGroup(pointer / "kernels", category.at("kernels"), true);
       }
 
       if (category.contains("deps")) {
-        if (category.at("deps").contains("sclk")) {
-          ret[pointer]["deps"]["sclk"] = getPathsFromRegex(root, category.at("deps").at("sclk"));
-        }
-        if (category.at("deps").contains("pck")) {
-          ret[pointer]["deps"]["pck"] = getPathsFromRegex(root, category.at("deps").at("pck"));
-        }
-        if (category.at("deps").contains("objs")) {
-          ret[pointer]["deps"]["objs"] = category.at("deps").at("objs");
-        }
+        addDeps(pointer, category.at("deps"));
       }
 
       // iterate over potential qualities
@@ -173,22 +227,22 @@ namespace SpiceQL {
           continue;
         }
 
-        vector<vector<string>> binKernels = getPathsFromRegex(root, jsonArrayToVector(category[qual].at("kernels")));
-        if (!binKernels.empty()) {
-          ret[pointer][qual]["kernels"] = binKernels;
-        } 
+        addGroup(pointer / qual / "kernels", category[qual].at("kernels"), false);
 
         if (category[qual].contains("deps")) {
-          if (category[qual].at("deps").contains("sclk")) {
-            ret[pointer][qual]["deps"]["sclk"] = getPathsFromRegex(root, jsonArrayToVector(category[qual].at("deps").at("sclk")));
-          }
-          if (category[qual].at("deps").contains("pck")) {
-            ret[pointer][qual]["deps"]["pck"] = getPathsFromRegex(root, jsonArrayToVector(category[qual].at("deps").at("pck")));
-          }
-          if (category[qual].at("deps").contains("objs")) {
-            ret[pointer][qual]["deps"]["objs"] = category[qual].at("deps").at("objs");
-          }
+          addDeps(pointer / qual, category[qual].at("deps"));
+        }
+      }
+    }
+
+    if (!regexGroups.empty()) {
+      vector<vector<vector<string>>> results = getPathsFromRegexGroups(root, regexGroups);
+
+      for (size_t i = 0; i < results.size(); i++) {
+        if (results[i].empty() && !keepEmpty[i]) {
+          continue;
         }
+        ret[groupPointers[i]] = results[i];
       }
     }
 
@@ -245,9 +299,31 @@ namespace SpiceQL {
         json ckQual = cks[qual]["kernels"];
         newKernels = json::array();
 
+        // file name dates only save work when coverage is read per kernel, with the mission's
+        // coverage already loaded a lookup is cheaper than matching the name
+        vector<FilenameDateExtractor> dateExtractors;
+        if (cachedTimes.empty() || cachedTimes.is_null()) {
+          dateExtractors = compileDateExtractors(cks[qual].value("dates", json::array()));
+        }
+
         for(auto &subArr : ckQual) {
           for (auto &kernel : subArr) {
             json newKernelsSubArr = json::array();
+
+            // rule out kernels by the dates in their name before reading their coverage
+            if (!dateExtractors.empty()) {
+              optional<pair<double, double>> nameRange = getFilenameDateRange(kernel.get<string>(), dateExtractors);
+              // the file only has to overlap the search window, a window can span several files
+              if (nameRange && !times.empty()) {
+                auto [first, last] = minmax_element(times.cbegin(), times.cend());
+                bool possible = *first <= nameRange->second && *last >= nameRange->first;
+                if (!possible) {
+                  SPDLOG_TRACE("Skipping {}, file name dates are outside of the search times", kernel.get<string>());
+                  continue;
+                }
+              }
+            }
+
             vector<pair<double, double>> intervals;
             if(cachedTimes.empty() || cachedTimes.is_null()) {
               SPDLOG_TRACE("Getting times");
@@ -278,6 +354,10 @@ namespace SpiceQL {
         
         SPDLOG_TRACE("newKernels {}", newKernels.dump());
         reducedKernels[p/qual/"kernels"] = newKernels;
+        // the date extractors are only needed for the search, drop them from the result
+        if (cks[qual].contains("dates")) {
+          reducedKernels[p/qual/"dates"] = nullptr;
+        }
         reducedKernels[p]["deps"] = kernels[p]["deps"];
       }
     }
@@ -349,42 +429,449 @@ namespace SpiceQL {
   }
 
 
+  vector<string> getQualityFallbacks(string quality) {
+    // "na" comes first in QUALITIES, the rest go from the lowest quality to the highest
+    auto requested = find(Kernel::QUALITIES.begin(), Kernel::QUALITIES.end(), quality);
+    if (requested == Kernel::QUALITIES.end()) {
+      throw invalid_argument(fmt::format("{} is not a valid kernel quality", quality));
+    }
+
+    // qualities are tried from the requested one down to the lowest, "na" takes any quality
+    vector<string> qualities;
+    for (auto it = requested; it != Kernel::QUALITIES.begin(); it--) {
+      qualities.push_back(*it);
+    }
+    return qualities;
+  }
+
+
+  json filterKernelsByBodies(json kernels, vector<int> bodies, vector<double> times, json bodyCoverage) {
+    if (times.empty() || bodies.empty()) {
+      return kernels;
+    }
+    double startTime = *min_element(times.begin(), times.end());
+    double stopTime = *max_element(times.begin(), times.end());
+
+    // only kernel lists under an spk or tspk key are filtered
+    vector<json::json_pointer> spkPointers;
+    for (auto &p : findKeyInJson(kernels, "kernels", true)) {
+      string pointer = p.to_string();
+      if (pointer.find("/spk/") != string::npos || pointer.find("/tspk/") != string::npos) {
+        spkPointers.push_back(p);
+      }
+    }
+
+    map<string, json> coverage;
+    for (auto &p : spkPointers) {
+      for (auto &kernel : getKernelsAsVector(kernels[p])) {
+        if (!coverage.count(kernel)) {
+          coverage[kernel] = bodyCoverage.contains(kernel) ? bodyCoverage[kernel] : json::parse(Memo::getBodyCoverage(kernel));
+        }
+      }
+    }
+
+    auto coversTimes = [&](json &body) -> bool {
+      for (auto &interval : body["intervals"]) {
+        if (interval[0].get<double>() <= stopTime && interval[1].get<double>() >= startTime) {
+          return true;
+        }
+      }
+      return false;
+    };
+
+    // follow the centers of motion until every body in the chain is known
+    set<int> needed(bodies.begin(), bodies.end());
+    bool grew = true;
+    while (grew) {
+      grew = false;
+      for (auto &[kernel, kernelBodies] : coverage) {
+        for (auto &[id, body] : kernelBodies.items()) {
+          if (!needed.count(stoi(id)) || !body.contains("centers") || !coversTimes(body)) {
+            continue;
+          }
+          for (int center : body["centers"].get<vector<int>>()) {
+            grew |= needed.insert(center).second;
+          }
+        }
+      }
+    }
+    SPDLOG_DEBUG("Bodies needed for {}: {}", fmt::join(bodies, ", "), fmt::join(needed, ", "));
+
+    auto isNeeded = [&](const string &kernel) -> bool {
+      json &kernelBodies = coverage[kernel];
+      if (kernelBodies.empty()) {
+        return true;
+      }
+      for (auto &[id, body] : kernelBodies.items()) {
+        if (needed.count(stoi(id)) && coversTimes(body)) {
+          return true;
+        }
+      }
+      SPDLOG_TRACE("Dropping {}, it has none of the needed bodies over the times", kernel);
+      return false;
+    };
+
+    for (auto &p : spkPointers) {
+      json filtered = json::array();
+      for (auto &subArr : json2DArrayTo2DVector(kernels[p])) {
+        vector<string> keep;
+        copy_if(subArr.begin(), subArr.end(), back_inserter(keep), isNeeded);
+        if (!keep.empty()) {
+          filtered.push_back(keep);
+        }
+      }
+      kernels[p] = filtered;
+    }
+
+    return kernels;
+  }
+
+
+  json getMinimalCoveringKernels(json kernels, vector<double> times, json bodyCoverage) {
+    if (times.empty()) {
+      return kernels;
+    }
+
+    // segment level CK coverage can span gaps where SPICE falls through to earlier kernels
+    bool minimizeCks = getCkCoverageLevel() == "INTERVAL";
+
+    // callers usually pass the ends of a window, everything in between gets looked up too
+    double startTime = *min_element(times.begin(), times.end());
+    double stopTime = *max_element(times.begin(), times.end());
+
+    for (auto &p : findKeyInJson(kernels, "kernels", true)) {
+      string pointer = p.to_string();
+      bool isSpk = pointer.find("/spk/") != string::npos || pointer.find("/tspk/") != string::npos;
+      bool isCk = pointer.find("/ck/") != string::npos;
+      if (!isSpk && !(isCk && minimizeCks)) {
+        continue;
+      }
+
+      // kernels are furnished in list order, so later kernels take precedence
+      vector<vector<string>> subArrs = json2DArrayTo2DVector(kernels[p]);
+      vector<string> ordered;
+      for (auto &subArr : subArrs) {
+        ordered.insert(ordered.end(), subArr.begin(), subArr.end());
+      }
+
+      vector<map<int, vector<pair<double, double>>>> coverage;
+      for (auto &kernel : ordered) {
+        map<int, vector<pair<double, double>>> bodies;
+        json kernelBodies = bodyCoverage.contains(kernel) ? bodyCoverage[kernel] : json::parse(Memo::getBodyCoverage(kernel));
+        for (auto &[id, body] : kernelBodies.items()) {
+          vector<pair<double, double>> intervals = json2DArrayToDoublePair(body["intervals"]);
+          sort(intervals.begin(), intervals.end());
+          bodies[stoi(id)] = intervals;
+        }
+        coverage.push_back(bodies);
+      }
+
+      auto covers = [](const vector<pair<double, double>> &intervals, double time) -> bool {
+        auto it = upper_bound(intervals.begin(), intervals.end(), make_pair(time, numeric_limits<double>::infinity()));
+        return it != intervals.begin() && prev(it)->second >= time;
+      };
+
+      set<int> bodyIds;
+      for (auto &bodies : coverage) {
+        for (auto &[id, intervals] : bodies) {
+          bodyIds.insert(id);
+        }
+      }
+
+      // a kernel is needed if it is the last loaded kernel covering some body somewhere in the window,
+      // kernels without known coverage can't be ruled out
+      vector<bool> needed(ordered.size(), false);
+      for (size_t k = 0; k < ordered.size(); k++) {
+        needed[k] = coverage[k].empty();
+      }
+
+      for (int id : bodyIds) {
+        // the last loaded kernel can only change at an interval boundary, so checking every
+        // boundary and a time between each pair of boundaries covers the whole window
+        vector<double> boundaries = {startTime, stopTime};
+        for (auto &bodies : coverage) {
+          auto body = bodies.find(id);
+          if (body == bodies.end()) {
+            continue;
+          }
+          for (auto &interval : body->second) {
+            if (interval.second >= startTime && interval.first <= stopTime) {
+              boundaries.push_back(max(startTime, interval.first));
+              boundaries.push_back(min(stopTime, interval.second));
+            }
+          }
+        }
+        sort(boundaries.begin(), boundaries.end());
+        boundaries.erase(unique(boundaries.begin(), boundaries.end()), boundaries.end());
+
+        vector<double> samples = boundaries;
+        for (size_t b = 0; b + 1 < boundaries.size(); b++) {
+          samples.push_back(boundaries[b] + (boundaries[b + 1] - boundaries[b]) / 2);
+        }
+
+        for (double time : samples) {
+          for (size_t k = ordered.size(); k-- > 0;) {
+            auto body = coverage[k].find(id);
+            if (body != coverage[k].end() && covers(body->second, time)) {
+              needed[k] = true;
+              break;
+            }
+          }
+        }
+      }
+
+      set<string> keep;
+      for (size_t k = 0; k < ordered.size(); k++) {
+        if (needed[k]) {
+          keep.insert(ordered[k]);
+        }
+        else {
+          SPDLOG_TRACE("Dropping {}, it is shadowed by later kernels over the whole window", ordered[k]);
+        }
+      }
+
+      json minimal = json::array();
+      for (auto &subArr : subArrs) {
+        vector<string> kept;
+        copy_if(subArr.begin(), subArr.end(), back_inserter(kept), [&](const string &k) { return keep.count(k) > 0; });
+        if (!kept.empty()) {
+          minimal.push_back(kept);
+        }
+      }
+      SPDLOG_DEBUG("Minimal covering set for {}: {} of {} kernels", pointer, keep.size(), ordered.size());
+      kernels[p] = minimal;
+    }
+
+    return kernels;
+  }
+
+
+  json buildKernelTimeline(json kernels, json coverage, vector<string> qualities) {
+    json timelineKernels = json::array();
+    vector<size_t> qualityRanks;
+
+    // kernels are listed best quality first, each quality in load order along with
+    // the version group they came from so searches can keep them grouped
+    for (size_t q = 0; q < qualities.size(); q++) {
+      if (!kernels.contains(qualities[q]) || !kernels[qualities[q]].contains("kernels")) {
+        continue;
+      }
+      vector<vector<string>> groups = json2DArrayTo2DVector(kernels[qualities[q]]["kernels"]);
+      for (size_t g = 0; g < groups.size(); g++) {
+        for (auto &kernel : groups[g]) {
+          timelineKernels.push_back({{"path", kernel}, {"quality", qualities[q]}, {"group", g}});
+          qualityRanks.push_back(q);
+        }
+      }
+    }
+
+    // sweep the start and stop of every interval, tracking which kernels cover each range
+    struct Event {
+      double time;
+      bool isStart;
+      size_t kernel;
+    };
+    vector<Event> events;
+    for (size_t k = 0; k < timelineKernels.size(); k++) {
+      string path = timelineKernels[k]["path"];
+      if (!coverage.contains(path)) {
+        continue;
+      }
+      for (auto &interval : json2DArrayToDoublePair(coverage[path])) {
+        events.push_back({interval.first, true, k});
+        events.push_back({interval.second, false, k});
+      }
+    }
+    sort(events.begin(), events.end(), [](const Event &a, const Event &b) { return a.time < b.time; });
+
+    vector<set<size_t>> active(qualities.size());
+    vector<int> activeCount(timelineKernels.size(), 0);
+    json ranges = json::array();
+
+    for (size_t e = 0; e < events.size();) {
+      double start = events[e].time;
+      for (; e < events.size() && events[e].time == start; e++) {
+        size_t k = events[e].kernel;
+        // a kernel's intervals can overlap when it has several bodies
+        if (events[e].isStart && activeCount[k]++ == 0) {
+          active[qualityRanks[k]].insert(k);
+        }
+        else if (!events[e].isStart && --activeCount[k] == 0) {
+          active[qualityRanks[k]].erase(k);
+        }
+      }
+
+      if (e == events.size()) {
+        break;
+      }
+      double stop = events[e].time;
+
+      // the same fallback as searchAndRefineKernels, the best quality with any coverage wins
+      auto best = find_if(active.begin(), active.end(), [](const set<size_t> &a) { return !a.empty(); });
+      if (best == active.end()) {
+        continue;
+      }
+
+      json rangeKernels = *best;
+      if (!ranges.empty() && ranges.back()["stop"] == start && ranges.back()["kernels"] == rangeKernels) {
+        ranges.back()["stop"] = stop;
+      }
+      else {
+        ranges.push_back({{"start", start}, {"stop", stop}, {"kernels", rangeKernels}});
+      }
+    }
+
+    SPDLOG_DEBUG("Built timeline with {} ranges over {} kernels", ranges.size(), timelineKernels.size());
+    return {{"version", TIMELINE_VERSION}, {"kernels", timelineKernels}, {"ranges", ranges}};
+  }
+
+
+  json searchKernelTimeline(json timeline, vector<double> times) {
+    json &ranges = timeline["ranges"];
+    set<size_t> found;
+
+    for (double time : times) {
+      // last range starting at or before the time
+      size_t low = 0, high = ranges.size();
+      while (low < high) {
+        size_t mid = (low + high) / 2;
+        if (ranges[mid]["start"].get<double>() <= time) {
+          low = mid + 1;
+        }
+        else {
+          high = mid;
+        }
+      }
+
+      if (low > 0 && time <= ranges[low - 1]["stop"].get<double>()) {
+        for (auto &k : ranges[low - 1]["kernels"]) {
+          found.insert(k.get<size_t>());
+        }
+      }
+    }
+
+    // kernels are ordered best quality first, each quality's kernels are split up by version group
+    vector<json> qualityKernels;
+    json lastQuality, lastGroup;
+    for (size_t k : found) {
+      json &kernel = timeline["kernels"][k];
+      json group = kernel["group"];
+      if (qualityKernels.empty() || kernel["quality"] != lastQuality) {
+        qualityKernels.push_back(json::array());
+        lastQuality = kernel["quality"];
+        lastGroup = nullptr;
+      }
+      if (group != lastGroup) {
+        qualityKernels.back().push_back(json::array());
+        lastGroup = group;
+      }
+      qualityKernels.back().back().push_back(kernel["path"]);
+    }
+
+    // the best quality goes last so it takes precedence when loaded
+    json res = {{"kernels", json::array()}};
+    for (auto quality = qualityKernels.rbegin(); quality != qualityKernels.rend(); quality++) {
+      res["kernels"].insert(res["kernels"].end(), quality->begin(), quality->end());
+    }
+
+    if (!found.empty()) {
+      res["quality"] = timeline["kernels"][*found.begin()]["quality"];
+    }
+    return res;
+  }
+
+
+  json getKernelTimeline(string mission, string kernelType, string quality, string coverageHash) {
+    fs::path timelinePath = fs::path(Memo::getCacheDir()) / fmt::format("spiceql_timeline_{}_{}_{}.json", mission, kernelType, quality);
+
+    // parsed timelines are kept for as long as the coverage they were built from is current
+    static map<string, json> timelines;
+    static mutex timelinesLock;
+
+    auto readTimeline = [&]() -> json {
+      if (!fs::exists(timelinePath)) {
+        return {};
+      }
+      try {
+        ifstream ifs(timelinePath);
+        return json::parse(ifs);
+      }
+      catch (json::exception &e) {
+        SPDLOG_WARN("Unable to read kernel timeline {}: {}", timelinePath.string(), e.what());
+        return {};
+      }
+    };
+
+    auto isCurrent = [&](const json &timeline) {
+      return !timeline.empty() && timeline.value("version", 0) == TIMELINE_VERSION && timeline.value("coverageHash", "") == coverageHash;
+    };
+
+    // timelines without kernels mark groups the mission doesn't have, so they aren't rebuilt every time
+    auto found = [](const json &timeline) -> json {
+      return timeline.contains("kernels") && !timeline["kernels"].empty() ? timeline : json();
+    };
+
+    // bring the coverage up to date first, the timeline has to match it
+    if (coverageHash.empty()) {
+      coverageHash = getCoverageHash(Memo::globTimeIntervals(mission));
+    }
+
+    {
+      lock_guard<mutex> lock(timelinesLock);
+      auto cached = timelines.find(timelinePath.string());
+      if (cached != timelines.end() && isCurrent(cached->second)) {
+        return found(cached->second);
+      }
+    }
+
+    json timeline = readTimeline();
+    if (!isCurrent(timeline)) {
+      // timelines are written along with the mission's coverage store
+      SPDLOG_DEBUG("Kernel timeline {} is missing or out of date, rebuilding it", timelinePath.string());
+      globTimeIntervals(mission);
+      timeline = readTimeline();
+    }
+
+    lock_guard<mutex> lock(timelinesLock);
+    timelines[timelinePath.string()] = timeline;
+    return found(timeline);
+  }
+
+
   json searchAndRefineKernels(string mission, vector<double> times, string ckQuality, string spkQuality, vector<string> kernels) {
     auto start = high_resolution_clock::now();
     Config config;
     json missionKernels;
-    Kernel::Quality ckQualityEnum;
-    Kernel::Quality spkQualityEnum;
 
     try {
-      ckQualityEnum = Kernel::translateQuality(ckQuality);
+      Kernel::translateQuality(ckQuality);
     }
     catch (invalid_argument &e) {
       SPDLOG_WARN("{}. Setting ckQuality to RECONSTRUCTED", e.what());
       ckQuality = "reconstructed";
-      ckQualityEnum = Kernel::translateQuality(ckQuality);
     }
 
     try {
-      spkQualityEnum = Kernel::translateQuality(spkQuality);
+      Kernel::translateQuality(spkQuality);
     }
     catch (invalid_argument &e) {
       SPDLOG_WARN("{}. Setting spkQuality to RECONSTRUCTED", e.what());
       spkQuality = "reconstructed";
-      spkQualityEnum = Kernel::translateQuality(spkQuality);
     }
 
-    if (config.contains(mission)) {
-      SPDLOG_TRACE("Found {} in config, getting only {} kernels.", mission, mission);
-      missionKernels = config.get(mission);
+    vector<string> ckQualities = getQualityFallbacks(ckQuality);
+    vector<string> spkQualities = getQualityFallbacks(spkQuality);
+
+    // only the requested kernel types and usable qualities get their regexes expanded
+    map<string, vector<string>> qualities;
+    if (!ckQualities.empty()) {
+      qualities["ck"] = ckQualities;
     }
-    else {
-      throw invalid_argument("Couldn't find " + mission + " in config explicitly, please request a mission from the config [" + getMissionKeys(config.globalConf()) + "]");
+    if (!spkQualities.empty()) {
+      qualities["spk"] = spkQualities;
     }
-    // If nadir is enabled we can probably load a smaller set of kernels?
-    json refinedMissionKernels = {};
-    json refinedBaseKernels = {};
-    json baseKernels = config.get("base");
+
+    vector<string> validKernels;
     bool timeDepKernelsRequested = false;
 
     for (string kernel : kernels) {
@@ -393,56 +880,161 @@ namespace SpiceQL {
         if (kernel == "ck" || kernel == "spk") {
           timeDepKernelsRequested = true;
         }
-        if (missionKernels.contains(kernel)) {
-          refinedMissionKernels[kernel] = missionKernels[kernel];
-        }
-        if (baseKernels.contains(kernel)) {
-          refinedBaseKernels[kernel] = baseKernels[kernel];
-        }
+        validKernels.push_back(kernel);
       }
       catch (invalid_argument &e) {
         SPDLOG_WARN(e.what());
       }
     }
+
+    if (config.contains(mission)) {
+      SPDLOG_TRACE("Found {} in config, getting only {} kernels for {}.", mission, fmt::join(validKernels, ", "), mission);
+      missionKernels = config.get(mission, validKernels, qualities);
+    }
+    else {
+      throw invalid_argument("Couldn't find " + mission + " in config explicitly, please request a mission from the config [" + getMissionKeys(config.globalConf()) + "]");
+    }
+    // If nadir is enabled we can probably load a smaller set of kernels?
+    json refinedMissionKernels = {};
+    json refinedBaseKernels = {};
+    // pinned base kernels are still returned, KernelSet skips furnishing them
+    json baseKernels = config.get("base", validKernels);
+
+    for (string &kernel : validKernels) {
+      if (missionKernels.contains(kernel) && !missionKernels[kernel].is_null()) {
+        refinedMissionKernels[kernel] = missionKernels[kernel];
+      }
+      if (baseKernels.contains(kernel) && !baseKernels[kernel].is_null()) {
+        refinedBaseKernels[kernel] = baseKernels[kernel];
+      }
+    }
+
     // Refines times based kernels (cks, spks, and sclks)
     if (timeDepKernelsRequested) {
-      json cachedTimes = json::parse(Memo::globTimeIntervals(mission));
-      
-      refinedMissionKernels = searchEphemerisKernels(refinedMissionKernels, times, true, cachedTimes);
-
-      if (refinedMissionKernels.contains("ck")) {
-        for (int i = (int) ckQualityEnum; (int) ckQualityEnum != 0; i--) {
-          string ckQual = Kernel::translateQuality(Kernel::Quality(i));
-          if (refinedMissionKernels["ck"].contains(ckQual)) {
-            if (size(refinedMissionKernels["ck"][ckQual]["kernels"]) != 0) {
-              refinedMissionKernels["ck"] = refinedMissionKernels["ck"][ckQual];
-              break;
-            }
+      json cachedTimes = {};
+      vector<KernelSet> sclkKernels;
+
+      // precomputed timelines replace the coverage search, groups without quality keys are skipped by it
+      set<string> timelineTypes;
+      string coverage;
+      if (getEnvBool("SPICEQL_KERNEL_TIMELINE") && !times.empty()) {
+        // read and hashed once for both kernel types
+        coverage = Memo::globTimeIntervals(mission);
+        string coverageHash = getCoverageHash(coverage);
+
+        for (auto &[kernelType, typeQualities] : map<string, vector<string>>{{"ck", ckQualities}, {"spk", spkQualities}}) {
+          if (typeQualities.empty() || !refinedMissionKernels.contains(kernelType)) {
+            continue;
+          }
+
+          json timeline = getKernelTimeline(mission, kernelType, typeQualities.front(), coverageHash);
+          if (timeline.empty()) {
+            continue;
           }
+
+          json found = searchKernelTimeline(timeline, times);
+          string qual = found.value("quality", typeQualities.front());
+          json group = refinedMissionKernels[kernelType].contains(qual) ? refinedMissionKernels[kernelType][qual] : json::object();
+          group.erase("dates");
+          group["kernels"] = found["kernels"];
+          refinedMissionKernels[kernelType] = group;
+          timelineTypes.insert(kernelType);
+          SPDLOG_DEBUG("{} {} kernels from the {} timeline", found["kernels"].size(), kernelType, typeQualities.front());
         }
       }
 
-      if (refinedMissionKernels.contains("spk")) {
-        for (int i = (int) spkQualityEnum; (int) spkQualityEnum != 0; i--) {
-          string spkQual = Kernel::translateQuality(Kernel::Quality(i));
-          if (refinedMissionKernels["spk"].contains(spkQual)) {
-            if (size(refinedMissionKernels["spk"][spkQual]["kernels"]) != 0) {
-              refinedMissionKernels["spk"] = refinedMissionKernels["spk"][spkQual];
-              break;
-            }
+      bool timelineAnswered = all_of(validKernels.begin(), validKernels.end(), [&](const string &kernelType) {
+        return (kernelType != "ck" && kernelType != "spk") || !refinedMissionKernels.contains(kernelType) || timelineTypes.count(kernelType);
+      });
+
+      if (getEnvBool("SPICEQL_LAZY_COVERAGE")) {
+        // coverage is read and cached per kernel, only for the kernels that survive the other filters
+        SPDLOG_DEBUG("Lazy coverage enabled, skipping mission wide coverage for {}", mission);
+        if (refinedMissionKernels.contains("ck") && !timelineTypes.count("ck") && !refinedMissionKernels.contains("sclk")) {
+          json sclks = config.get(mission, {"sclk"});
+          if (sclks.contains("sclk") && !sclks["sclk"].is_null()) {
+            sclkKernels.push_back(KernelSet(getLatestKernels(sclks["sclk"])));
           }
         }
       }
+      else if (!timelineAnswered) {
+        cachedTimes = json::parse(coverage.empty() ? Memo::globTimeIntervals(mission) : coverage);
+      }
+
+      // searches one kernel type group, the sclks are passed along for CK coverage
+      auto searchGroup = [&](string kernelType, json group) -> json {
+        json candidates;
+        candidates[kernelType] = group;
+        if (refinedMissionKernels.contains("sclk")) {
+          candidates["sclk"] = refinedMissionKernels["sclk"];
+        }
+        return searchEphemerisKernels(candidates, times, true, cachedTimes)[kernelType];
+      };
+
+      // search the requested quality first, lower qualities are only searched if it has nothing
+      for (auto &[kernelType, typeQualities] : map<string, vector<string>>{{"ck", ckQualities}, {"spk", spkQualities}}) {
+        if (!refinedMissionKernels.contains(kernelType) || timelineTypes.count(kernelType)) {
+          continue;
+        }
+
+        // any quality is acceptable or the group has no quality keys, e.g. cassini's flat
+        // kernel lists, the whole group is searched and kept
+        bool hasQualities = any_of(typeQualities.begin(), typeQualities.end(), [&](const string &qual) {
+          return refinedMissionKernels[kernelType].contains(qual);
+        });
+        if (!hasQualities) {
+          refinedMissionKernels[kernelType] = searchGroup(kernelType, refinedMissionKernels[kernelType]);
+          continue;
+        }
+
+        json searched = {};
+        for (auto &qual : typeQualities) {
+          if (!refinedMissionKernels[kernelType].contains(qual)) {
+            continue;
+          }
+
+          searched = searchGroup(kernelType, {{qual, refinedMissionKernels[kernelType][qual]}})[qual];
+          if (!searched["kernels"].empty()) {
+            SPDLOG_DEBUG("Found {} {} kernels", qual, kernelType);
+            break;
+          }
+          SPDLOG_DEBUG("No {} {} kernels found, falling back", qual, kernelType);
+        }
+        refinedMissionKernels[kernelType] = searched;
+      }
     }
     // Gets the latest kernel of every type
     refinedMissionKernels = getLatestKernels(refinedMissionKernels);
 
+    if (timeDepKernelsRequested && getEnvBool("SPICEQL_MINIMAL_KERNELS")) {
+      json stored = getStoredBodyCoverage(mission, getKernelsAsVector(refinedMissionKernels));
+      refinedMissionKernels = getMinimalCoveringKernels(refinedMissionKernels, times, stored);
+    }
+
     refinedBaseKernels = getLatestKernels(refinedBaseKernels);
     // SPDLOG_TRACE("Base Kernels found: {}", baseKernels.dump());
     SPDLOG_TRACE("Kernels found: {}", refinedMissionKernels.dump());
     json finalKernels = {};
     finalKernels["base"] = refinedBaseKernels;
     finalKernels[mission] = refinedMissionKernels;
+
+    // the reads overlap with whatever the caller does before furnishing the kernels,
+    // kernels that are already furnished won't be read again
+    unsigned int prefetchThreads = getPrefetchThreads();
+    if (prefetchThreads > 0) {
+      set<string> furnished;
+      for (auto &[path, kind] : KernelPool::getInstance().getLoadOrder()) {
+        furnished.insert(path);
+      }
+      vector<string> unread;
+      for (auto &kernel : getKernelsAsVector(finalKernels)) {
+        if (!furnished.count(kernel)) {
+          unread.push_back(kernel);
+        }
+      }
+      prefetchKernels(unread, prefetchThreads, true);
+    }
+
     auto stop = high_resolution_clock::now();
     auto duration = duration_cast<microseconds>(stop - start);
 
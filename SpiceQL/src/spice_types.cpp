@@ -4,6 +4,13 @@
   *
  **/
 
+#include <atomic>
+#include <unordered_set>
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+
 #include <fmt/format.h>
 #include <SpiceUsr.h>
 
@@ -13,10 +20,12 @@
 
 #include <spdlog/spdlog.h>
 
+#include "executor.h"
 #include "spice_types.h"
 #include "query.h"
 #include "utils.h"
 #include "config.h"
+#include "memo.h"
 
 using namespace std;
 using json = nlohmann::json;
@@ -85,87 +94,96 @@ namespace SpiceQL {
 
 
   int translateNameToCode(string frame, string mission, bool searchKernels) {    
-    SpiceInt code;
-    SpiceBoolean found;
     json kernelsToLoad = {};
 
     if (mission != "" && searchKernels) {
       kernelsToLoad = loadTranslationKernels(mission);
     } 
-    KernelSet kset(kernelsToLoad);
 
-    checkNaifErrors();
-    bodn2c_c(frame.c_str(), &code, &found);
-    checkNaifErrors();
+    return runOnSpiceExecutor([&]() -> int {
+      SpiceInt code;
+      SpiceBoolean found;
+      KernelSet kset(kernelsToLoad);
 
-    if (!found) {
-      namfrm_c(frame.c_str(), &code);
       checkNaifErrors();
-    }
+      bodn2c_c(frame.c_str(), &code, &found);
+      checkNaifErrors();
 
-    if (code == 0) {
-      throw invalid_argument(fmt::format("Frame code for frame name [{}] not found.", frame));
-    }
+      if (!found) {
+        namfrm_c(frame.c_str(), &code);
+        checkNaifErrors();
+      }
 
-    return code;
+      if (code == 0) {
+        throw invalid_argument(fmt::format("Frame code for frame name [{}] not found.", frame));
+      }
+
+      return code;
+    });
   }
 
 
   string translateCodeToName(int frame, string mission, bool searchKernels) {
-    SpiceChar name[128];
-    SpiceBoolean found;
     json kernelsToLoad = {};
 
     if (mission != "" && searchKernels){
       kernelsToLoad = loadTranslationKernels(mission);
     }
-    KernelSet kset(kernelsToLoad);
 
-    checkNaifErrors();
-    bodc2n_c(frame, 128, name, &found);
-    checkNaifErrors();
+    return runOnSpiceExecutor([&]() -> string {
+      SpiceChar name[128];
+      SpiceBoolean found;
+      KernelSet kset(kernelsToLoad);
 
-    if(!found) {  
-      frmnam_c(frame, 128, name);
       checkNaifErrors();
-    }
+      bodc2n_c(frame, 128, name, &found);
+      checkNaifErrors();
 
-    if(strlen(name) == 0) {
-       throw invalid_argument(fmt::format("Frame name for code {} not found.", frame));
-    }
+      if(!found) {  
+        frmnam_c(frame, 128, name);
+        checkNaifErrors();
+      }
+
+      if(strlen(name) == 0) {
+         throw invalid_argument(fmt::format("Frame name for code {} not found.", frame));
+      }
     
-    return string(name);
+      return string(name);
+    });
   }
 
   vector<int> getFrameInfo(int frame, string mission, bool searchKernels) {
-    SpiceInt cent;
-    SpiceInt frclss;
-    SpiceInt clssid;
-    SpiceBoolean found;
-
     json kernelsToLoad = {};
 
     if (mission != "" && searchKernels) {
       // Load only the FKs
       kernelsToLoad = loadTranslationKernels(mission, true, false, false);
     }
-    KernelSet kset(kernelsToLoad);
 
-    checkNaifErrors();
-    frinfo_c(frame, &cent, &frclss, &clssid, &found);
-    checkNaifErrors();
-    SPDLOG_TRACE("RETURN FROM FRINFO: {}, {}, {}, {}", cent, frclss, clssid, found);
+    return runOnSpiceExecutor([&]() -> vector<int> {
+      SpiceInt cent;
+      SpiceInt frclss;
+      SpiceInt clssid;
+      SpiceBoolean found;
 
-    if (!found) {
-       throw invalid_argument(fmt::format("Frame info for code {} not found.", frame));
-    }
+      KernelSet kset(kernelsToLoad);
+
+      checkNaifErrors();
+      frinfo_c(frame, &cent, &frclss, &clssid, &found);
+      checkNaifErrors();
+      SPDLOG_TRACE("RETURN FROM FRINFO: {}, {}, {}, {}", cent, frclss, clssid, found);
 
-    return {cent, frclss, clssid};
+      if (!found) {
+         throw invalid_argument(fmt::format("Frame info for code {} not found.", frame));
+      }
+
+      return {cent, frclss, clssid};
+    });
   }
 
-  Kernel::Kernel(string path) {
+  Kernel::Kernel(string path, bool force_refurnsh) {
     this->path = path;
-    KernelPool::getInstance().load(path, true);
+    KernelPool::getInstance().load(path, force_refurnsh);
   }
 
 
@@ -181,81 +199,91 @@ namespace SpiceQL {
 
 
   double utcToEt(string utc, bool searchKernels) {
+    json lsks = {};
+
+    // get lsk kernel, unless the base lsk is pinned
+    if (searchKernels && !KernelPool::getInstance().isBasePinned("lsk")) {
       Config conf;
       conf = conf["base"];
-      json lsks = {};
-
-      // get lsk kernel
-      if (searchKernels) {
-       lsks = conf.getLatest("lsk");
-      }
+      lsks = conf.getLatest("lsk");
+    }
 
-      KernelSet lsk(lsks);
+    return runOnSpiceExecutor([&]() -> double {
+        KernelSet lsk(lsks);
 
-      SpiceDouble et;
-      checkNaifErrors();
-      str2et_c(utc.c_str(), &et);
-      checkNaifErrors();
+        SpiceDouble et;
+        checkNaifErrors();
+        str2et_c(utc.c_str(), &et);
+        checkNaifErrors();
 
-      return et;
+        return et;
+    });
   }
 
   string etToUtc(double et, string format, double precision, bool searchKernels) {
+    json lsks = {};
+
+    // get lsk kernel, unless the base lsk is pinned
+    if (searchKernels && !KernelPool::getInstance().isBasePinned("lsk")) {
       Config conf;
       conf = conf["base"];
-      json lsks = {};
-
-      // get lsk kernel
-      if (searchKernels) {
-       lsks = conf.getLatest("lsk");
-      }
+      lsks = conf.getLatest("lsk");
+    }
 
-      KernelSet lsk(lsks);
+    return runOnSpiceExecutor([&]() -> string {
+        KernelSet lsk(lsks);
 
-      SpiceChar utc_spice[100]; 
-      checkNaifErrors();
-      et2utc_c(et, format.c_str(), precision, 100, utc_spice);
-      checkNaifErrors();
-      string utc_string(utc_spice);
-      return utc_string;
+        SpiceChar utc_spice[100]; 
+        checkNaifErrors();
+        et2utc_c(et, format.c_str(), precision, 100, utc_spice);
+        checkNaifErrors();
+        string utc_string(utc_spice);
+        return utc_string;
+    });
   }
 
   double strSclkToEt(int frameCode, string sclk, string mission, bool searchKernels) {
-      Config missionConf;
-      json sclks;
+    json sclks;
 
-      if (searchKernels) {
-        sclks = loadSelectKernels("sclk", mission);
-      }
+    if (searchKernels) {
+      sclks = loadSelectKernels("sclk", mission);
+    }
 
-      KernelSet sclkSet(sclks);
+    return runOnSpiceExecutor([&]() -> double {
+        Config missionConf;
 
-      SpiceDouble et;
-      checkNaifErrors();
-      scs2e_c(frameCode, sclk.c_str(), &et);
-      checkNaifErrors();
-      SPDLOG_DEBUG("strsclktoet({}, {}, {}) -> {}", frameCode, mission, sclk, et);
+        KernelSet sclkSet(sclks);
+
+        SpiceDouble et;
+        checkNaifErrors();
+        scs2e_c(frameCode, sclk.c_str(), &et);
+        checkNaifErrors();
+        SPDLOG_DEBUG("strsclktoet({}, {}, {}) -> {}", frameCode, mission, sclk, et);
       
-      return et;
+        return et;
+    });
   }
 
   double doubleSclkToEt(int frameCode, double sclk, string mission, bool searchKernels) {
-      Config missionConf;
-      json sclks;
+    json sclks;
 
-      if (searchKernels) {
-        sclks = loadSelectKernels("sclk", mission);
-      }
+    if (searchKernels) {
+      sclks = loadSelectKernels("sclk", mission);
+    }
 
-      KernelSet sclkSet(sclks);
+    return runOnSpiceExecutor([&]() -> double {
+        Config missionConf;
 
-      SpiceDouble et;
-      checkNaifErrors();
-      sct2e_c(frameCode, sclk, &et);
-      checkNaifErrors();
-      SPDLOG_DEBUG("strsclktoet({}, {}, {}) -> {}", frameCode, mission, sclk, et);
+        KernelSet sclkSet(sclks);
 
-      return et;
+        SpiceDouble et;
+        checkNaifErrors();
+        sct2e_c(frameCode, sclk, &et);
+        checkNaifErrors();
+        SPDLOG_DEBUG("strsclktoet({}, {}, {}) -> {}", frameCode, mission, sclk, et);
+
+        return et;
+    });
   }
 
   json findMissionKeywords(string key, string mission, bool searchKernels) {
@@ -265,9 +293,11 @@ namespace SpiceQL {
       translationKernels = loadTranslationKernels(mission);
     }
 
-    KernelSet kset(translationKernels);
+    return runOnSpiceExecutor([&]() -> json {
+      KernelSet kset(translationKernels);
 
-    return findKeywords(key);
+      return findKeywords(key);
+    });
   }
 
 
@@ -275,119 +305,567 @@ namespace SpiceQL {
     json kernelsToLoad = {};
 
     if (mission != "" && searchKernels) {
-      kernelsToLoad["base"] = loadSelectKernels("pck", "base");
+      if (!KernelPool::getInstance().isBasePinned("pck")) {
+        kernelsToLoad["base"] = loadSelectKernels("pck", "base");
+      }
       kernelsToLoad[mission] = loadSelectKernels("pck", mission);
     }
-    KernelSet kset(kernelsToLoad);
-    return findKeywords(key);
+
+    return runOnSpiceExecutor([&]() -> json {
+      KernelSet kset(kernelsToLoad);
+      return findKeywords(key);
+    });
   }
 
 
   json getTargetFrameInfo(int targetId, string mission, bool searchKernels) {
-    SpiceInt frameCode;
-    SpiceChar frameName[128];
-    SpiceBoolean found;
-
-    json frameInfo;
     json kernelsToLoad = {};
 
     if (mission != "" && searchKernels) {
-      kernelsToLoad["base"] = loadSelectKernels("pck", "base");
+      if (!KernelPool::getInstance().isBasePinned("pck")) {
+        kernelsToLoad["base"] = loadSelectKernels("pck", "base");
+      }
       kernelsToLoad[mission] = loadSelectKernels("pck", mission);
     }
-    KernelSet kset(kernelsToLoad);
 
-    checkNaifErrors();
-    cidfrm_c(targetId, 128, &frameCode, frameName, &found);
-    checkNaifErrors();
+    return runOnSpiceExecutor([&]() -> json {
+      SpiceInt frameCode;
+      SpiceChar frameName[128];
+      SpiceBoolean found;
 
-    if(!found) {  
-      throw invalid_argument(fmt::format("Frame info for target id {} not found.", targetId));
-    }
+      json frameInfo;
+      KernelSet kset(kernelsToLoad);
+
+      checkNaifErrors();
+      cidfrm_c(targetId, 128, &frameCode, frameName, &found);
+      checkNaifErrors();
+
+      if(!found) {  
+        throw invalid_argument(fmt::format("Frame info for target id {} not found.", targetId));
+      }
 
-    frameInfo["frameCode"] = frameCode;
-    frameInfo["frameName"] = frameName;
+      frameInfo["frameCode"] = frameCode;
+      frameInfo["frameName"] = frameName;
 
-    return frameInfo;
+      return frameInfo;
+    });
   }
 
 
   int KernelPool::load(string path, bool force_refurnsh) {
-    SPDLOG_DEBUG("Furnishing {}, force refurnish? {}.", path, force_refurnsh);
-
-    int refCount; 
+    return runOnSpiceExecutor([&]() -> int {
+      SPDLOG_DEBUG("Furnishing {}, force refurnish? {}.", path, force_refurnsh);
+
+      int refCount; 
+
+      // retained kernels are still furnished, they just need a reference again
+      auto retainedIt = retainedIndex.find(path);
+      if (retainedIt != retainedIndex.end()) {
+        SPDLOG_TRACE("{} is retained, reusing it.", path);
+        retainedBytes -= retainedIt->second->second;
+        retained.erase(retainedIt->second);
+        retainedIndex.erase(retainedIt);
+        refCounts.emplace(path, 1);
+
+        if (force_refurnsh) {
+          promote(path);
+        }
+        return 1;
+      }
 
-    auto it = refCounts.find(path);
+      auto it = refCounts.find(path);
 
-    if (it != refCounts.end()) {
-      SPDLOG_TRACE("{} already furnished.", path);
+      if (it != refCounts.end()) {
+        SPDLOG_TRACE("{} already furnished.", path);
 
-      // it's been furnished before, increment ref count
-      it->second += 1;
-      refCount = it->second; 
+        // it's been furnished before, increment ref count
+        it->second += 1;
+        refCount = it->second; 
  
-      if (force_refurnsh) {
-        checkNaifErrors();
-        furnsh_c(path.c_str());
-        checkNaifErrors();
+        if (force_refurnsh) {
+          promote(path);
+        }
+      }
+      else { 
+        refCount = 1;  
+        // load the kernel and register in onto the kernel map 
+        furnish(path);
+        refCounts.emplace(path, 1);
+        evictRetainedKernels();
+      }
+
+
+      SPDLOG_TRACE("refcout of {}: {}", path, refCount);
+      return refCount;
+    });
+  }
+
+
+  bool KernelPool::promote(string path) {
+    return runOnSpiceExecutor([&]() -> bool {
+      auto copies = furnishedCopies.find(path);
+      if (copies == furnishedCopies.end()) {
+        if (!refCounts.count(path)) {
+          throw out_of_range(path + " is not a kernel that has been loaded.");
+        }
+        // only loaded through a meta-kernel, a copy of its own takes precedence
+        furnish(path);
+        return true;
+      }
+
+      // the last copy is the one CSPICE uses, only kernels of the same kind loaded after it take precedence.
+      // Meta-kernels can load any kind of kernel, so they shadow and are shadowed by everything.
+      auto last = copies->second.back();
+      string kind = last->second;
+      bool shadowed = any_of(next(last), loadOrder.end(), [&](const pair<string, string> &later) {
+        return later.second == kind || kind == "META" || later.second == "META";
+      });
+
+      if (!shadowed) {
+        SPDLOG_TRACE("{} already takes precedence, not refurnishing it.", path);
+        return false;
+      }
+
+      furnish(path);
+      return true;
+    });
+  }
+
+
+  /**
+   * @brief Get the type of a kernel CSPICE has just furnished
+   *
+   * Like getKernelType, but old files without an ID word are looked up with kinfo_c
+   * directly since the kernel is already loaded and furnishing it again would recurse.
+   */
+  static string getFurnishedKernelType(const string &path) {
+    string type = getKernelTypeFromHeader(path);
+    if (!type.empty()) {
+      return type;
+    }
+
+    SpiceChar fileType[6];
+    SpiceChar source[6];
+    SpiceInt handle;
+    SpiceBoolean found;
+
+    checkNaifErrors();
+    kinfo_c(path.c_str(), 6, 6, fileType, source, &handle, &found);
+    checkNaifErrors();
+    return found ? string(fileType) : "";
+  }
+
+
+  /**
+   * @brief Get the kernels CSPICE loaded through a furnished meta-kernel
+   */
+  static vector<string> getMetaKernelContents(const string &metaKernel) {
+    vector<string> contents;
+    SpiceInt count;
+    checkNaifErrors();
+    ktotal_c("ALL", &count);
+    checkNaifErrors();
+
+    for (SpiceInt i = 0; i < count; i++) {
+      SpiceChar file[2048], fileType[32], source[2048];
+      SpiceInt handle;
+      SpiceBoolean found;
+      kdata_c(i, "ALL", sizeof(file), sizeof(fileType), sizeof(source), file, fileType, source, &handle, &found);
+      checkNaifErrors();
+      if (found && metaKernel == source) {
+        contents.push_back(file);
       }
     }
-    else { 
-      refCount = 1;  
-      // load the kernel and register in onto the kernel map 
+    return contents;
+  }
+
+
+  void KernelPool::furnish(string path) {
+    // CSPICE's tables can fill up with retained kernels, make room and try again
+    try {
+      checkNaifErrors();
+      furnsh_c(path.c_str());
+      checkNaifErrors();
+    }
+    catch (runtime_error &e) {
+      string msg = e.what();
+      bool tableFull = msg.find("FULL") != string::npos || msg.find("TOOMANY") != string::npos;
+      if (retained.empty() || !tableFull) {
+        throw;
+      }
+      SPDLOG_WARN("Unable to furnish {} with {} retained kernels, releasing them: {}", path, retained.size(), e.what());
+      releaseRetainedKernels();
       checkNaifErrors();
       furnsh_c(path.c_str());
       checkNaifErrors();
-      refCounts.emplace(path, 1);
     }
 
+    vector<list<pair<string, string>>::iterator> &copies = furnishedCopies[path];
+    string kind = !copies.empty() ? copies.back()->second : getFurnishedKernelType(path);
 
-    SPDLOG_TRACE("refcout of {}: {}", path, refCount);
-    return refCount;
+    loadOrder.emplace_back(path, kind);
+    copies.push_back(prev(loadOrder.end()));
+
+    if (kind != "META") {
+      return;
+    }
+
+    vector<string> &contents = metaKernelContents[path];
+    if (contents.empty()) {
+      contents = getMetaKernelContents(path);
+    }
+    for (auto &kernel : contents) {
+      // a retained kernel is referenced again, by the meta-kernel
+      auto retainedIt = retainedIndex.find(kernel);
+      if (retainedIt != retainedIndex.end()) {
+        retainedBytes -= retainedIt->second->second;
+        retained.erase(retainedIt->second);
+        retainedIndex.erase(retainedIt);
+      }
+      refCounts[kernel]++;
+    }
+
+    // meta-kernels are read again when they are promoted or reopened, the lock keeps other processes from pruning them
+    if (!metaKernelLocks.count(path)) {
+      int fd = open(path.c_str(), O_RDONLY);
+      if (fd >= 0 && flock(fd, LOCK_SH) != 0) {
+        close(fd);
+        fd = -1;
+      }
+      metaKernelLocks[path] = fd;
+    }
+  }
+
+
+  void KernelPool::unfurnish(string path) {
+    checkNaifErrors();
+    unload_c(path.c_str());
+    checkNaifErrors();
+
+    // unload_c removes the most recently furnished copy
+    auto copies = furnishedCopies.find(path);
+    if (copies == furnishedCopies.end()) {
+      return;
+    }
+    loadOrder.erase(copies->second.back());
+    copies->second.pop_back();
+    if (copies->second.empty()) {
+      furnishedCopies.erase(copies);
+    }
+
+    auto contents = metaKernelContents.find(path);
+    if (contents == metaKernelContents.end()) {
+      return;
+    }
+
+    vector<string> kernels = contents->second;
+    if (getFurnishCount(path) == 0) {
+      metaKernelContents.erase(contents);
+      auto lock = metaKernelLocks.find(path);
+      if (lock != metaKernelLocks.end()) {
+        if (lock->second >= 0) {
+          close(lock->second);
+        }
+        metaKernelLocks.erase(lock);
+      }
+    }
+
+    for (auto &kernel : kernels) {
+      auto ref = refCounts.find(kernel);
+      if (ref == refCounts.end()) {
+        continue;
+      }
+
+      if (--ref->second <= 0) {
+        refCounts.erase(ref);
+        while (getFurnishCount(kernel) > 0) {
+          unfurnish(kernel);
+        }
+      }
+      else if (getFurnishCount(kernel) == 0) {
+        // unload_c took the kernel with the meta-kernel, it is still referenced elsewhere
+        furnish(kernel);
+      }
+    }
+  }
+
+
+  size_t KernelPool::getFurnishCount(string path) {
+    auto copies = furnishedCopies.find(path);
+    return copies != furnishedCopies.end() ? copies->second.size() : 0;
   }
 
 
   int KernelPool::unload(string path) {
-    try { 
-      int &refcount = refCounts.at(path);
-      
+    return runOnSpiceExecutor([&]() -> int {
+      auto it = refCounts.find(path);
+      if (it == refCounts.end()) {
+        throw out_of_range(path + " is not a kernel that has been loaded."); 
+      }
+
+      int &refcount = it->second;
+
+      // references that were loaded without a furnish share a copy, only unload the extra copies
+      if (refcount > 1) {
+        refcount--;
+        if (getFurnishCount(path) > (size_t)refcount) {
+          unfurnish(path);
+        }
+        return refcount;
+      }
+
+      refCounts.erase(it);
+
       // if the map contains the last copy of the kernel, delete it
-      if (refcount == 1) {
-        // unfurnsh the kernel
+      // kernels only loaded through a meta-kernel have no copy of their own to retain
+      if (retainCount > 0 && getFurnishCount(path) > 0) {
+        // keep one copy furnished in case it is needed again
+        while (getFurnishCount(path) > 1) {
+          unfurnish(path);
+        }
+
+        uintmax_t size = fs::exists(path) ? fs::file_size(path) : 0;
+        retained.emplace_front(path, size);
+        retainedIndex[path] = retained.begin();
+        retainedBytes += size;
+        SPDLOG_TRACE("Retaining {}", path);
+
+        evictRetainedKernels();
+        return 0;
+      }
+
+      // unfurnsh the kernel
+      while (getFurnishCount(path) > 0) {
+        unfurnish(path);
+      }
+      return 0;
+    });
+  }
+
+
+  vector<pair<string, string>> KernelPool::getLoadOrder() {
+    return runOnSpiceExecutor([&]() -> vector<pair<string, string>> {
+      return vector<pair<string, string>>(loadOrder.begin(), loadOrder.end());
+    });
+  }
+
+
+  void KernelPool::setDeltaLoading(bool enabled) {
+    runOnSpiceExecutor([&]() {
+      deltaLoading = enabled;
+    });
+  }
+
+
+  bool KernelPool::getDeltaLoading() {
+    return runOnSpiceExecutor([&]() -> bool {
+      return deltaLoading;
+    });
+  }
+
+
+  void KernelPool::setRetention(size_t maxKernels, uintmax_t maxBytes) {
+    runOnSpiceExecutor([&]() {
+      SPDLOG_DEBUG("Retaining up to {} kernels and {} bytes", maxKernels, maxBytes);
+      retainCount = maxKernels;
+      retainBytes = maxBytes;
+      evictRetainedKernels();
+    });
+  }
+
+
+  vector<string> KernelPool::getRetainedKernels() {
+    return runOnSpiceExecutor([&]() -> vector<string> {
+      vector<string> res;
+      for (auto &[path, size] : retained) {
+        res.push_back(path);
+      }
+      return res;
+    });
+  }
+
+
+  void KernelPool::releaseRetainedKernels() {
+    runOnSpiceExecutor([&]() {
+      while (!retained.empty()) {
+        string path = retained.back().first;
+        retained.pop_back();
+        retainedIndex.erase(path);
+        unfurnish(path);
+      }
+      retainedBytes = 0;
+    });
+  }
+
+
+  void KernelPool::pin(string path) {
+    runOnSpiceExecutor([&]() {
+      if (find(pinned.begin(), pinned.end(), path) != pinned.end()) {
+        return;
+      }
+      SPDLOG_DEBUG("Pinning {}", path);
+      load(path, false);
+      pinned.push_back(path);
+    });
+  }
+
+
+  void KernelPool::unpin(string path) {
+    runOnSpiceExecutor([&]() {
+      auto it = find(pinned.begin(), pinned.end(), path);
+      if (it == pinned.end()) {
+        throw out_of_range(path + " is not a pinned kernel.");
+      }
+      pinned.erase(it);
+
+      // the base kernel type it belongs to is no longer fully pinned
+      for (auto base = pinnedBase.begin(); base != pinnedBase.end();) {
+        if (find(base->second.begin(), base->second.end(), path) != base->second.end()) {
+          base = pinnedBase.erase(base);
+        }
+        else {
+          base++;
+        }
+      }
+
+      SPDLOG_DEBUG("Unpinning {}", path);
+      unload(path);
+    });
+  }
+
+
+  void KernelPool::unpinAll() {
+    runOnSpiceExecutor([&]() {
+      pinBaseOnUse = false;
+      while (!pinned.empty()) {
+        unpin(pinned.back());
+      }
+    });
+  }
+
+
+  vector<string> KernelPool::getPinnedKernels() {
+    return runOnSpiceExecutor([&]() -> vector<string> {
+      return pinned;
+    });
+  }
+
+
+  bool KernelPool::isPinned(string path) {
+    return runOnSpiceExecutor([&]() -> bool {
+      return find(pinned.begin(), pinned.end(), path) != pinned.end();
+    });
+  }
+
+
+  void KernelPool::pinBaseKernels(vector<string> kernelTypes) {
+    Config conf;
+    conf = conf["base"];
+
+    // the config is searched before the pool is touched on the SPICE executor
+    vector<pair<string, vector<string>>> baseKernels;
+    for (auto &kernelType : kernelTypes) {
+      if (conf.contains(kernelType)) {
+        baseKernels.emplace_back(kernelType, getKernelsAsVector(conf.getLatest(kernelType)));
+      }
+    }
+
+    runOnSpiceExecutor([&]() {
+      for (auto &[kernelType, kernels] : baseKernels) {
+        if (pinnedBase.count(kernelType)) {
+          continue;
+        }
+
+        for (auto &kernel : kernels) {
+          pin(kernel);
+        }
+        pinnedBase[kernelType] = kernels;
+        SPDLOG_DEBUG("Pinned {} base {} kernels", kernels.size(), kernelType);
+      }
+    });
+  }
+
+
+  bool KernelPool::isBasePinned(string kernelType) {
+    return runOnSpiceExecutor([&]() -> bool {
+      // pin on first use so the config isn't read while the pool is being constructed
+      if (pinBaseOnUse) {
+        pinBaseOnUse = false;
+        try {
+          pinBaseKernels();
+        }
+        catch (exception &e) {
+          SPDLOG_WARN("Unable to pin the base kernels: {}", e.what());
+        }
+      }
+      return pinnedBase.count(kernelType) > 0;
+    });
+  }
+
+
+  void KernelPool::reopenKernels() {
+    runOnSpiceExecutor([&]() {
+      SPDLOG_DEBUG("Reopening {} furnished kernels", loadOrder.size());
+
+      // unload_c removes the newest copy of a kernel, so copies are unloaded newest first
+      for (auto it = loadOrder.rbegin(); it != loadOrder.rend(); it++) {
         checkNaifErrors();
-        unload_c(path.c_str());
+        unload_c(it->first.c_str());
         checkNaifErrors();
-        
-        refCounts.erase(path);
-        return 0;
       }
-      else {
+
+      for (auto &[path, kind] : loadOrder) {
         checkNaifErrors();
-        unload_c(path.c_str());
+        furnsh_c(path.c_str());
         checkNaifErrors();
-        
-        refcount--;
-        
-        return refcount;
       }
+    });
+  }
+
+
+  void KernelPool::evictRetainedKernels() {
+    if (retained.empty()) {
+      return;
     }
-    catch(out_of_range &e) {
-      throw out_of_range(path + " is not a kernel that has been loaded."); 
+
+    // stay well under CSPICE's 5000 entry kernel and file tables
+    const SpiceInt maxFurnished = 4000;
+
+    SpiceInt furnished = 0;
+    checkNaifErrors();
+    ktotal_c("ALL", &furnished);
+    checkNaifErrors();
+
+    while (!retained.empty() && (retained.size() > retainCount
+                                 || (retainBytes > 0 && retainedBytes > retainBytes)
+                                 || furnished > maxFurnished)) {
+      auto [path, size] = retained.back();
+      retained.pop_back();
+      retainedIndex.erase(path);
+      retainedBytes -= size;
+      furnished--;
+
+      SPDLOG_TRACE("Evicting retained kernel {}", path);
+      unfurnish(path);
     }
   }
 
 
   unsigned int KernelPool::getRefCount(std::string key) {
-    try {
-      return refCounts.at(key);
-    } catch(out_of_range &e) {
-      return 0;
-    }
+    return runOnSpiceExecutor([&]() -> unsigned int {
+      try {
+        return refCounts.at(key);
+      } catch(out_of_range &e) {
+        return 0;
+      }
+    });
   }
 
 
   unordered_map<string, int> KernelPool::getRefCounts() {
-    return refCounts;
+    return runOnSpiceExecutor([&]() -> unordered_map<string, int> {
+      return refCounts;
+    });
   }
 
 
@@ -398,23 +876,32 @@ namespace SpiceQL {
 
 
   KernelPool::KernelPool() : refCounts() { 
-    loadLeapSecondKernel();
+    deltaLoading = getEnvBool("SPICEQL_DELTA_KERNELS");
+    pinBaseOnUse = getEnvBool("SPICEQL_PIN_BASE_KERNELS");
 
-    checkNaifErrors();
-    // create aliases for spacecrafts 
-    boddef_c("mess", -236); // NAIF uses MESSENGER, we use mess for short
-    checkNaifErrors();
-  
+    retainCount = getEnvUnsigned("SPICEQL_KERNEL_RETENTION", 0);
+    retainBytes = getEnvUnsigned("SPICEQL_KERNEL_RETENTION_BYTES", 0);
+
+    runOnSpiceExecutor([&]() {
+      loadLeapSecondKernel();
+
+      checkNaifErrors();
+      // create aliases for spacecrafts 
+      boddef_c("mess", -236); // NAIF uses MESSENGER, we use mess for short
+      checkNaifErrors();
+    });
   }
 
 
   vector<string> KernelPool::getLoadedKernels() {
-    vector<string> res;
+    return runOnSpiceExecutor([&]() -> vector<string> {
+      vector<string> res;
 
-    for( const auto& [key, value] : refCounts ) {
-      res.emplace_back(key);
-    }
-    return res;
+      for( const auto& [key, value] : refCounts ) {
+        res.emplace_back(key);
+      }
+      return res;
+    });
   }
 
   void KernelPool::loadClockKernels() { 
@@ -427,20 +914,21 @@ namespace SpiceQL {
     // get SCLKs
     for(auto &j : confs) {
       vector<json::json_pointer> p = findKeyInJson(j, "sclk", true);
-      
+    
       if (!p.empty()) {
         json sclks = j[p.at(0)];
         clocks[p.at(0)] = sclks;
       }
     }
-  
+
     clocks = listMissionKernels(dataDir, clocks);
     clocks = getLatestKernels(clocks);
 
+    // only the loads touch the pool, each goes through the SPICE executor
     vector<json::json_pointer> kpointers = findKeyInJson(clocks, "kernels", true);
     for (auto &p : kpointers) {
         json sclks = clocks[p];
-        
+      
         for (auto &e : sclks) { 
           load(e.get<string>());
         }
@@ -459,16 +947,128 @@ namespace SpiceQL {
   KernelSet::KernelSet(json kernels) {
     SPDLOG_TRACE("Creating Kernelset: {}", kernels.dump());
     this->kernels = kernels;
+    loadedKernels = furnishKernels(getKernelsAsVector(kernels));
+  }
+
+
+  void KernelSet::activate(json kernels) {
+    SPDLOG_TRACE("Activating Kernelset: {}", kernels.dump());
+    // the new kernels are referenced before the old ones are released,
+    // so kernels in both sets are never unloaded
+    vector<SharedKernel> next = furnishKernels(getKernelsAsVector(kernels));
+    loadedKernels = next;
+    this->kernels = kernels;
+  }
+
+
+  vector<SharedKernel> KernelSet::furnishKernels(vector<string> kv) {
+    KernelPool &pool = KernelPool::getInstance();
 
-    vector<string> kv = getKernelsAsVector(kernels);
-  
-    vector<SharedKernel> res;
-    for (auto &k : kv) {
-      SPDLOG_TRACE("Creating shared kernel {}", k);
-      SharedKernel sk(new Kernel(k));
-      res.emplace_back(sk);
+    // start reading every kernel that isn't furnished or pinned yet at once, so furnishing them one at
+    // a time hits the page cache. It's done before taking the SPICE executor so other work isn't held up
+    // by it, the pool can change in the meantime but prefetching is only advice
+    unsigned int prefetchThreads = getPrefetchThreads();
+    if (prefetchThreads > 0) {
+      unordered_set<string> furnished;
+      for (auto &[path, kind] : pool.getLoadOrder()) {
+        furnished.insert(path);
+      }
+      for (auto &path : pool.getPinnedKernels()) {
+        furnished.insert(path);
+      }
+      vector<string> unread;
+      copy_if(kv.begin(), kv.end(), back_inserter(unread), [&](const string &k) { return !furnished.count(k); });
+      prefetchKernels(unread, prefetchThreads);
     }
-    loadedKernels.insert(loadedKernels.end(), res.begin(), res.end());
+
+    return runOnSpiceExecutor([&]() -> vector<SharedKernel> {
+      vector<SharedKernel> res;
+
+      // pinned kernels stay furnished with the pool's reference, e.g. pinned base kernels in a query's results
+      kv.erase(remove_if(kv.begin(), kv.end(), [&](const string &k) { return pool.isPinned(k); }), kv.end());
+
+      vector<pair<string, string>> order = pool.getLoadOrder();
+
+      // large sets are furnished with a single call through a meta-kernel
+      size_t metaThreshold = getMetaKernelThreshold();
+      if (metaThreshold > 0 && kv.size() >= metaThreshold) {
+        string metaKernel = writeMetaKernel(kv, Memo::getCacheDir());
+        SPDLOG_DEBUG("Furnishing {} kernels through {}", kv.size(), metaKernel);
+        res.emplace_back(new Kernel(metaKernel));
+
+        // pruning scans the whole cache directory, so it only happens every so many writes
+        static atomic<size_t> metaKernelWrites{0};
+        const size_t pruneInterval = 32;
+        if (metaKernelWrites++ % pruneInterval == 0) {
+          // furnished meta-kernels are read again when they are promoted or reopened, so they are kept
+          vector<string> furnishedMeta;
+          for (auto &[path, kind] : order) {
+            if (kind == "META") {
+              furnishedMeta.push_back(path);
+            }
+          }
+          pruneMetaKernels(Memo::getCacheDir(), getMetaKernelLimit(), furnishedMeta);
+        }
+        return res;
+      }
+
+      if (!pool.getDeltaLoading()) {
+        for (auto &k : kv) {
+          SPDLOG_TRACE("Creating shared kernel {}", k);
+          res.emplace_back(new Kernel(k));
+        }
+        return res;
+      }
+
+      // furnished files of each kind in load order, only the last copy of a file matters
+      // and only kernels of the same kind can shadow each other
+      unordered_map<string, vector<string>> furnishedByKind;
+      unordered_map<string, string> furnishedKinds;
+      for (auto it = order.rbegin(); it != order.rend(); it++) {
+        if (furnishedKinds.emplace(it->first, it->second).second) {
+          furnishedByKind[it->second].push_back(it->first);
+        }
+      }
+      for (auto &[kind, files] : furnishedByKind) {
+        reverse(files.begin(), files.end());
+      }
+
+      unordered_map<string, vector<string>> requestedByKind;
+      vector<string> kinds;
+      for (auto &k : kv) {
+        auto furnishedKind = furnishedKinds.find(k);
+        kinds.push_back(furnishedKind != furnishedKinds.end() ? furnishedKind->second : getKernelType(k));
+        requestedByKind[kinds.back()].push_back(k);
+      }
+
+      // the first kernels of a kind can stay where they are if they are already the last ones
+      // furnished of that kind, in the same order. Everything after them is furnished on top.
+      // A furnished meta-kernel can shadow any kind, so nothing is reused around it.
+      unordered_map<string, size_t> reusable;
+      for (auto &[kind, requested] : requestedByKind) {
+        if (furnishedByKind.count("META")) {
+          break;
+        }
+        vector<string> &furnished = furnishedByKind[kind];
+        auto first = find(furnished.begin(), furnished.end(), requested.front());
+        size_t tail = distance(first, furnished.end());
+        bool matches = first != furnished.end() && tail <= requested.size() && equal(first, furnished.end(), requested.begin());
+        reusable[kind] = matches ? tail : 0;
+      }
+
+      unordered_map<string, size_t> seen;
+      size_t furnishCount = 0;
+      for (size_t i = 0; i < kv.size(); i++) {
+        bool reuse = seen[kinds[i]]++ < reusable[kinds[i]];
+        res.emplace_back(new Kernel(kv[i], !reuse));
+        furnishCount += reuse ? 0 : 1;
+      }
+
+      SPDLOG_DEBUG("Furnished {} of {} kernels, the rest were already loaded in order", furnishCount, kv.size());
+      return res;
+    });
   }
+
+
 } 
  
\ No newline at end of file
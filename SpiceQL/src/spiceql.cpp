@@ -81,6 +81,10 @@ namespace SpiceQL {
         SPDLOG_DEBUG("Log level enum: {}", log_level);
         SPDLOG_TRACE("Log dir: {}", log_dir);
       } 
+
+      if (getEnvBool("SPICEQL_FORK_HANDLERS")) {
+        registerForkHandlers();
+      }
     }
   };
   
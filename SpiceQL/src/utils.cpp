@@ -4,10 +4,31 @@
  * 
  **/
 
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
 #include <exception>
+#include <functional>
 #include <fstream>
+#include <iomanip>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
 #include <regex>
+#include <set>
+#include <sstream>
 #include <chrono>
+#include <numeric>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include <SpiceUsr.h>
 #include <SpiceZfc.h>
@@ -23,6 +44,8 @@
 #include <spdlog/spdlog.h>
 
 #include "config.h"
+#include "daf.h"
+#include "executor.h"
 #include "memo.h"
 #include "memoized_functions.h"
 #include "query.h"
@@ -109,34 +132,145 @@ namespace SpiceQL {
 
 
   vector<vector<string>> getPathsFromRegex(string root, vector<string> regexes) {
-    cout << "root: " << root << endl;
+    return getPathsFromRegexGroups(root, {regexes}).at(0);
+  }
+
+
+  vector<vector<vector<string>>> getPathsFromRegexGroups(string root, vector<vector<string>> regexGroups) {
     vector<string> files_to_search = Memo::ls(root, true);
-      
-    vector<vector<string>> kernels; 
-    string temp;
-    vector<string> paths;
-    paths.reserve(files_to_search.size());
-    
-    for (auto &regex : regexes) { 
-      paths.clear();
-      SPDLOG_INFO("Searching for kernels matching {} in {} files", regex, files_to_search.size());
-      
-      for (auto &f : files_to_search) {
-        temp = fs::path(f).filename();
-        if (regex_search(temp.c_str(), basic_regex(regex, regex_constants::optimize|regex_constants::ECMAScript))) {
-          paths.push_back(f);
+
+    // compile every distinct regex once, groups often share the same expressions
+    vector<string> uniqueRegexes;
+    unordered_map<string, size_t> regexIndex;
+    for (auto &group : regexGroups) {
+      for (auto &regex : group) {
+        if (regexIndex.emplace(regex, uniqueRegexes.size()).second) {
+          uniqueRegexes.push_back(regex);
+        }
+      }
+    }
+
+    vector<basic_regex<char>> compiled;
+    compiled.reserve(uniqueRegexes.size());
+    for (auto &regex : uniqueRegexes) {
+      compiled.emplace_back(regex, regex_constants::optimize|regex_constants::ECMAScript);
+    }
+
+    SPDLOG_INFO("Searching for kernels matching {} regexes in {} groups in {} files", uniqueRegexes.size(), regexGroups.size(), files_to_search.size());
+
+    // index the inventory by filename so each regex only runs against
+    // the files that can contain its literal prefix
+    vector<string> filenames;
+    filenames.reserve(files_to_search.size());
+    for (auto &f : files_to_search) {
+      filenames.push_back(fs::path(f).filename());
+    }
+
+    vector<size_t> sortedFiles(filenames.size());
+    iota(sortedFiles.begin(), sortedFiles.end(), 0);
+    sort(sortedFiles.begin(), sortedFiles.end(), [&](size_t a, size_t b) {
+      return filenames[a] < filenames[b];
+    });
+
+    vector<vector<string>> matches(uniqueRegexes.size());
+    for (size_t i = 0; i < compiled.size(); i++) {
+      auto [prefix, anchored] = getRegexLiteralPrefix(uniqueRegexes[i]);
+      vector<size_t> matched;
+
+      if (anchored && !prefix.empty()) {
+        // every match starts with the prefix, range scan the sorted names
+        auto first = lower_bound(sortedFiles.begin(), sortedFiles.end(), prefix, [&](size_t a, const string &p) {
+          return filenames[a].compare(0, p.size(), p) < 0;
+        });
+        for (auto it = first; it != sortedFiles.end() && filenames[*it].compare(0, prefix.size(), prefix) == 0; it++) {
+          if (regex_search(filenames[*it], compiled[i])) {
+            matched.push_back(*it);
+          }
+        }
+        // keep the inventory order
+        sort(matched.begin(), matched.end());
+      }
+      else {
+        // regex_search can match anywhere in the name, use the prefix as a substring filter
+        for (size_t j = 0; j < filenames.size(); j++) {
+          if ((prefix.empty() || filenames[j].find(prefix) != string::npos) && regex_search(filenames[j], compiled[i])) {
+            matched.push_back(j);
+          }
         }
       }
 
-      SPDLOG_DEBUG("found: {}", fmt::join(paths, ", "));
-      if (!paths.empty()) { 
-        kernels.push_back(paths);
+      SPDLOG_TRACE("{} literal prefix \"{}\" (anchored: {}), {} matches", uniqueRegexes[i], prefix, anchored, matched.size());
+      for (size_t j : matched) {
+        matches[i].push_back(files_to_search[j]);
       }
     }
 
-    return kernels;
+    vector<vector<vector<string>>> kernelGroups;
+    kernelGroups.reserve(regexGroups.size());
+    for (auto &group : regexGroups) {
+      vector<vector<string>> kernels;
+      for (auto &regex : group) {
+        vector<string> &paths = matches[regexIndex.at(regex)];
+        SPDLOG_DEBUG("{} found: {}", regex, fmt::join(paths, ", "));
+        if (!paths.empty()) {
+          kernels.push_back(paths);
+        }
+      }
+      kernelGroups.push_back(kernels);
+    }
+
+    return kernelGroups;
+  }
+
+  pair<string, bool> getRegexLiteralPrefix(string regex) {
+    bool anchored = !regex.empty() && regex.front() == '^';
+    string prefix;
+
+    // alternation can make any branch match, so nothing is guaranteed
+    for (size_t i = 0; i < regex.size(); i++) {
+      if (regex[i] == '\\') {
+        i++;
+      }
+      else if (regex[i] == '|') {
+        return {"", anchored};
+      }
+    }
+
+    const string metachars = ".[]()^$|";
+    const string quantifiers = "?*{+";
+
+    for (size_t i = anchored ? 1 : 0; i < regex.size(); i++) {
+      char c = regex[i];
+      size_t next = i + 1;
+
+      if (c == '\\') {
+        // \d, \w, \b and friends are classes, not literals
+        if (next >= regex.size() || isalnum(static_cast<unsigned char>(regex[next]))) {
+          break;
+        }
+        c = regex[next];
+        next++;
+      }
+      else if (metachars.find(c) != string::npos || quantifiers.find(c) != string::npos) {
+        break;
+      }
+
+      if (next < regex.size() && quantifiers.find(regex[next]) != string::npos) {
+        // c+ still needs one c, c?, c* and c{n,m} might not have any
+        if (regex[next] == '+') {
+          prefix += c;
+        }
+        break;
+      }
+
+      prefix += c;
+      i = next - 1;
+    }
+
+    return {prefix, anchored};
   }
 
+
   void mergeConfigs(json &baseConfig, const json &mergingConfig) {
     for (json::const_iterator it = mergingConfig.begin(); it != mergingConfig.end(); ++it) {
       if (baseConfig.contains(it.key())) {
@@ -175,272 +309,289 @@ namespace SpiceQL {
 
 
   vector<double> getTargetState(double et, string target, string observer, string frame, string abcorr) {
-    // convert params to spice types
-    ConstSpiceChar *target_spice = target.c_str();  // better way to do this?
-    ConstSpiceChar *observer_spice = observer.c_str();
-    ConstSpiceChar *frame_spice = frame.c_str();
-    ConstSpiceChar *abcorr_spice = abcorr.c_str();
+    return runOnSpiceExecutor([&]() -> vector<double> {
+      // convert params to spice types
+      ConstSpiceChar *target_spice = target.c_str();  // better way to do this?
+      ConstSpiceChar *observer_spice = observer.c_str();
+      ConstSpiceChar *frame_spice = frame.c_str();
+      ConstSpiceChar *abcorr_spice = abcorr.c_str();
 
-    // define outputs
-    SpiceDouble lt;
-    SpiceDouble starg_spice[6];
+      // define outputs
+      SpiceDouble lt;
+      SpiceDouble starg_spice[6];
 
-    checkNaifErrors();
-    spkezr_c( target_spice, et, frame_spice, abcorr_spice, observer_spice, starg_spice, &lt );
-    checkNaifErrors();
+      checkNaifErrors();
+      spkezr_c( target_spice, et, frame_spice, abcorr_spice, observer_spice, starg_spice, &lt );
+      checkNaifErrors();
 
-    // convert to std::array for output
-    vector<double> lt_starg = {0, 0, 0, 0, 0, 0, lt};
-    for(int i = 0; i < 6; i++) {
-      lt_starg[i] = starg_spice[i];
-    }
+      // convert to std::array for output
+      vector<double> lt_starg = {0, 0, 0, 0, 0, 0, lt};
+      for(int i = 0; i < 6; i++) {
+        lt_starg[i] = starg_spice[i];
+      }
 
-    return lt_starg;
+      return lt_starg;
+    });
   }
 
 
   vector<vector<double>> getTargetStates(vector<double> ets, string target, string observer, string frame, string abcorr, string mission, string ckQuality, string spkQuality, bool searchKernels) {
     SPDLOG_TRACE("Calling getTargetStates with {}, {}, {}, {}, {}, {}, {}, {}, {}", ets.size(), target, observer, frame, abcorr, mission, ckQuality, spkQuality, searchKernels);
-    
+
     if (ets.size() < 1) {
       throw invalid_argument("No ephemeris times given.");
     }
 
+    // the kernel search only needs CSPICE for coverage, which it runs on the SPICE executor itself
     json ephemKernels = {};
 
     if (searchKernels) {
-      ephemKernels = searchAndRefineKernels(mission, {ets.front(), ets.back()}, ckQuality, spkQuality, {"sclk", "ck", "spk", "pck", "tspk"});
+      ephemKernels = searchAndRefineKernels(mission, {ets.front(), ets.back()}, ckQuality, spkQuality, {"spk", "pck", "tspk"});
+
+      // only load the SPKs that have the target, observer or a body in between
+      try {
+        vector<int> bodies = {Memo::translateNameToCode(target, mission), Memo::translateNameToCode(observer, mission)};
+        json stored = getStoredBodyCoverage(mission, getKernelsAsVector(ephemKernels));
+        ephemKernels = filterKernelsByBodies(ephemKernels, bodies, ets, stored);
+      }
+      catch (exception &e) {
+        SPDLOG_DEBUG("Not filtering SPKs by body: {}", e.what());
+      }
     }
 
-    auto start = high_resolution_clock::now();
-    KernelSet ephemSet(ephemKernels);
-    auto stop = high_resolution_clock::now();
-    auto duration = duration_cast<microseconds>(stop - start);
-    SPDLOG_INFO("Time in microseconds to furnish kernel sets: {}", duration.count());
+    return runOnSpiceExecutor([&]() -> vector<vector<double>> {
+      auto start = high_resolution_clock::now();
+      KernelSet ephemSet(ephemKernels);
+      auto stop = high_resolution_clock::now();
+      auto duration = duration_cast<microseconds>(stop - start);
+      SPDLOG_INFO("Time in microseconds to furnish kernel sets: {}", duration.count());
     
-    start = high_resolution_clock::now();
-    vector<vector<double>> lt_stargs;
-    vector<double> lt_starg;
-    for (auto et: ets) {
-      lt_starg = getTargetState(et, target, observer, frame, abcorr);
-      lt_stargs.push_back(lt_starg);
-    }
+      start = high_resolution_clock::now();
+      vector<vector<double>> lt_stargs;
+      vector<double> lt_starg;
+      for (auto et: ets) {
+        lt_starg = getTargetState(et, target, observer, frame, abcorr);
+        lt_stargs.push_back(lt_starg);
+      }
 
-    stop = high_resolution_clock::now();
-    duration = duration_cast<microseconds>(stop - start);
-    SPDLOG_INFO("Time in microseconds to get data results: {}", duration.count());
+      stop = high_resolution_clock::now();
+      duration = duration_cast<microseconds>(stop - start);
+      SPDLOG_INFO("Time in microseconds to get data results: {}", duration.count());
  
-    return lt_stargs;
+      return lt_stargs;
+    });
   }
 
 
   vector<double> extractExactCkTimes(double observStart, double observEnd, int targetFrame, string mission, string ckQuality, bool searchKernels) {
-    SPDLOG_TRACE("Calling extractExactCkTimes with {}, {}, {}, {}, {}, {}", observStart, observEnd, targetFrame, mission, ckQuality, searchKernels);
-    Config config;
-    json missionJson;
-
     json ephemKernels = {};
 
     if (searchKernels) {
       ephemKernels = searchAndRefineKernels(mission, {observStart, observEnd}, ckQuality, "na", {"ck", "sclk"});
     }
 
-    KernelSet ephemSet(ephemKernels);
-
-    int count = 0;
-
-    //  Next line added 12-03-2009 to allow observations to cross segment boundaries
-    double currentTime = observStart;
-    bool timeLoaded = false;
-
-    // Get number of ck loaded for this rotation.  This method assumes only one SpiceRotation
-    // object is loaded.
-    checkNaifErrors();
-    ktotal_c("ck", (SpiceInt *)&count);
-
-    if (count > 1) {
-      std::string msg = "Unable to get exact CK record times when more than 1 CK is loaded, Aborting";
-      throw std::runtime_error(msg);
-    }
-    else if (count < 1) {
-      std::string msg = "No CK kernels loaded, Aborting";
-      throw std::runtime_error(msg);
-    }
-
-    // case of a single ck -- read instances and data straight from kernel for given time range
-    SpiceInt handle;
-
-    // Define some Naif constants
-    int FILESIZ = 128;
-    int TYPESIZ = 32;
-    int SOURCESIZ = 128;
-    //      double DIRSIZ = 100;
-
-    SpiceChar file[FILESIZ];
-    SpiceChar filtyp[TYPESIZ]; // kernel type (ck, ek, etc.)
-    SpiceChar source[SOURCESIZ];
-
-    SpiceBoolean found;
-    bool observationSpansToNextSegment = false;
+    return runOnSpiceExecutor([&]() -> vector<double> {
+      SPDLOG_TRACE("Calling extractExactCkTimes with {}, {}, {}, {}, {}, {}", observStart, observEnd, targetFrame, mission, ckQuality, searchKernels);
+      Config config;
+      json missionJson;
 
-    double segStartEt;
-    double segStopEt;
+      KernelSet ephemSet(ephemKernels);
 
-    kdata_c(0, "ck", FILESIZ, TYPESIZ, SOURCESIZ, file, filtyp, source, &handle, &found);
-    dafbfs_c(handle);
-    daffna_c(&found);
-    int spCode = ((int)(targetFrame / 1000)) * 1000;
-    std::vector<double> cacheTimes = {};
+      int count = 0;
 
-    while (found) {
-      observationSpansToNextSegment = false;
-      double sum[10]; // daf segment summary
-      double dc[2];   // segment starting and ending times in tics
-      SpiceInt ic[6]; // segment summary values:
-      // instrument code for platform,
-      // reference frame code,
-      // data type,
-      // velocity flag,
-      // offset to quat 1,
-      // offset to end.
-      dafgs_c(sum);
-      dafus_c(sum, (SpiceInt)2, (SpiceInt)6, dc, ic);
+      //  Next line added 12-03-2009 to allow observations to cross segment boundaries
+      double currentTime = observStart;
+      bool timeLoaded = false;
 
-      // Don't read type 5 ck here
-      if (ic[2] == 5)
-        break;
+      // Get number of ck loaded for this rotation.  This method assumes only one SpiceRotation
+      // object is loaded.
+      checkNaifErrors();
+      ktotal_c("ck", (SpiceInt *)&count);
 
-      // Check times for type 3 ck segment if spacecraft matches
-      if (ic[0] == spCode && ic[2] == 3) {
-        sct2e_c((int)spCode / 1000, dc[0], &segStartEt);
-        sct2e_c((int)spCode / 1000, dc[1], &segStopEt);
-        checkNaifErrors();
-        double et;
+      if (count > 1) {
+        std::string msg = "Unable to get exact CK record times when more than 1 CK is loaded, Aborting";
+        throw std::runtime_error(msg);
+      }
+      else if (count < 1) {
+        std::string msg = "No CK kernels loaded, Aborting";
+        throw std::runtime_error(msg);
+      }
 
-        // Get times for this segment
-        if (currentTime >= segStartEt && currentTime <= segStopEt) {
+      // case of a single ck -- read instances and data straight from kernel for given time range
+      SpiceInt handle;
+
+      // Define some Naif constants
+      int FILESIZ = 128;
+      int TYPESIZ = 32;
+      int SOURCESIZ = 128;
+      //      double DIRSIZ = 100;
+
+      SpiceChar file[FILESIZ];
+      SpiceChar filtyp[TYPESIZ]; // kernel type (ck, ek, etc.)
+      SpiceChar source[SOURCESIZ];
+
+      SpiceBoolean found;
+      bool observationSpansToNextSegment = false;
+
+      double segStartEt;
+      double segStopEt;
+
+      kdata_c(0, "ck", FILESIZ, TYPESIZ, SOURCESIZ, file, filtyp, source, &handle, &found);
+      dafbfs_c(handle);
+      daffna_c(&found);
+      int spCode = ((int)(targetFrame / 1000)) * 1000;
+      std::vector<double> cacheTimes = {};
+
+      while (found) {
+        observationSpansToNextSegment = false;
+        double sum[10]; // daf segment summary
+        double dc[2];   // segment starting and ending times in tics
+        SpiceInt ic[6]; // segment summary values:
+        // instrument code for platform,
+        // reference frame code,
+        // data type,
+        // velocity flag,
+        // offset to quat 1,
+        // offset to end.
+        dafgs_c(sum);
+        dafus_c(sum, (SpiceInt)2, (SpiceInt)6, dc, ic);
+
+        // Don't read type 5 ck here
+        if (ic[2] == 5)
+          break;
+
+        // Check times for type 3 ck segment if spacecraft matches
+        if (ic[0] == spCode && ic[2] == 3) {
+          sct2e_c((int)spCode / 1000, dc[0], &segStartEt);
+          sct2e_c((int)spCode / 1000, dc[1], &segStopEt);
+          checkNaifErrors();
+          double et;
+
+          // Get times for this segment
+          if (currentTime >= segStartEt && currentTime <= segStopEt) {
+
+            // Check for a gap in the time coverage by making sure the time span of the observation
+            //  does not cross a segment unless the next segment starts where the current one ends
+            if (observationSpansToNextSegment && currentTime > segStartEt) {
+              std::string msg = "Observation crosses segment boundary--unable to interpolate pointing";
+              throw std::runtime_error(msg);
+            }
+            if (observEnd > segStopEt) {
+              observationSpansToNextSegment = true;
+            }
 
-          // Check for a gap in the time coverage by making sure the time span of the observation
-          //  does not cross a segment unless the next segment starts where the current one ends
-          if (observationSpansToNextSegment && currentTime > segStartEt) {
-            std::string msg = "Observation crosses segment boundary--unable to interpolate pointing";
-            throw std::runtime_error(msg);
-          }
-          if (observEnd > segStopEt) {
-            observationSpansToNextSegment = true;
-          }
+            // Extract necessary header parameters
+            int dovelocity = ic[3];
+            int end = ic[5];
+            double val[2];
+            dafgda_c(handle, end - 1, end, val);
+            //            int nints = (int) val[0];
+            int ninstances = (int)val[1];
+            int numvel = dovelocity * 3;
+            int quatnoff = ic[4] + (4 + numvel) * ninstances - 1;
+            //            int nrdir = (int) (( ninstances - 1 ) / DIRSIZ); /* sclkdp directory records */
+            int sclkdp1off = quatnoff + 1;
+            int sclkdpnoff = sclkdp1off + ninstances - 1;
+            //            int start1off = sclkdpnoff + nrdir + 1;
+            //            int startnoff = start1off + nints - 1;
+            int sclkSpCode = spCode / 1000;
+
+            // Now get the times
+            std::vector<double> sclkdp(ninstances);
+            dafgda_c(handle, sclkdp1off, sclkdpnoff, (SpiceDouble *)&sclkdp[0]);
+
+            int instance = 0;
+            sct2e_c(sclkSpCode, sclkdp[0], &et);
+
+            while (instance < (ninstances - 1) && et < currentTime) {
+              instance++;
+              sct2e_c(sclkSpCode, sclkdp[instance], &et);
+            }
 
-          // Extract necessary header parameters
-          int dovelocity = ic[3];
-          int end = ic[5];
-          double val[2];
-          dafgda_c(handle, end - 1, end, val);
-          //            int nints = (int) val[0];
-          int ninstances = (int)val[1];
-          int numvel = dovelocity * 3;
-          int quatnoff = ic[4] + (4 + numvel) * ninstances - 1;
-          //            int nrdir = (int) (( ninstances - 1 ) / DIRSIZ); /* sclkdp directory records */
-          int sclkdp1off = quatnoff + 1;
-          int sclkdpnoff = sclkdp1off + ninstances - 1;
-          //            int start1off = sclkdpnoff + nrdir + 1;
-          //            int startnoff = start1off + nints - 1;
-          int sclkSpCode = spCode / 1000;
-
-          // Now get the times
-          std::vector<double> sclkdp(ninstances);
-          dafgda_c(handle, sclkdp1off, sclkdpnoff, (SpiceDouble *)&sclkdp[0]);
-
-          int instance = 0;
-          sct2e_c(sclkSpCode, sclkdp[0], &et);
-
-          while (instance < (ninstances - 1) && et < currentTime) {
-            instance++;
+            if (instance > 0)
+              instance--;
             sct2e_c(sclkSpCode, sclkdp[instance], &et);
-          }
-
-          if (instance > 0)
-            instance--;
-          sct2e_c(sclkSpCode, sclkdp[instance], &et);
 
-          while (instance < (ninstances - 1) && et < observEnd) {
+            while (instance < (ninstances - 1) && et < observEnd) {
+              cacheTimes.push_back(et);
+              instance++;
+              sct2e_c(sclkSpCode, sclkdp[instance], &et);
+            }
             cacheTimes.push_back(et);
-            instance++;
-            sct2e_c(sclkSpCode, sclkdp[instance], &et);
-          }
-          cacheTimes.push_back(et);
 
-          if (!observationSpansToNextSegment) {
-            timeLoaded = true;
-            break;
-          }
-          else {
-            currentTime = segStopEt;
+            if (!observationSpansToNextSegment) {
+              timeLoaded = true;
+              break;
+            }
+            else {
+              currentTime = segStopEt;
+            }
           }
         }
+        dafcs_c(handle);  // Continue search in daf last searched
+        daffna_c(&found); // Find next forward array in current daf
       }
-      dafcs_c(handle);  // Continue search in daf last searched
-      daffna_c(&found); // Find next forward array in current daf
-    }
 
-    return cacheTimes;
+      return cacheTimes;
+    });
   }
 
   vector<double> getTargetOrientation(double et, int toFrame, int refFrame) {
-    // Much of this function is from ISIS SpiceRotation.cpp
-    SpiceDouble stateCJ[6][6];
-    SpiceDouble CJ_spice[3][3];
-    SpiceDouble av_spice[3];
-    SpiceDouble quat_spice[4];
-
-    vector<double> orientation = {0, 0, 0, 0};
+    return runOnSpiceExecutor([&]() -> vector<double> {
+      // Much of this function is from ISIS SpiceRotation.cpp
+      SpiceDouble stateCJ[6][6];
+      SpiceDouble CJ_spice[3][3];
+      SpiceDouble av_spice[3];
+      SpiceDouble quat_spice[4];
 
-    bool has_av = true;
+      vector<double> orientation = {0, 0, 0, 0};
 
-    // First try getting the entire state matrix (6x6), which includes CJ and the angular velocity
-    checkNaifErrors();
-    frmchg_((int *) &refFrame, (int *) &toFrame, &et, (doublereal *) stateCJ);
-    checkNaifErrors();
+      bool has_av = true;
 
-    if (!failed_c()) {
-      // Transpose and isolate CJ and av
+      // First try getting the entire state matrix (6x6), which includes CJ and the angular velocity
       checkNaifErrors();
-      xpose6_c(stateCJ, stateCJ);
-      xf2rav_c(stateCJ, CJ_spice, av_spice);
+      frmchg_((int *) &refFrame, (int *) &toFrame, &et, (doublereal *) stateCJ);
       checkNaifErrors();
 
-      // Convert to std::array for output
-      for(int i = 0; i < 3; i++) {
-        orientation.push_back(av_spice[i]);
-      }
+      if (!failed_c()) {
+        // Transpose and isolate CJ and av
+        checkNaifErrors();
+        xpose6_c(stateCJ, stateCJ);
+        xf2rav_c(stateCJ, CJ_spice, av_spice);
+        checkNaifErrors();
 
-    }
-    else {  // TODO This case is untested
-      // Recompute CJ_spice ignoring av
-      checkNaifErrors();
-      reset_c(); // reset frmchg_ failure
+        // Convert to std::array for output
+        for(int i = 0; i < 3; i++) {
+          orientation.push_back(av_spice[i]);
+        }
 
-      refchg_((int *) &refFrame, (int *) &toFrame, &et, (doublereal *) CJ_spice);
-      xpose_c(CJ_spice, CJ_spice);
-      checkNaifErrors();
+      }
+      else {  // TODO This case is untested
+        // Recompute CJ_spice ignoring av
+        checkNaifErrors();
+        reset_c(); // reset frmchg_ failure
 
-      has_av = false;
-    }
+        refchg_((int *) &refFrame, (int *) &toFrame, &et, (doublereal *) CJ_spice);
+        xpose_c(CJ_spice, CJ_spice);
+        checkNaifErrors();
+
+        has_av = false;
+      }
 
-    // Translate matrix to std:array quaternion
-    m2q_c(CJ_spice, quat_spice);
+      // Translate matrix to std:array quaternion
+      m2q_c(CJ_spice, quat_spice);
 
-    for(int i = 0; i < 4; i++) {
-      orientation[i] = quat_spice[i];
-    }
+      for(int i = 0; i < 4; i++) {
+        orientation[i] = quat_spice[i];
+      }
 
-    return orientation;
+      return orientation;
+    });
   }
 
 
   vector<vector<double>> getTargetOrientations(vector<double> ets, int toFrame, int refFrame, string mission, string ckQuality, bool searchKernels) {
     SPDLOG_TRACE("Calling getTargetOrientations with {}, {}, {}, {}, {}, {}", ets.size(), toFrame, refFrame, mission, ckQuality, searchKernels);
-    Config config;
-    json missionJson;
 
     if (ets.size() < 1) {
       throw invalid_argument("No ephemeris times given.");
@@ -452,155 +603,163 @@ namespace SpiceQL {
       ephemKernels = searchAndRefineKernels(mission, {ets.front(), ets.back()}, ckQuality, "na", {"sclk", "ck", "pck", "fk", "tspk"});
     }
 
-    auto start = high_resolution_clock::now();
-    KernelSet ephemSet(ephemKernels);
-    auto stop = high_resolution_clock::now();
-    auto duration = duration_cast<microseconds>(stop - start);
-    SPDLOG_INFO("Time in microseconds to furnish kernel sets: {}", duration.count());
-
-    start = high_resolution_clock::now();
-    vector<vector<double>> orientations = {};
-    vector<double> orientation;
-    for (auto et: ets) {
-      orientation = getTargetOrientation(et, toFrame, refFrame);
-      orientations.push_back(orientation);
-    }
-    stop = high_resolution_clock::now();
-    duration = duration_cast<microseconds>(stop - start);
-    SPDLOG_INFO("Time in microseconds to get data results: {}", duration.count());
+    return runOnSpiceExecutor([&]() -> vector<vector<double>> {
+      Config config;
+      json missionJson;
+
+      auto start = high_resolution_clock::now();
+      KernelSet ephemSet(ephemKernels);
+      auto stop = high_resolution_clock::now();
+      auto duration = duration_cast<microseconds>(stop - start);
+      SPDLOG_INFO("Time in microseconds to furnish kernel sets: {}", duration.count());
+
+      start = high_resolution_clock::now();
+      vector<vector<double>> orientations = {};
+      vector<double> orientation;
+      for (auto et: ets) {
+        orientation = getTargetOrientation(et, toFrame, refFrame);
+        orientations.push_back(orientation);
+      }
+      stop = high_resolution_clock::now();
+      duration = duration_cast<microseconds>(stop - start);
+      SPDLOG_INFO("Time in microseconds to get data results: {}", duration.count());
 
-    return orientations;
+      return orientations;
+    });
   }
 
 
   vector<vector<int>> frameTrace(double et, int initialFrame, string mission, string ckQuality, bool searchKernels) {
-    checkNaifErrors();
-    Config config;
-    json missionJson;
     json ephemKernels;
 
     if (searchKernels) {
       ephemKernels = searchAndRefineKernels(mission, {et}, ckQuality, "na", {"sclk", "ck", "pck", "fk", "tspk"});
     }
 
-    KernelSet ephemSet(ephemKernels);
-
-    checkNaifErrors();
-    // The code for this method was extracted from the Naif routine rotget written by N.J. Bachman &
-    //   W.L. Taber (JPL)
-    int           center;
-    int           type;
-    int           typid;
-    SpiceBoolean  found;
-    int           frmidx;  // Frame chain index for current frame
-    SpiceInt      nextFrame;   // Naif frame code of next frame
-    int           J2000Code = 1;
-    checkNaifErrors();
-    vector<int> frameCodes;
-    vector<int> frameTypes;
-    vector<int> constantFrames;
-    vector<int> timeFrames;
-    frameCodes.push_back(initialFrame);
-    frinfo_c((SpiceInt)frameCodes[0],
-             (SpiceInt *)&center,
-             (SpiceInt *)&type,
-             (SpiceInt *)&typid, &found);
-    frameTypes.push_back(type);
-
-    while (frameCodes[frameCodes.size() - 1] != J2000Code) {
-      frmidx  =  frameCodes.size() - 1;
-      // First get the frame type  (Note:: we may also need to save center if we use dynamic frames)
-      // (Another note:  the type returned is the Naif from type.  This is not quite the same as the
-      // SpiceRotation enumerated FrameType.  The SpiceRotation FrameType differentiates between
-      // pck types.  FrameTypes of 2, 6, and 7 will all be considered to be Naif frame type 2.  The
-      // logic for FrameTypes in this method is correct for all types except type 7.  Current pck
-      // do not exercise this option.  Should we ever use pck with a target body not referenced to
-      // the J2000 frame and epoch, both this method and loadPCFromSpice will need to be modified.
-      frinfo_c((SpiceInt) frameCodes[frmidx],
-               (SpiceInt *) &center,
-               (SpiceInt *) &type,
-               (SpiceInt *) &typid, &found);
+    return runOnSpiceExecutor([&]() -> vector<vector<int>> {
+      checkNaifErrors();
+      Config config;
+      json missionJson;
 
-      if (!found) {
-        string msg = "The frame " + to_string(frameCodes[frmidx]) + " is not supported by Naif";
-        throw logic_error(msg);
-      }
+      KernelSet ephemSet(ephemKernels);
 
-      double matrix[3][3];
+      checkNaifErrors();
+      // The code for this method was extracted from the Naif routine rotget written by N.J. Bachman &
+      //   W.L. Taber (JPL)
+      int           center;
+      int           type;
+      int           typid;
+      SpiceBoolean  found;
+      int           frmidx;  // Frame chain index for current frame
+      SpiceInt      nextFrame;   // Naif frame code of next frame
+      int           J2000Code = 1;
+      checkNaifErrors();
+      vector<int> frameCodes;
+      vector<int> frameTypes;
+      vector<int> constantFrames;
+      vector<int> timeFrames;
+      frameCodes.push_back(initialFrame);
+      frinfo_c((SpiceInt)frameCodes[0],
+               (SpiceInt *)&center,
+               (SpiceInt *)&type,
+               (SpiceInt *)&typid, &found);
+      frameTypes.push_back(type);
 
-      // To get the next link in the frame chain, use the frame type
-      // 1 = INTERNAL, 2 = PCK
-      if (type == 1 ||  type == 2) {
-        nextFrame = J2000Code;
-      }
-      // 3 = CK
-      else if (type == 3) {
-        ckfrot_((SpiceInt *) &typid, &et, (double *) matrix, &nextFrame, (logical *) &found);
+      while (frameCodes[frameCodes.size() - 1] != J2000Code) {
+        frmidx  =  frameCodes.size() - 1;
+        // First get the frame type  (Note:: we may also need to save center if we use dynamic frames)
+        // (Another note:  the type returned is the Naif from type.  This is not quite the same as the
+        // SpiceRotation enumerated FrameType.  The SpiceRotation FrameType differentiates between
+        // pck types.  FrameTypes of 2, 6, and 7 will all be considered to be Naif frame type 2.  The
+        // logic for FrameTypes in this method is correct for all types except type 7.  Current pck
+        // do not exercise this option.  Should we ever use pck with a target body not referenced to
+        // the J2000 frame and epoch, both this method and loadPCFromSpice will need to be modified.
+        frinfo_c((SpiceInt) frameCodes[frmidx],
+                 (SpiceInt *) &center,
+                 (SpiceInt *) &type,
+                 (SpiceInt *) &typid, &found);
 
         if (!found) {
-          string msg = "The ck rotation from frame " + to_string(frameCodes[frmidx]) + " can not "
-               + "be found due to no pointing available at requested time or a problem with the "
-               + "frame";
+          string msg = "The frame " + to_string(frameCodes[frmidx]) + " is not supported by Naif";
           throw logic_error(msg);
         }
-      }
-      // 4 = TK
-      else if (type == 4) {
-        tkfram_((SpiceInt *) &typid, (double *) matrix, &nextFrame, (logical *) &found);
-        if (!found) {
-          string msg = "The tk rotation from frame " + to_string(frameCodes[frmidx]) +
-                       " can not be found";
+
+        double matrix[3][3];
+
+        // To get the next link in the frame chain, use the frame type
+        // 1 = INTERNAL, 2 = PCK
+        if (type == 1 ||  type == 2) {
+          nextFrame = J2000Code;
+        }
+        // 3 = CK
+        else if (type == 3) {
+          ckfrot_((SpiceInt *) &typid, &et, (double *) matrix, &nextFrame, (logical *) &found);
+
+          if (!found) {
+            string msg = "The ck rotation from frame " + to_string(frameCodes[frmidx]) + " can not "
+                 + "be found due to no pointing available at requested time or a problem with the "
+                 + "frame";
+            throw logic_error(msg);
+          }
+        }
+        // 4 = TK
+        else if (type == 4) {
+          tkfram_((SpiceInt *) &typid, (double *) matrix, &nextFrame, (logical *) &found);
+          if (!found) {
+            string msg = "The tk rotation from frame " + to_string(frameCodes[frmidx]) +
+                         " can not be found";
+            throw logic_error(msg);
+          }
+        }
+        // 5 = DYN
+        else if (type == 5) {
+          //
+          //        Unlike the other frame classes, the dynamic frame evaluation
+          //        routine ZZDYNROT requires the input frame ID rather than the
+          //        dynamic frame class ID. ZZDYNROT also requires the center ID
+          //        we found via the FRINFO call.
+
+          zzdynrot_((SpiceInt *) &typid, (SpiceInt *) &center, &et, (double *) matrix, &nextFrame);
+        }
+
+        else {
+          string msg = "The frame " + to_string(frameCodes[frmidx]) +
+                       " has a type " + to_string(type) + " not supported by your version of Naif Spicelib. " + 
+                       "You need to update.";
           throw logic_error(msg);
         }
+        frameCodes.push_back(nextFrame);
+        frameTypes.push_back(type);
       }
-      // 5 = DYN
-      else if (type == 5) {
-        //
-        //        Unlike the other frame classes, the dynamic frame evaluation
-        //        routine ZZDYNROT requires the input frame ID rather than the
-        //        dynamic frame class ID. ZZDYNROT also requires the center ID
-        //        we found via the FRINFO call.
+      SPDLOG_TRACE("All Frame Chain Codes: {}", fmt::join(frameCodes, ", "));
 
-        zzdynrot_((SpiceInt *) &typid, (SpiceInt *) &center, &et, (double *) matrix, &nextFrame);
+      constantFrames.clear();
+      // 4 = TK
+      while (frameCodes.size() > 0) {
+        if (frameTypes[0] == 4) {
+          constantFrames.push_back(frameCodes[0]);
+          frameCodes.erase(frameCodes.begin());
+          frameTypes.erase(frameTypes.begin());
+        }
+        else {
+          break;
+        }
       }
 
-      else {
-        string msg = "The frame " + to_string(frameCodes[frmidx]) +
-                     " has a type " + to_string(type) + " not supported by your version of Naif Spicelib. " + 
-                     "You need to update.";
-        throw logic_error(msg);
+      if (constantFrames.size() != 0) {
+        timeFrames.push_back(constantFrames[constantFrames.size() - 1]);
       }
-      frameCodes.push_back(nextFrame);
-      frameTypes.push_back(type);
-    }
-    SPDLOG_TRACE("All Frame Chain Codes: {}", fmt::join(frameCodes, ", "));
 
-    constantFrames.clear();
-    // 4 = TK
-    while (frameCodes.size() > 0) {
-      if (frameTypes[0] == 4) {
-        constantFrames.push_back(frameCodes[0]);
-        frameCodes.erase(frameCodes.begin());
-        frameTypes.erase(frameTypes.begin());
-      }
-      else {
-        break;
+      for (int i = 0;  i < (int) frameCodes.size(); i++) {
+        timeFrames.push_back(frameCodes[i]);
       }
-    }
-
-    if (constantFrames.size() != 0) {
-      timeFrames.push_back(constantFrames[constantFrames.size() - 1]);
-    }
-
-    for (int i = 0;  i < (int) frameCodes.size(); i++) {
-      timeFrames.push_back(frameCodes[i]);
-    }
-    SPDLOG_TRACE("Time Dependent Frame Chain Codes: {}", fmt::join(timeFrames, ", "));
-    SPDLOG_TRACE("Constant Frame Chain Codes: {}", fmt::join(constantFrames, ", "));
-    checkNaifErrors();
+      SPDLOG_TRACE("Time Dependent Frame Chain Codes: {}", fmt::join(timeFrames, ", "));
+      SPDLOG_TRACE("Constant Frame Chain Codes: {}", fmt::join(constantFrames, ", "));
+      checkNaifErrors();
 
-    vector<vector<int>> res = {timeFrames, constantFrames};
-    return res;
+      vector<vector<int>> res = {timeFrames, constantFrames};
+      return res;
+    });
   }
 
 
@@ -608,132 +767,134 @@ namespace SpiceQL {
   // returns json with up to ROOM=50 matching keynames:values
   // if no keys are found, returns null
   json findKeywords(string keytpl) {
-    // Define gnpool i/o
-    const SpiceInt START = 0;
-    const SpiceInt ROOM = 50;
-    const SpiceInt LENOUT = 100;
-    ConstSpiceChar *cstr = keytpl.c_str();
-    SpiceInt nkeys;
-    SpiceChar kvals [ROOM][LENOUT];
-    SpiceBoolean gnfound;
-
-    // Call gnpool to search for input key template
-    checkNaifErrors();
-    gnpool_c(cstr, START, ROOM, LENOUT, &nkeys, kvals, &gnfound);
-    checkNaifErrors();
-
-    if(!gnfound) {
-      return nullptr;
-    }
-
-    // Call gXpool for each key found in gnpool
-    // accumulate results to json allResults
-
-    // Define gXpool params
-    ConstSpiceChar *fkey;
-    SpiceInt nvals;
-    SpiceChar cvals [ROOM][LENOUT];
-    SpiceDouble dvals[ROOM];
-    SpiceInt ivals[ROOM];
-    SpiceBoolean gcfound = false, gdfound = false, gifound = false;
-
-    json allResults;
-    
-    // iterate over kvals;
-    for(int i = 0; i < nkeys; i++) {
-      json jresultVal;
-
-      fkey = &kvals[i][0];
-
+    return runOnSpiceExecutor([&]() -> json {
+      // Define gnpool i/o
+      const SpiceInt START = 0;
+      const SpiceInt ROOM = 50;
+      const SpiceInt LENOUT = 100;
+      ConstSpiceChar *cstr = keytpl.c_str();
+      SpiceInt nkeys;
+      SpiceChar kvals [ROOM][LENOUT];
+      SpiceBoolean gnfound;
+
+      // Call gnpool to search for input key template
       checkNaifErrors();
-      gdpool_c(fkey, START, ROOM, &nvals, dvals, &gdfound);
+      gnpool_c(cstr, START, ROOM, LENOUT, &nkeys, kvals, &gnfound);
       checkNaifErrors();
 
-      if (gdfound) {
-        // format output
-        if (nvals == 1) {
-          jresultVal = dvals[0];
-        }
-        else {
-          for(int j=0; j<nvals; j++) {
-            jresultVal.push_back(dvals[j]);
-          }
-        }
+      if(!gnfound) {
+        return nullptr;
       }
 
-      if (!gdfound) {
-        gipool_c(fkey, START, ROOM, &nvals, ivals, &gifound);
-        checkNaifErrors();
+      // Call gXpool for each key found in gnpool
+      // accumulate results to json allResults
 
-      }
+      // Define gXpool params
+      ConstSpiceChar *fkey;
+      SpiceInt nvals;
+      SpiceChar cvals [ROOM][LENOUT];
+      SpiceDouble dvals[ROOM];
+      SpiceInt ivals[ROOM];
+      SpiceBoolean gcfound = false, gdfound = false, gifound = false;
 
-      if (gifound) {
-        // format output
-        if (nvals == 1) {
-          jresultVal = ivals[0];
-        }
-        else {
-          for(int j=0; j<nvals; j++) {
-            jresultVal.push_back(ivals[j]);
-          }
-        }
-      }
+      json allResults;
+    
+      // iterate over kvals;
+      for(int i = 0; i < nkeys; i++) {
+        json jresultVal;
 
-      if (!gifound || !gdfound) {
-        gcpool_c(fkey, START, ROOM, LENOUT, &nvals, cvals, &gcfound);
-        checkNaifErrors();
-      }
+        fkey = &kvals[i][0];
 
-      if (gcfound) {
-        // format gcpool output
-        string str_cval;
-        if (nvals == 1) {
-          str_cval.assign(&cvals[0][0]);
-          string lower = toLower(str_cval);
+        checkNaifErrors();
+        gdpool_c(fkey, START, ROOM, &nvals, dvals, &gdfound);
+        checkNaifErrors();
 
-          // if null or boolean, do a conversion
-          if (lower == "true") {
-            jresultVal = true;
+        if (gdfound) {
+          // format output
+          if (nvals == 1) {
+            jresultVal = dvals[0];
           }
-          else if (lower == "false") {
-            jresultVal = false;
+          else {
+            for(int j=0; j<nvals; j++) {
+              jresultVal.push_back(dvals[j]);
+            }
           }
-          else if (lower == "null") {
-            jresultVal = nullptr;
+        }
+
+        if (!gdfound) {
+          gipool_c(fkey, START, ROOM, &nvals, ivals, &gifound);
+          checkNaifErrors();
+
+        }
+
+        if (gifound) {
+          // format output
+          if (nvals == 1) {
+            jresultVal = ivals[0];
           }
           else {
-            jresultVal = str_cval;
+            for(int j=0; j<nvals; j++) {
+              jresultVal.push_back(ivals[j]);
+            }
           }
         }
-        else {
-          for(int j=0; j<nvals; j++) {
-            str_cval.assign(&cvals[j][0]);
+
+        if (!gifound || !gdfound) {
+          gcpool_c(fkey, START, ROOM, LENOUT, &nvals, cvals, &gcfound);
+          checkNaifErrors();
+        }
+
+        if (gcfound) {
+          // format gcpool output
+          string str_cval;
+          if (nvals == 1) {
+            str_cval.assign(&cvals[0][0]);
             string lower = toLower(str_cval);
 
             // if null or boolean, do a conversion
             if (lower == "true") {
-              jresultVal.push_back(true);
+              jresultVal = true;
             }
             else if (lower == "false") {
-              jresultVal.push_back(false);
+              jresultVal = false;
             }
             else if (lower == "null") {
-              jresultVal.push_back(nullptr);
+              jresultVal = nullptr;
             }
             else {
-              jresultVal.push_back(str_cval);
+              jresultVal = str_cval;
+            }
+          }
+          else {
+            for(int j=0; j<nvals; j++) {
+              str_cval.assign(&cvals[j][0]);
+              string lower = toLower(str_cval);
+
+              // if null or boolean, do a conversion
+              if (lower == "true") {
+                jresultVal.push_back(true);
+              }
+              else if (lower == "false") {
+                jresultVal.push_back(false);
+              }
+              else if (lower == "null") {
+                jresultVal.push_back(nullptr);
+              }
+              else {
+                jresultVal.push_back(str_cval);
+              }
             }
           }
         }
-      }
 
-      // append to allResults:
-      //     key:list-of-values
-      string resultKey(fkey);
-      allResults[resultKey] = jresultVal;
-    }
+        // append to allResults:
+        //     key:list-of-values
+        string resultKey(fkey);
+        allResults[resultKey] = jresultVal;
+      }
 
-    return allResults;
+      return allResults;
+    });
   }
 
   vector<json::json_pointer> findKeyInJson(json in, string key, bool recursive) {
@@ -892,165 +1053,720 @@ namespace SpiceQL {
   }
 
 
-  vector<pair<double, double>> getTimeIntervals(string kpath) {
-    auto formatIntervals = [&](SpiceCell &coverage) -> vector<pair<double, double>> {
-      //Get the number of intervals in the object.
-      checkNaifErrors();
-
-      int niv = card_c(&coverage) / 2;
-      //Convert the coverage interval start and stop times to TDB
-      SpiceDouble begin, end;
+  /**
+   * Converts CK intervals in encoded SCLK ticks to ephemeris time like ckcov_c does.
+   * Uses CSPICE for the clock conversion, which runs on the SPICE executor.
+   */
+  static vector<pair<double, double>> ckTicksToEt(int instrument, const vector<pair<double, double>> &intervals) {
+    return runOnSpiceExecutor([&]() -> vector<pair<double, double>> {
+      vector<pair<double, double>> result;
 
-      vector<pair<double, double>> res;
+      SpiceInt sclkId;
+      checkNaifErrors();
+      ckmeta_c(instrument, "SCLK", &sclkId);
+      checkNaifErrors();
 
-      for(int j = 0;  j < niv;  j++) {
-        //Get the endpoints of the jth interval.
-        wnfetd_c(&coverage, j, &begin, &end);
+      for (auto &interval : intervals) {
+        SpiceDouble begin, end;
+        sct2e_c(sclkId, interval.first, &begin);
+        sct2e_c(sclkId, interval.second, &end);
         checkNaifErrors();
-        pair<double, double> p = {begin, end};
-        res.emplace_back(p);
+        result.emplace_back(begin, end);
       }
 
-      return res;
-    };
-
-
-    SpiceChar fileType[32], source[2048];
-    SpiceInt handle;
-    SpiceBoolean found;
+      return result;
+    });
+  }
 
-    Kernel k(kpath);
 
-    checkNaifErrors();
-    kinfo_c(kpath.c_str(), 32, 2048, fileType, source, &handle, &found);
-    checkNaifErrors();
+  /**
+   * Coverage of one CK instrument in ephemeris time. Segment level coverage without
+   * a tolerance comes straight from the native summaries, anything else is read with
+   * ckcov_c since interval bounds are inside the segments' data. CSPICE calls run on the SPICE executor.
+   */
+  static vector<pair<double, double>> ckCoverage(const string &kpath, int instrument, const vector<pair<double, double>> &segmentTicks,
+                                                 const string &level, double tolerance) {
+    if (level == "SEGMENT" && tolerance == 0) {
+      return ckTicksToEt(instrument, segmentTicks);
+    }
 
-    string currFile = fileType;
+    return runOnSpiceExecutor([&]() -> vector<pair<double, double>> {
+      //  200,000 is the max coverage window size for a CK kernel
+      SPICEDOUBLE_CELL(cover, 200000);
+      ssize_c(0, &cover);
+      ssize_c(200000, &cover);
 
-    //create a spice cell capable of containing all the objects in the kernel.
-    SPICEINT_CELL(currCell, 100);
+      checkNaifErrors();
+      ckcov_c(kpath.c_str(), instrument, SPICEFALSE, level.c_str(), tolerance, "TDB", &cover);
+      checkNaifErrors();
 
-    //this resizing is done because otherwise a spice cell will append new data
-    //to the last "currCell"
-    ssize_c(0, &currCell);
-    ssize_c(100, &currCell);
+      vector<pair<double, double>> result;
+      int niv = card_c(&cover) / 2;
+      for (int j = 0; j < niv; j++) {
+        SpiceDouble begin, end;
+        wnfetd_c(&cover, j, &begin, &end);
+        result.emplace_back(begin, end);
+      }
+      checkNaifErrors();
 
-    SPICEDOUBLE_CELL(cover, 100);
+      return result;
+    });
+  }
 
-    if (currFile == "SPK") {
-      spkobj_c(kpath.c_str(), &currCell);
-    }
-    else if (currFile == "CK") {
-      ckobj_c(kpath.c_str(), &currCell);
-    }
-    else if (currFile == "TEXT") {
-      throw invalid_argument("Input Kernel is a text kernel which has no intervals");
-    }
-    checkNaifErrors();
 
+  /**
+   * Flattens native DAF coverage into getTimeIntervals' format, only negative
+   * NAIF codes are kept and CK coverage is converted to ephemeris time at the requested level.
+   */
+  static vector<pair<double, double>> dafCoverageToTimeIntervals(const string &kpath, string type, map<int, vector<pair<double, double>>> coverage,
+                                                                 const string &ckLevel, double ckTolerance) {
     vector<pair<double, double>> result;
 
-    for(int bodyCount = 0 ; bodyCount < card_c(&currCell) ; bodyCount++) {
-      //get the NAIF body code
-      int body = SPICE_CELL_ELEM_I(&currCell, bodyCount);
-
+    for (auto &[body, intervals] : coverage) {
       //only provide coverage for negative NAIF codes
-      //(Positive codes indicate planetary bodies, negatives indicate
-      // spacecraft and instruments)
-      checkNaifErrors();
-      if (body < 0) {
-        vector<pair<double, double>> times;
-        //find the correct coverage window
-        if(currFile == "SPK") {
-          SPICEDOUBLE_CELL(cover, 1000);
-          ssize_c(0, &cover);
-          ssize_c(1000, &cover);
-          spkcov_c(kpath.c_str(), body, &cover);
-          times = formatIntervals(cover);
-        }
-        else if(currFile == "CK") {
-          //  200,000 is the max coverage window size for a CK kernel
-          SPICEDOUBLE_CELL(cover, 1000);
-          ssize_c(0, &cover);
-          ssize_c(1000, &cover);
+      if (body >= 0) {
+        continue;
+      }
 
-          // A SPICE SEGMENT is composed of SPICE INTERVALS
-          ckcov_c(kpath.c_str(), body, SPICEFALSE, "SEGMENT", 0.0, "TDB", &cover);
+      vector<pair<double, double>> times = type == "CK" ? ckCoverage(kpath, body, intervals, ckLevel, ckTolerance) : intervals;
+      result.insert(result.end(), times.begin(), times.end());
+    }
+
+    return result;
+  }
 
-          times = formatIntervals(cover);
-        }
-        checkNaifErrors();
 
-        result.reserve(result.size() + distance(times.begin(), times.end()));
-        result.insert(result.end(), times.begin(), times.end());
+  /**
+   * Per body coverage of native DAF summaries in getBodyCoverage's format
+   */
+  static json dafBodyCoverage(const string &kpath, const DafSummaries &daf, const string &ckLevel, double ckTolerance) {
+    json bodies = json::object();
 
+    map<int, set<int>> centers;
+    if (daf.type == "SPK") {
+      for (auto &segment : daf.segments) {
+        centers[segment.ic[0]].insert(segment.ic[1]);
       }
     }
-    return result;
-  }
 
+    for (auto &[body, intervals] : getDafCoverage(daf)) {
+      string id = to_string(body);
+      bodies[id]["intervals"] = daf.type == "CK" ? ckCoverage(kpath, body, intervals, ckLevel, ckTolerance) : intervals;
+      if (daf.type == "SPK") {
+        bodies[id]["centers"] = centers[body];
+      }
+    }
 
-  string globTimeIntervals(string mission) { 
-    SPDLOG_TRACE("In globTimeIntervals.");
-    Config conf;
-    conf = conf[mission];
-    json new_json = {};
-    json sclk_json = getLatestKernels(conf.get("sclk"));
-    KernelSet sclks(sclk_json);
+    return bodies;
+  }
 
-    // Get CK Times
-    json ckJson = conf.getRecursive("ck");
 
-    vector<json::json_pointer> ckKernelGrps = findKeyInJson(ckJson, "kernels");
-    for(auto &ckKernelGrp : ckKernelGrps) { 
-      vector<vector<string>> kernelList = json2DArrayTo2DVector(ckJson[ckKernelGrp]);
-      for(auto &subList : kernelList) { 
-        for (auto & kernel : subList) {
-          vector<pair<double, double>> timeIntervals = getTimeIntervals(kernel);
-          new_json[kernel] = timeIntervals;
-        }
+  string getBodyCoverage(string kpath, string ckLevel, double ckTolerance) {
+    try {
+      DafSummaries daf = readDafSummaries(kpath);
+      if (daf.type == "SPK" || daf.type == "CK" || daf.type == "PCK") {
+        return dafBodyCoverage(kpath, daf, ckLevel, ckTolerance).dump();
       }
     }
-    
-    // get SPK times
-    json spkJson = conf.getRecursive("spk");
-    vector<json::json_pointer> spkKernelGrps = findKeyInJson(spkJson, "kernels");
-    for(auto &spkKernelGrp : spkKernelGrps) { 
-      vector<vector<string>> kernelList = json2DArrayTo2DVector(spkJson[spkKernelGrp]);
-      for(auto &subList : kernelList) { 
-        for (auto & kernel : subList) {
-          vector<pair<double, double>> timeIntervals = getTimeIntervals(kernel);
-          new_json[kernel] = timeIntervals;
-        }
-      }
+    catch (invalid_argument &e) {
+      SPDLOG_TRACE("No native body coverage for {}: {}", kpath, e.what());
     }
-    return new_json.dump();
+    return json::object().dump();
   }
 
 
+  vector<pair<double, double>> getTimeIntervals(string kpath, string ckLevel, double ckTolerance) {
+    // SPKs and CKs are read natively, without furnishing them
+    optional<DafSummaries> daf;
+    try {
+      daf = readDafSummaries(kpath);
+    }
+    catch (invalid_argument &e) {
+      SPDLOG_TRACE("Falling back to CSPICE for {} coverage: {}", kpath, e.what());
+    }
 
-  string getDataDirectory() {
-      char* isisdata_ptr = getenv("ISISDATA");
-      fs::path isisDataDir = isisdata_ptr == NULL ? "" : isisdata_ptr;
+    if (daf && (daf->type == "SPK" || daf->type == "CK")) {
+      return dafCoverageToTimeIntervals(kpath, daf->type, getDafCoverage(*daf), ckLevel, ckTolerance);
+    }
 
-      char* alespice_ptr = getenv("ALESPICEROOT");
-      fs::path aleDataDir = alespice_ptr == NULL ? "" : alespice_ptr;
-      
-      char* spiceroot_ptr = getenv("SPICEROOT");
-      fs::path spiceDataDir = spiceroot_ptr == NULL ? "" : spiceroot_ptr;
- 
-      if (fs::is_directory(spiceDataDir)) {
-         return spiceDataDir;
-      }
+    string headerType = getKernelTypeFromHeader(kpath);
+    if (headerType == "TEXT" || headerType == "META") {
+      throw invalid_argument("Input Kernel is a text kernel which has no intervals");
+    }
 
-      if (fs::is_directory(aleDataDir)) {
-        return aleDataDir;
-      }
+    // anything else is furnished and read through CSPICE on the SPICE executor
+    return runOnSpiceExecutor([&]() -> vector<pair<double, double>> {
+      auto formatIntervals = [&](SpiceCell &coverage) -> vector<pair<double, double>> {
+        //Get the number of intervals in the object.
+        checkNaifErrors();
 
-      if (fs::is_directory(isisDataDir)) {
-        return isisDataDir;
-      }
-      throw runtime_error(fmt::format("Please set env var SPICEROOT, ISISDATA or ALESPICEROOT in order to proceed."));
+        int niv = card_c(&coverage) / 2;
+        //Convert the coverage interval start and stop times to TDB
+        SpiceDouble begin, end;
+
+        vector<pair<double, double>> res;
+
+        for(int j = 0;  j < niv;  j++) {
+          //Get the endpoints of the jth interval.
+          wnfetd_c(&coverage, j, &begin, &end);
+          checkNaifErrors();
+          pair<double, double> p = {begin, end};
+          res.emplace_back(p);
+        }
+
+        return res;
+      };
+
+
+      SpiceChar fileType[32], source[2048];
+      SpiceInt handle;
+      SpiceBoolean found;
+
+      Kernel k(kpath);
+
+      checkNaifErrors();
+      kinfo_c(kpath.c_str(), 32, 2048, fileType, source, &handle, &found);
+      checkNaifErrors();
+
+      string currFile = fileType;
+
+      //create a spice cell capable of containing all the objects in the kernel.
+      SPICEINT_CELL(currCell, 100);
+
+      //this resizing is done because otherwise a spice cell will append new data
+      //to the last "currCell"
+      ssize_c(0, &currCell);
+      ssize_c(100, &currCell);
+
+      SPICEDOUBLE_CELL(cover, 100);
+
+      if (currFile == "SPK") {
+        spkobj_c(kpath.c_str(), &currCell);
+      }
+      else if (currFile == "CK") {
+        ckobj_c(kpath.c_str(), &currCell);
+      }
+      else if (currFile == "TEXT") {
+        throw invalid_argument("Input Kernel is a text kernel which has no intervals");
+      }
+      checkNaifErrors();
+
+      vector<pair<double, double>> result;
+
+      for(int bodyCount = 0 ; bodyCount < card_c(&currCell) ; bodyCount++) {
+        //get the NAIF body code
+        int body = SPICE_CELL_ELEM_I(&currCell, bodyCount);
+
+        //only provide coverage for negative NAIF codes
+        //(Positive codes indicate planetary bodies, negatives indicate
+        // spacecraft and instruments)
+        checkNaifErrors();
+        if (body < 0) {
+          vector<pair<double, double>> times;
+          //find the correct coverage window
+          if(currFile == "SPK") {
+            SPICEDOUBLE_CELL(cover, 1000);
+            ssize_c(0, &cover);
+            ssize_c(1000, &cover);
+            spkcov_c(kpath.c_str(), body, &cover);
+            times = formatIntervals(cover);
+          }
+          else if(currFile == "CK") {
+            //  200,000 is the max coverage window size for a CK kernel
+            SPICEDOUBLE_CELL(cover, 200000);
+            ssize_c(0, &cover);
+            ssize_c(200000, &cover);
+
+            // A SPICE SEGMENT is composed of SPICE INTERVALS
+            ckcov_c(kpath.c_str(), body, SPICEFALSE, ckLevel.c_str(), ckTolerance, "TDB", &cover);
+
+            times = formatIntervals(cover);
+          }
+          checkNaifErrors();
+
+          result.reserve(result.size() + distance(times.begin(), times.end()));
+          result.insert(result.end(), times.begin(), times.end());
+
+        }
+      }
+      return result;
+    });
+  }
+
+
+  optional<pair<double, double>> getFilenameDateRange(string kpath, json dateExtractors) {
+    return getFilenameDateRange(kpath, compileDateExtractors(dateExtractors));
+  }
+
+
+  vector<FilenameDateExtractor> compileDateExtractors(json dateExtractors) {
+    // day precision dates plus ~69 seconds of TDB - UTC
+    const double defaultMargin = 2 * 86400;
+
+    vector<FilenameDateExtractor> compiled;
+    for (auto &extractor : dateExtractors) {
+      if (!extractor.contains("regex") || !extractor.contains("format")) {
+        continue;
+      }
+      compiled.push_back({regex(extractor["regex"].get<string>()), extractor["format"].get<string>(), extractor.value("margin", defaultMargin)});
+    }
+    return compiled;
+  }
+
+
+  optional<pair<double, double>> getFilenameDateRange(string kpath, const vector<FilenameDateExtractor> &dateExtractors) {
+    string filename = fs::path(kpath).filename();
+
+    // days since 1970-01-01 of a proleptic Gregorian date
+    auto daysFromCivil = [](long y, unsigned m, unsigned d) -> long {
+      y -= m <= 2;
+      const long era = (y >= 0 ? y : y - 399) / 400;
+      const unsigned yoe = static_cast<unsigned>(y - era * 400);
+      const unsigned doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+      const unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+      return era * 146097 + static_cast<long>(doe) - 719468;
+    };
+
+    // parses fixed width %Y, %y, %j, %m, %d, %H, %M and %S fields, other characters have to match exactly
+    auto toEt = [&](string date, string format) -> optional<double> {
+      const map<char, size_t> widths = {{'Y', 4}, {'y', 2}, {'j', 3}, {'m', 2}, {'d', 2}, {'H', 2}, {'M', 2}, {'S', 2}};
+      map<char, long> fields = {{'m', 1}, {'d', 1}};
+      size_t pos = 0;
+
+      for (size_t i = 0; i < format.size(); i++) {
+        if (format[i] != '%' || i + 1 == format.size()) {
+          if (pos >= date.size() || date[pos++] != format[i]) {
+            return nullopt;
+          }
+          continue;
+        }
+
+        char field = format[++i];
+        auto width = widths.find(field);
+        if (width == widths.end() || pos + width->second > date.size()) {
+          return nullopt;
+        }
+
+        string digits = date.substr(pos, width->second);
+        if (!all_of(digits.begin(), digits.end(), ::isdigit)) {
+          return nullopt;
+        }
+        fields[field] = stol(digits);
+        pos += width->second;
+      }
+
+      if (pos != date.size() || (!fields.count('Y') && !fields.count('y'))) {
+        return nullopt;
+      }
+
+      // two digit years follow POSIX, 69-99 are 19xx and 00-68 are 20xx
+      long year = fields.count('Y') ? fields['Y'] : fields['y'] + (fields['y'] < 69 ? 2000 : 1900);
+      long days = fields.count('j') ? daysFromCivil(year, 1, 1) + fields['j'] - 1
+                                    : daysFromCivil(year, fields['m'], fields['d']);
+      days -= daysFromCivil(2000, 1, 1);
+
+      return days * 86400.0 - 43200.0 + fields['H'] * 3600.0 + fields['M'] * 60.0 + fields['S'];
+    };
+
+    for (auto &extractor : dateExtractors) {
+      smatch match;
+      if (!regex_search(filename, match, extractor.regex) || match.size() < 3) {
+        continue;
+      }
+
+      const string &format = extractor.format;
+      optional<double> start = toEt(match[1].str(), format);
+      optional<double> stop = toEt(match[2].str(), format);
+      if (!start || !stop) {
+        SPDLOG_DEBUG("Could not parse dates from {} with format {}", filename, format);
+        continue;
+      }
+
+      SPDLOG_TRACE("File name dates for {}: {} to {}", filename, *start, *stop);
+      return make_pair(*start - extractor.margin, *stop + extractor.margin);
+    }
+
+    return nullopt;
+  }
+
+
+  void parallelForEach(size_t count, unsigned int threads, function<void(size_t)> task) {
+    if (threads == 0) {
+      threads = max(1u, thread::hardware_concurrency());
+    }
+    threads = static_cast<unsigned int>(min<size_t>(threads, count));
+
+    if (threads <= 1) {
+      for (size_t i = 0; i < count; i++) {
+        task(i);
+      }
+      return;
+    }
+
+    // deal the work round robin so every queue starts with some of the most expensive tasks
+    vector<deque<size_t>> queues(threads);
+    vector<mutex> locks(threads);
+    for (size_t i = 0; i < count; i++) {
+      queues[i % threads].push_back(i);
+    }
+
+    exception_ptr firstError = nullptr;
+    mutex errorLock;
+
+    auto worker = [&](unsigned int id) {
+      while (true) {
+        optional<size_t> next;
+
+        {
+          lock_guard<mutex> lock(locks[id]);
+          if (!queues[id].empty()) {
+            next = queues[id].front();
+            queues[id].pop_front();
+          }
+        }
+
+        // own queue is empty, steal the cheapest task from another thread
+        for (unsigned int offset = 1; !next && offset < threads; offset++) {
+          unsigned int victim = (id + offset) % threads;
+          lock_guard<mutex> lock(locks[victim]);
+          if (!queues[victim].empty()) {
+            next = queues[victim].back();
+            queues[victim].pop_back();
+          }
+        }
+
+        // no work is ever added, so once every queue is empty we are done
+        if (!next) {
+          return;
+        }
+
+        try {
+          task(*next);
+        }
+        catch (...) {
+          lock_guard<mutex> lock(errorLock);
+          if (!firstError) {
+            firstError = current_exception();
+          }
+        }
+      }
+    };
+
+    vector<thread> pool;
+    for (unsigned int id = 0; id < threads; id++) {
+      pool.emplace_back(worker, id);
+    }
+    for (auto &t : pool) {
+      t.join();
+    }
+
+    if (firstError) {
+      rethrow_exception(firstError);
+    }
+  }
+
+
+  string getCoverageHash(string coverage) {
+    return fmt::format("{:016x}", hash<string>{}(coverage));
+  }
+
+
+  static fs::path getCoverageStorePath(const string &mission) {
+    return fs::path(Memo::getCacheDir()) / ("spiceql_coverage_" + mission + ".json");
+  }
+
+
+  static optional<json> getCoverageIdentity(const string &kernel, const string &ckLevel, double ckTolerance) {
+    struct stat info;
+    if (stat(kernel.c_str(), &info) != 0) {
+      return nullopt;
+    }
+
+    // the CK coverage level is part of the identity, so changing it re-reads the kernels
+    return json({
+      {"size", static_cast<uintmax_t>(info.st_size)},
+      {"mtime", static_cast<int64_t>(fs::last_write_time(kernel).time_since_epoch().count())},
+      {"inode", static_cast<uintmax_t>(info.st_ino)},
+      {"ckLevel", ckLevel},
+      {"ckTolerance", ckTolerance}
+    });
+  }
+
+
+  static bool isCoverageCurrent(const json &entry, const json &identity) {
+    if (!entry.is_object() || !entry.contains("intervals") || !entry.contains("bodies")) {
+      return false;
+    }
+    for (auto &[key, value] : identity.items()) {
+      if (entry.value(key, json()) != value) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+
+  json getStoredBodyCoverage(string mission, vector<string> kernels) {
+    static mutex storesLock;
+    static map<string, pair<fs::file_time_type, shared_ptr<const json>>> stores;
+
+    fs::path storePath = getCoverageStorePath(mission);
+    error_code ec;
+    fs::file_time_type storeTime = fs::last_write_time(storePath, ec);
+    if (ec) {
+      return json::object();
+    }
+
+    // the store is only parsed again when globTimeIntervals has replaced it
+    shared_ptr<const json> store;
+    {
+      lock_guard<mutex> lock(storesLock);
+      auto cached = stores.find(storePath.string());
+      if (cached != stores.end() && cached->second.first == storeTime) {
+        store = cached->second.second;
+      }
+    }
+
+    if (!store) {
+      try {
+        ifstream ifs(storePath);
+        store = make_shared<const json>(json::parse(ifs));
+      }
+      catch (json::exception &e) {
+        SPDLOG_WARN("Unable to read coverage store {}: {}", storePath.string(), e.what());
+        return json::object();
+      }
+      lock_guard<mutex> lock(storesLock);
+      stores[storePath.string()] = {storeTime, store};
+    }
+
+    string ckLevel = getCkCoverageLevel();
+    double ckTolerance = getCkCoverageTolerance();
+    json res = json::object();
+    for (auto &kernel : kernels) {
+      auto entry = store->find(kernel);
+      if (res.contains(kernel) || entry == store->end()) {
+        continue;
+      }
+
+      optional<json> identity = getCoverageIdentity(kernel, ckLevel, ckTolerance);
+      if (identity && isCoverageCurrent(*entry, *identity)) {
+        res[kernel] = (*entry)["bodies"];
+      }
+    }
+
+    SPDLOG_TRACE("Stored body coverage for {} of {} kernels", res.size(), kernels.size());
+    return res;
+  }
+
+
+  json updateTimeIntervals(json store, vector<string> kernels, unsigned int threads, function<void(size_t, size_t)> progress) {
+    json newStore = json::object();
+    string ckLevel = getCkCoverageLevel();
+    double ckTolerance = getCkCoverageTolerance();
+    vector<string> toRead;
+    vector<json> identities;
+    vector<uintmax_t> sizes;
+    size_t reused = 0;
+
+    for (auto &kernel : kernels) {
+      if (newStore.contains(kernel)) {
+        continue;
+      }
+
+      optional<json> kernelIdentity = getCoverageIdentity(kernel, ckLevel, ckTolerance);
+      if (!kernelIdentity) {
+        SPDLOG_WARN("Unable to stat {}, skipping its coverage", kernel);
+        continue;
+      }
+      json identity = *kernelIdentity;
+
+      if (store.contains(kernel) && isCoverageCurrent(store[kernel], identity)) {
+        newStore[kernel] = store[kernel];
+        reused++;
+        continue;
+      }
+
+      // placeholder so duplicates in the kernel list are only read once
+      newStore[kernel] = nullptr;
+      toRead.push_back(kernel);
+      identities.push_back(identity);
+      sizes.push_back(identity["size"].get<uintmax_t>());
+    }
+
+    // largest kernels first so they don't end up alone at the end of the run
+    vector<size_t> order(toRead.size());
+    iota(order.begin(), order.end(), 0);
+    stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return sizes[a] > sizes[b]; });
+
+    if (threads == 0) {
+      threads = static_cast<unsigned int>(min<size_t>(getEnvUnsigned("SPICEQL_COVERAGE_THREADS", 0), numeric_limits<unsigned int>::max()));
+    }
+
+    // the worker threads can't hand CSPICE work back to the executor while it waits on them
+    if (SpiceExecutor::getInstance().isExecutorThread()) {
+      threads = 1;
+    }
+
+    // every kernel is read start to finish on a worker, SPKs and CK segment bounds come from
+    // the native DAF reader and only the CSPICE calls (CK clock conversion, ckcov_c and non-DAF
+    // kernels) are serialized, on the executor when it is on
+    vector<json> results(toRead.size());
+    mutex spiceLock;
+    size_t done = 0;
+    mutex progressLock;
+
+    parallelForEach(order.size(), threads, [&](size_t i) {
+      size_t k = order[i];
+      SPDLOG_TRACE("Reading coverage for new or changed kernel {}", toRead[k]);
+      json identity = identities[k];
+
+      optional<DafSummaries> daf;
+      try {
+        daf = readDafSummaries(toRead[k]);
+      }
+      catch (invalid_argument &e) {
+        SPDLOG_TRACE("{} will be read with CSPICE: {}", toRead[k], e.what());
+      }
+
+      if (daf && daf->type == "SPK") {
+        identity["bodies"] = dafBodyCoverage(toRead[k], *daf, ckLevel, ckTolerance);
+      }
+      else if (daf && daf->type == "CK") {
+        lock_guard<mutex> lock(spiceLock);
+        identity["bodies"] = dafBodyCoverage(toRead[k], *daf, ckLevel, ckTolerance);
+      }
+
+      if (daf && (daf->type == "SPK" || daf->type == "CK")) {
+        // same as dafCoverageToTimeIntervals, without converting CK times a second time
+        vector<pair<double, double>> intervals;
+        for (auto &[body, segments] : getDafCoverage(*daf)) {
+          if (body < 0) {
+            vector<pair<double, double>> times = identity["bodies"][to_string(body)]["intervals"];
+            intervals.insert(intervals.end(), times.begin(), times.end());
+          }
+        }
+        identity["intervals"] = intervals;
+      }
+      else {
+        lock_guard<mutex> lock(spiceLock);
+        identity["intervals"] = getTimeIntervals(toRead[k], ckLevel, ckTolerance);
+        identity["bodies"] = json::object();
+      }
+      results[k] = identity;
+
+      if (progress) {
+        lock_guard<mutex> lock(progressLock);
+        progress(++done, toRead.size());
+      }
+    });
+
+    for (size_t k = 0; k < toRead.size(); k++) {
+      newStore[toRead[k]] = results[k];
+    }
+
+    SPDLOG_DEBUG("Coverage store: {} kernels reused, {} read, {} replaced or dropped", reused, toRead.size(), store.size() - reused);
+    return newStore;
+  }
+
+
+  string globTimeIntervals(string mission) { 
+    SPDLOG_TRACE("In globTimeIntervals.");
+    Config conf;
+    conf = conf[mission];
+    json sclk_json = getLatestKernels(conf.get("sclk"));
+    KernelSet sclks(sclk_json);
+
+    // Get CK and SPK kernels
+    vector<string> kernels;
+    map<string, json> kernelJsons;
+    for (string kernelType : {"ck", "spk"}) {
+      json kernelJson = conf.getRecursive(kernelType);
+      kernelJsons[kernelType] = kernelJson;
+      for (auto &kernelGrp : findKeyInJson(kernelJson, "kernels")) {
+        for (auto &subList : json2DArrayTo2DVector(kernelJson[kernelGrp])) {
+          kernels.insert(kernels.end(), subList.begin(), subList.end());
+        }
+      }
+    }
+
+    // only kernels that changed since the last refresh get read
+    fs::path storePath = getCoverageStorePath(mission);
+    json store = json::object();
+    if (fs::exists(storePath)) {
+      try {
+        ifstream ifs(storePath);
+        store = json::parse(ifs);
+      }
+      catch (json::exception &e) {
+        SPDLOG_WARN("Unable to read coverage store {}, rebuilding it: {}", storePath.string(), e.what());
+        store = json::object();
+      }
+    }
+
+    store = updateTimeIntervals(store, kernels);
+
+    // write to a temp file and rename so readers never see a partial file
+    auto writeJson = [](fs::path path, json &j) {
+      fs::path tempPath = path;
+      tempPath += "." + gen_random(10);
+      {
+        ofstream ofs(tempPath);
+        ofs << j.dump();
+      }
+      fs::rename(tempPath, path);
+    };
+    writeJson(storePath, store);
+
+    json new_json = json::object();
+    for (auto &[kernel, entry] : store.items()) {
+      new_json[kernel] = entry["intervals"];
+    }
+    string coverage = new_json.dump();
+
+    // timelines for the top level groups, one per quality with its fallbacks. Qualities
+    // the mission doesn't have still get an empty timeline so lookups don't rebuild them
+    string coverageHash = getCoverageHash(coverage);
+    for (auto &[kernelType, kernelJson] : kernelJsons) {
+      json group = kernelJson.contains(kernelType) ? kernelJson[kernelType] : json::object();
+      for (auto &qual : Kernel::QUALITIES) {
+        vector<string> fallbacks = getQualityFallbacks(qual);
+        if (fallbacks.empty()) {
+          continue;
+        }
+        json timeline = buildKernelTimeline(group, new_json, fallbacks);
+        timeline["coverageHash"] = coverageHash;
+        writeJson(fs::path(Memo::getCacheDir()) / fmt::format("spiceql_timeline_{}_{}_{}.json", mission, kernelType, qual), timeline);
+      }
+    }
+
+    return coverage;
+  }
+
+
+
+  string getDataDirectory() {
+      char* isisdata_ptr = getenv("ISISDATA");
+      fs::path isisDataDir = isisdata_ptr == NULL ? "" : isisdata_ptr;
+
+      char* alespice_ptr = getenv("ALESPICEROOT");
+      fs::path aleDataDir = alespice_ptr == NULL ? "" : alespice_ptr;
+      
+      char* spiceroot_ptr = getenv("SPICEROOT");
+      fs::path spiceDataDir = spiceroot_ptr == NULL ? "" : spiceroot_ptr;
+ 
+      if (fs::is_directory(spiceDataDir)) {
+         return spiceDataDir;
+      }
+
+      if (fs::is_directory(aleDataDir)) {
+        return aleDataDir;
+      }
+
+      if (fs::is_directory(isisDataDir)) {
+        return isisDataDir;
+      }
+      throw runtime_error(fmt::format("Please set env var SPICEROOT, ISISDATA or ALESPICEROOT in order to proceed."));
   }
 
 
@@ -1072,6 +1788,342 @@ namespace SpiceQL {
   }  
 
 
+  bool getEnvBool(string var, bool defaultValue) {
+    const char* env_value = getenv(var.c_str());
+    if (env_value == NULL) {
+      return defaultValue;
+    }
+
+    string value = toLower(string(env_value));
+    bool res = defaultValue;
+    istringstream iss(value);
+    if (all_of(value.begin(), value.end(), ::isdigit) && !value.empty()) {
+      res = value.find_first_not_of('0') != string::npos;
+    }
+    else if (!(iss >> boolalpha >> res)) {
+      res = defaultValue;
+    }
+
+    SPDLOG_TRACE("${} = {}", var, res);
+    return res;
+  }
+
+
+  size_t getEnvUnsigned(string var, size_t defaultValue) {
+    const char* env_value = getenv(var.c_str());
+    if (env_value == NULL) {
+      return defaultValue;
+    }
+
+    // stoull would take "-1" as the largest value and ignore trailing characters, only plain digits are accepted
+    string value = env_value;
+    if (!value.empty() && all_of(value.begin(), value.end(), ::isdigit)) {
+      try {
+        size_t res = stoull(value);
+        SPDLOG_TRACE("${} = {}", var, res);
+        return res;
+      }
+      catch (out_of_range &e) { }
+    }
+
+    SPDLOG_WARN("Invalid ${} {}, using {}", var, value, defaultValue);
+    return defaultValue;
+  }
+
+
+  string getCkCoverageLevel() {
+    const char* env_value = getenv("SPICEQL_CK_COVERAGE_LEVEL");
+    if (env_value == NULL) {
+      return "SEGMENT";
+    }
+
+    string level = toUpper(string(env_value));
+    if (level != "SEGMENT" && level != "INTERVAL") {
+      SPDLOG_WARN("Invalid $SPICEQL_CK_COVERAGE_LEVEL {}, using SEGMENT", env_value);
+      return "SEGMENT";
+    }
+    return level;
+  }
+
+
+  double getCkCoverageTolerance() {
+    const char* env_value = getenv("SPICEQL_CK_COVERAGE_TOLERANCE");
+    if (env_value == NULL) {
+      return 0;
+    }
+
+    try {
+      return max(0.0, stod(env_value));
+    }
+    catch (exception &e) {
+      SPDLOG_WARN("Invalid $SPICEQL_CK_COVERAGE_TOLERANCE {}, using 0", env_value);
+      return 0;
+    }
+  }
+
+
+  size_t getMetaKernelThreshold() {
+    return getEnvUnsigned("SPICEQL_META_KERNEL_THRESHOLD", 0);
+  }
+
+
+  string writeMetaKernel(vector<string> kernels, string dir) {
+    // kernel pool strings are at most 80 characters, longer paths are continued with +
+    const size_t maxChunk = 78;
+
+    stringstream body;
+    for (auto &kernel : kernels) {
+      // quotes are escaped by doubling them, an escaped quote is never split
+      vector<string> chunks = {""};
+      for (char c : fs::absolute(kernel).string()) {
+        string escaped = c == '\'' ? "''" : string(1, c);
+        if (chunks.back().size() + escaped.size() > maxChunk) {
+          chunks.push_back("");
+        }
+        chunks.back() += escaped;
+      }
+
+      for (size_t i = 0; i < chunks.size(); i++) {
+        body << "  '" << chunks[i] << (i + 1 < chunks.size() ? "+'" : "'") << "\n";
+      }
+    }
+
+    string content = "KPL/MK\n\nWritten by SpiceQL\n\n\\begindata\n\nKERNELS_TO_LOAD = (\n" + body.str() + ")\n\n\\begintext\n";
+    fs::path path = fs::path(dir) / fmt::format("spiceql_{:016x}.tm", hash<string>{}(content));
+
+    if (!fs::exists(path)) {
+      fs::create_directories(dir);
+      fs::path tempPath = path;
+      tempPath += "." + gen_random(10);
+      {
+        ofstream ofs(tempPath);
+        ofs << content;
+      }
+      fs::rename(tempPath, path);
+      SPDLOG_DEBUG("Wrote meta-kernel {} for {} kernels", path.string(), kernels.size());
+    }
+    else {
+      // pruning removes the least recently used meta-kernels first
+      error_code ec;
+      fs::last_write_time(path, fs::file_time_type::clock::now(), ec);
+    }
+
+    return path.string();
+  }
+
+
+  size_t getMetaKernelLimit() {
+    return getEnvUnsigned("SPICEQL_META_KERNEL_LIMIT", 256);
+  }
+
+
+  size_t pruneMetaKernels(string dir, size_t maxKernels, vector<string> keep) {
+    if (maxKernels == 0) {
+      return 0;
+    }
+
+    set<fs::path> kept;
+    for (auto &k : keep) {
+      kept.insert(fs::absolute(k));
+    }
+
+    error_code ec;
+    vector<pair<fs::file_time_type, fs::path>> metaKernels;
+    for (auto &entry : fs::directory_iterator(dir, ec)) {
+      string name = entry.path().filename().string();
+      if (name.rfind("spiceql_", 0) != 0 || entry.path().extension() != ".tm") {
+        continue;
+      }
+      fs::file_time_type mtime = fs::last_write_time(entry.path(), ec);
+      if (!ec) {
+        metaKernels.emplace_back(mtime, fs::absolute(entry.path()));
+      }
+    }
+
+    if (metaKernels.size() <= maxKernels) {
+      return 0;
+    }
+
+    // other processes sharing the directory may have just written a meta-kernel and not furnished it yet
+    const auto gracePeriod = chrono::seconds(60);
+    fs::file_time_type graceStart = fs::file_time_type::clock::now() - gracePeriod;
+
+    // newest first, everything after the first maxKernels goes
+    sort(metaKernels.begin(), metaKernels.end(), [](auto &a, auto &b) { return a.first > b.first; });
+    size_t removed = 0;
+    for (size_t i = maxKernels; i < metaKernels.size(); i++) {
+      auto &[mtime, path] = metaKernels[i];
+      if (kept.count(path) || mtime > graceStart) {
+        continue;
+      }
+
+      // KernelPool holds a shared lock on furnished meta-kernels, in any process
+      int fd = open(path.c_str(), O_RDONLY);
+      if (fd < 0) {
+        continue;
+      }
+      if (flock(fd, LOCK_EX | LOCK_NB) == 0 && fs::remove(path, ec)) {
+        removed++;
+      }
+      close(fd);
+    }
+
+    SPDLOG_DEBUG("Removed {} of {} meta-kernels in {}", removed, metaKernels.size(), dir);
+    return removed;
+  }
+
+
+  unsigned int getPrefetchThreads() {
+    return static_cast<unsigned int>(min<size_t>(getEnvUnsigned("SPICEQL_PREFETCH_THREADS", 0), numeric_limits<unsigned int>::max()));
+  }
+
+
+  //! kernels waiting for the background prefetch threads
+  struct PrefetchQueue {
+    mutex lock;
+    //! signaled when kernels are queued
+    condition_variable ready;
+    //! signaled when a kernel has been advised
+    condition_variable done;
+    deque<string> pending;
+    //! kernels that are pending or being advised
+    unordered_set<string> queued;
+    unsigned int threads = 0;
+  };
+
+  //! async prefetches past this many waiting kernels are dropped, prefetching is only advice
+  static const size_t PREFETCH_QUEUE_LIMIT = 4096;
+
+  //! guards creating the prefetch queue, held over forks by the fork hooks
+  static mutex prefetchGuard;
+  static PrefetchQueue *prefetchQueue = nullptr;
+  static pid_t prefetchOwner = 0;
+
+
+  /**
+   * Open a kernel and ask the OS to read it, the advice only starts the reads, it doesn't wait for them.
+   */
+  static void adviseKernel(const string &kernel) {
+    int fd = open(kernel.c_str(), O_RDONLY);
+    if (fd < 0) {
+      return;
+    }
+
+#if defined(POSIX_FADV_WILLNEED)
+    posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+#elif defined(F_RDADVISE)
+    struct stat st;
+    if (fstat(fd, &st) == 0) {
+      struct radvisory advice;
+      advice.ra_offset = 0;
+      advice.ra_count = static_cast<int>(min<off_t>(st.st_size, numeric_limits<int>::max()));
+      fcntl(fd, F_RDADVISE, &advice);
+    }
+#endif
+    close(fd);
+  }
+
+
+  /**
+   * Get the prefetch queue with at least the given number of threads working through it.
+   */
+  static PrefetchQueue *getPrefetchQueue(unsigned int threads) {
+    lock_guard<mutex> guard(prefetchGuard);
+    // the prefetch threads don't survive a fork, a child starts its own. The parent's queue is
+    // leaked, one of its threads may have held its lock when the process forked
+    if (prefetchOwner != getpid()) {
+      prefetchQueue = nullptr;
+    }
+    if (prefetchQueue == nullptr) {
+      prefetchQueue = new PrefetchQueue();
+      prefetchOwner = getpid();
+    }
+
+    PrefetchQueue *queue = prefetchQueue;
+    lock_guard<mutex> lock(queue->lock);
+    for (; queue->threads < threads; queue->threads++) {
+      thread([queue]() {
+        unique_lock<mutex> lock(queue->lock);
+        while (true) {
+          queue->ready.wait(lock, [&]() { return !queue->pending.empty(); });
+          string kernel = queue->pending.front();
+          queue->pending.pop_front();
+
+          lock.unlock();
+          adviseKernel(kernel);
+          lock.lock();
+
+          queue->queued.erase(kernel);
+          queue->done.notify_all();
+        }
+      }).detach();
+    }
+    return queue;
+  }
+
+
+  void pausePrefetchForFork() {
+    prefetchGuard.lock();
+  }
+
+
+  void resumePrefetchAfterFork() {
+    prefetchGuard.unlock();
+  }
+
+
+  void resetPrefetchAfterFork() {
+    prefetchQueue = nullptr;
+    prefetchOwner = getpid();
+    prefetchGuard.unlock();
+  }
+
+
+  void prefetchKernels(vector<string> kernels, unsigned int threads, bool async) {
+    if (kernels.empty()) {
+      return;
+    }
+
+    // every caller shares the same threads, so callers never add threads of their own
+    PrefetchQueue *queue = getPrefetchQueue(threads == 0 ? max(1u, thread::hardware_concurrency()) : threads);
+
+    unique_lock<mutex> lock(queue->lock);
+    if (async) {
+      for (auto &kernel : kernels) {
+        if (queue->pending.size() >= PREFETCH_QUEUE_LIMIT) {
+          SPDLOG_DEBUG("Prefetch queue is full, skipping the rest of {} kernels", kernels.size());
+          break;
+        }
+        if (queue->queued.insert(kernel).second) {
+          queue->pending.push_back(kernel);
+        }
+      }
+      lock.unlock();
+      queue->ready.notify_all();
+      return;
+    }
+
+    // the caller is about to read these, they go ahead of async requests in their order
+    for (auto it = kernels.rbegin(); it != kernels.rend(); it++) {
+      if (queue->queued.insert(*it).second) {
+        queue->pending.push_front(*it);
+      }
+      else {
+        auto pending = find(queue->pending.begin(), queue->pending.end(), *it);
+        if (pending != queue->pending.end()) {
+          queue->pending.erase(pending);
+          queue->pending.push_front(*it);
+        }
+      }
+    }
+    queue->ready.notify_all();
+
+    queue->done.wait(lock, [&]() {
+      return none_of(kernels.begin(), kernels.end(), [&](const string &kernel) { return queue->queued.count(kernel); });
+    });
+  }
+
+
   vector<string> getAvailableConfigFiles() {
     vector<string> confs; 
     fs::path dbDir = getConfigDirectory();
@@ -1174,22 +2226,75 @@ namespace SpiceQL {
   }
 
 
-  string getKernelType(string kernelPath) {
-    SpiceChar type[6];
-    SpiceChar source[6];
-    SpiceInt handle;
-    SpiceBoolean found;
+  string getKernelTypeFromHeader(string kernelPath) {
+    char idWord[8] = {};
+    ifstream ifs(kernelPath, ios::binary);
+    if (!ifs.read(idWord, sizeof(idWord))) {
+      return "";
+    }
 
-    Kernel k(kernelPath);
-    checkNaifErrors();
-    kinfo_c(kernelPath.c_str(), 6, 6, type, source, &handle, &found);
-    checkNaifErrors();
+    // ID words are "<architecture>/<type>" padded with blanks, e.g. "DAF/SPK ",
+    // text kernels usually end the line right after it
+    string id(idWord, sizeof(idWord));
+    id = id.substr(0, id.find_first_of(string(" \t\r\n\0", 5)));
 
-    if (!found) {
-      throw domain_error("Kernel Type not found");
+    size_t slash = id.find('/');
+    if (slash == string::npos) {
+      return "";
     }
 
-    return string(type);
+    string arch = id.substr(0, slash);
+    string type = id.substr(slash + 1);
+
+    if ((arch == "DAF" || arch == "DAS") && !type.empty()) {
+      return type;
+    }
+    if (arch == "KPL") {
+      return type == "MK" ? "META" : "TEXT";
+    }
+    return "";
+  }
+
+
+  map<string, string> getKernelTypes(string const & root, bool recursive) {
+    map<string, string> types;
+
+    for (auto &path : Memo::ls(root, recursive)) {
+      string type = getKernelTypeFromHeader(path);
+      if (!type.empty()) {
+        types[path] = type;
+      }
+    }
+
+    SPDLOG_DEBUG("Classified {} kernels in {}", types.size(), root);
+    return types;
+  }
+
+
+  string getKernelType(string kernelPath) {
+    string headerType = getKernelTypeFromHeader(kernelPath);
+    if (!headerType.empty()) {
+      return headerType;
+    }
+
+    return runOnSpiceExecutor([&]() -> string {
+      // old files without an ID word need CSPICE to tell
+      SpiceChar type[6];
+      SpiceChar source[6];
+      SpiceInt handle;
+      SpiceBoolean found;
+
+      Kernel k(kernelPath);
+      checkNaifErrors();
+      kinfo_c(kernelPath.c_str(), 6, 6, type, source, &handle, &found);
+      checkNaifErrors();
+
+      if (!found) {
+        throw domain_error("Kernel Type not found");
+      }
+
+      return string(type);
+    });
   }
 
 
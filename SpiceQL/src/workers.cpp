@@ -0,0 +1,487 @@
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <ctime>
+#include <functional>
+#include <map>
+#include <optional>
+#include <stdexcept>
+#include <thread>
+
+#include <semaphore.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <fmt/format.h>
+#include <spdlog/spdlog.h>
+
+#include "fork.h"
+#include "spice_types.h"
+#include "query.h"
+#include "utils.h"
+#include "workers.h"
+
+using json = nlohmann::json;
+using namespace std;
+
+namespace SpiceQL {
+
+  struct SpiceWorkerPool::Slot {
+    //! posted by the caller when a request is in the buffer
+    sem_t request;
+    //! posted by the worker when the result is in the buffer
+    sem_t response;
+    //! bytes used in the buffer
+    size_t size;
+  };
+
+
+  namespace {
+    // the slot header is padded so the buffer starts on a cache line
+    const size_t HEADER_BYTES = 128;
+
+    // points each worker gets on the hash ring, more points spread keys more evenly
+    const size_t RING_POINTS = 64;
+
+    /**
+     * A function workers can run, with the positions of the arguments used for routing.
+     * -1 if the function has no such argument.
+     */
+    struct Handler {
+      function<json(json &)> run;
+      int missionArg;
+      int timeArg;
+    };
+
+    // functions workers can run, arguments are positional
+    map<string, Handler> &getHandlers() {
+      static map<string, Handler> handlers = {
+        {"getTargetStates", {[](json &a) -> json {
+          return getTargetStates(a.at(0).get<vector<double>>(), a.at(1), a.at(2), a.at(3), a.at(4), a.at(5), a.at(6), a.at(7), a.at(8).get<bool>());
+        }, 5, 0}},
+        {"getTargetOrientations", {[](json &a) -> json {
+          return getTargetOrientations(a.at(0).get<vector<double>>(), a.at(1).get<int>(), a.at(2).get<int>(), a.at(3), a.at(4), a.at(5).get<bool>());
+        }, 3, 0}},
+        {"frameTrace", {[](json &a) -> json {
+          return frameTrace(a.at(0).get<double>(), a.at(1).get<int>(), a.at(2), a.at(3), a.at(4).get<bool>());
+        }, 2, 0}},
+        {"extractExactCkTimes", {[](json &a) -> json {
+          return extractExactCkTimes(a.at(0).get<double>(), a.at(1).get<double>(), a.at(2).get<int>(), a.at(3), a.at(4), a.at(5).get<bool>());
+        }, 3, 0}},
+        {"translateNameToCode", {[](json &a) -> json {
+          return translateNameToCode(a.at(0), a.at(1), a.at(2).get<bool>());
+        }, 1, -1}},
+        {"translateCodeToName", {[](json &a) -> json {
+          return translateCodeToName(a.at(0).get<int>(), a.at(1), a.at(2).get<bool>());
+        }, 1, -1}},
+        {"getFrameInfo", {[](json &a) -> json {
+          return getFrameInfo(a.at(0).get<int>(), a.at(1), a.at(2).get<bool>());
+        }, 1, -1}},
+        {"getTargetFrameInfo", {[](json &a) -> json {
+          return getTargetFrameInfo(a.at(0).get<int>(), a.at(1), a.at(2).get<bool>());
+        }, 1, -1}},
+        {"findMissionKeywords", {[](json &a) -> json {
+          return findMissionKeywords(a.at(0), a.at(1), a.at(2).get<bool>());
+        }, 1, -1}},
+        {"findTargetKeywords", {[](json &a) -> json {
+          return findTargetKeywords(a.at(0), a.at(1), a.at(2).get<bool>());
+        }, 1, -1}},
+        {"utcToEt", {[](json &a) -> json {
+          return utcToEt(a.at(0), a.at(1).get<bool>());
+        }, -1, -1}},
+        {"etToUtc", {[](json &a) -> json {
+          return etToUtc(a.at(0).get<double>(), a.at(1), a.at(2).get<double>(), a.at(3).get<bool>());
+        }, -1, -1}},
+        {"strSclkToEt", {[](json &a) -> json {
+          return strSclkToEt(a.at(0).get<int>(), a.at(1), a.at(2), a.at(3).get<bool>());
+        }, 2, -1}},
+        {"doubleSclkToEt", {[](json &a) -> json {
+          return doubleSclkToEt(a.at(0).get<int>(), a.at(1).get<double>(), a.at(2), a.at(3).get<bool>());
+        }, 2, -1}},
+        {"searchAndRefineKernels", {[](json &a) -> json {
+          return searchAndRefineKernels(a.at(0), a.at(1).get<vector<double>>(), a.at(2), a.at(3), a.at(4).get<vector<string>>());
+        }, 0, 1}}
+      };
+      return handlers;
+    }
+
+
+    char *slotBuffer(void *slot) {
+      return static_cast<char *>(slot) + HEADER_BYTES;
+    }
+
+
+    void waitSemaphore(sem_t *sem) {
+      while (sem_wait(sem) != 0) {
+        if (errno != EINTR) {
+          throw runtime_error(fmt::format("Unable to wait on worker semaphore: {}", strerror(errno)));
+        }
+      }
+    }
+
+
+    // true if the worker exited, reaping it. Exited workers can't be waited on if something else
+    // reaped them, e.g. with SIGCHLD ignored, so then the process is looked up instead
+    bool workerExited(pid_t pid) {
+      int status;
+      pid_t waited = waitpid(pid, &status, WNOHANG);
+      if (waited == pid) {
+        return true;
+      }
+      return waited == -1 && errno == ECHILD && kill(pid, 0) == -1 && errno == ESRCH;
+    }
+  }
+
+
+  SpiceWorkerPool::SpiceWorkerPool(size_t workers, size_t slotBytes) {
+    static_assert(sizeof(Slot) <= HEADER_BYTES, "worker slot header doesn't fit in its padding");
+
+    if (workers == 0) {
+      workers = getEnvUnsigned("SPICEQL_WORKERS", 0);
+    }
+    if (workers == 0) {
+      workers = max(1u, thread::hardware_concurrency());
+    }
+
+    if (slotBytes == 0) {
+      slotBytes = getEnvUnsigned("SPICEQL_WORKER_SLOT_BYTES", 0);
+    }
+    this->slotBytes = slotBytes != 0 ? slotBytes : 64 * 1024 * 1024;
+
+    const char *env_bucket = getenv("SPICEQL_WORKER_TIME_BUCKET");
+    try {
+      timeBucket = env_bucket != NULL ? stod(env_bucket) : timeBucket;
+    }
+    catch (exception &e) {
+      SPDLOG_WARN("Invalid $SPICEQL_WORKER_TIME_BUCKET {}, using {} seconds", env_bucket, timeBucket);
+    }
+    if (timeBucket <= 0) {
+      SPDLOG_WARN("$SPICEQL_WORKER_TIME_BUCKET has to be positive, using a day");
+      timeBucket = 86400;
+    }
+
+    try {
+      for (size_t i = 0; i < workers; i++) {
+        // anonymous shared mappings are inherited by the forked worker, pages are only used as they are written
+        void *mapped = mmap(NULL, HEADER_BYTES + this->slotBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        if (mapped == MAP_FAILED) {
+          throw runtime_error(fmt::format("Unable to map worker slot: {}", strerror(errno)));
+        }
+        slots.push_back(static_cast<Slot *>(mapped));
+        pids.push_back(0);
+        busy.push_back(false);
+        spawn(i);
+
+        for (size_t point = 0; point < RING_POINTS; point++) {
+          ring.emplace_back(hash<string>{}(fmt::format("worker-{}-{}", i, point)), i);
+        }
+      }
+    }
+    catch (...) {
+      // the destructor won't run for a pool that failed to start
+      stopWorkers();
+      throw;
+    }
+    sort(ring.begin(), ring.end());
+    idleCount = workers;
+
+    SPDLOG_DEBUG("Started {} SpiceQL workers with {} byte slots", workers, this->slotBytes);
+  }
+
+
+  SpiceWorkerPool::~SpiceWorkerPool() {
+    stopWorkers();
+  }
+
+
+  void SpiceWorkerPool::stopWorkers() {
+    for (size_t i = 0; i < slots.size(); i++) {
+      // an empty request tells the worker to exit
+      if (pids[i] > 0) {
+        slots[i]->size = 0;
+        sem_post(&slots[i]->request);
+      }
+    }
+
+    for (size_t i = 0; i < slots.size(); i++) {
+      // a slot whose fork failed has no worker to wait for
+      if (pids[i] > 0) {
+        waitpid(pids[i], NULL, 0);
+      }
+      sem_destroy(&slots[i]->request);
+      sem_destroy(&slots[i]->response);
+      munmap(slots[i], HEADER_BYTES + slotBytes);
+    }
+    slots.clear();
+    pids.clear();
+  }
+
+
+  void SpiceWorkerPool::spawn(size_t index) {
+    Slot *slot = slots[index];
+    sem_init(&slot->request, 1, 0);
+    sem_init(&slot->response, 1, 0);
+    slot->size = 0;
+
+    pid_t pid;
+    try {
+      pid = forkProcess();
+    }
+    catch (runtime_error &e) {
+      throw runtime_error(fmt::format("Unable to fork a SpiceQL worker: {}", e.what()));
+    }
+
+    if (pid == 0) {
+      // the worker has a copy of the caller's stack, an exception must not unwind into it
+      try {
+        serve(slot, slotBytes);
+      }
+      catch (exception &e) {
+        SPDLOG_ERROR("SpiceQL worker {} stopped: {}", getpid(), e.what());
+      }
+      catch (...) {
+        SPDLOG_ERROR("SpiceQL worker {} stopped", getpid());
+      }
+      _exit(1);
+    }
+
+    lock_guard<mutex> lock(idleLock);
+    pids[index] = pid;
+  }
+
+
+  void SpiceWorkerPool::respawn(size_t index) {
+    kill(pids[index], SIGKILL);
+    waitpid(pids[index], NULL, 0);
+    spawn(index);
+  }
+
+
+  void SpiceWorkerPool::serve(Slot *slot, size_t slotBytes) {
+    char *buffer = slotBuffer(slot);
+    const auto &handlers = getHandlers();
+
+    while (true) {
+      waitSemaphore(&slot->request);
+      if (slot->size == 0) {
+        _exit(0);
+      }
+
+      json response;
+      try {
+        json request = json::parse(buffer, buffer + slot->size);
+        auto handler = handlers.find(request.at("function").get<string>());
+        if (handler == handlers.end()) {
+          throw invalid_argument(fmt::format("{} is not a function SpiceQL workers can run", request["function"].get<string>()));
+        }
+        response["return"] = handler->second.run(request.at("args"));
+      }
+      catch (invalid_argument &e) {
+        response = {{"error", e.what()}, {"type", "invalid_argument"}};
+      }
+      catch (out_of_range &e) {
+        response = {{"error", e.what()}, {"type", "out_of_range"}};
+      }
+      catch (exception &e) {
+        response = {{"error", e.what()}, {"type", "runtime_error"}};
+      }
+
+      string result = response.dump();
+      if (result.size() > slotBytes) {
+        result = json({{"error", fmt::format("Result of {} bytes is larger than the {} byte worker slot", result.size(), slotBytes)},
+                       {"type", "runtime_error"}}).dump();
+      }
+      memcpy(buffer, result.data(), result.size());
+      slot->size = result.size();
+      sem_post(&slot->response);
+    }
+  }
+
+
+  json SpiceWorkerPool::call(string function, json args) {
+    auto handler = getHandlers().find(function);
+    if (handler == getHandlers().end()) {
+      throw invalid_argument(fmt::format("{} is not a function SpiceQL workers can run", function));
+    }
+
+    // requests for a mission are routed on the mission and the bucket of their first time
+    optional<size_t> affinity;
+    int missionArg = handler->second.missionArg;
+    if (missionArg >= 0 && args.is_array() && (int)args.size() > missionArg && args[missionArg].is_string() && args[missionArg] != "") {
+      int timeArg = handler->second.timeArg;
+      json time = timeArg >= 0 && (int)args.size() > timeArg ? args[timeArg] : json();
+      if (time.is_array()) {
+        time = time.empty() ? json() : time[0];
+      }
+      affinity = getAffinityKey(args[missionArg], time.is_number() ? optional<double>(time.get<double>()) : nullopt);
+    }
+
+    string request = json({{"function", function}, {"args", args}}).dump();
+    if (request.size() > slotBytes) {
+      throw invalid_argument(fmt::format("Request of {} bytes is larger than the {} byte worker slot", request.size(), slotBytes));
+    }
+
+    size_t index;
+    {
+      unique_lock<mutex> lock(idleLock);
+      idleReady.wait(lock, [&]() { return idleCount > 0; });
+
+      // the key's owner if it is idle, otherwise spill over to the next idle worker on the ring,
+      // so a busy key keeps going to the same few workers
+      size_t point = affinity ? ringPosition(*affinity) : nextStart++ % ring.size();
+      while (busy[ring[point].second]) {
+        point = (point + 1) % ring.size();
+      }
+      index = ring[point].second;
+      busy[index] = true;
+      idleCount--;
+    }
+
+    auto release = [&]() {
+      {
+        lock_guard<mutex> lock(idleLock);
+        busy[index] = false;
+        idleCount++;
+      }
+      idleReady.notify_one();
+    };
+
+    Slot *slot = slots[index];
+    memcpy(slotBuffer(slot), request.data(), request.size());
+    slot->size = request.size();
+    sem_post(&slot->request);
+
+    // check on the worker while waiting, so a crash doesn't hang the caller
+    while (true) {
+      timespec deadline;
+      clock_gettime(CLOCK_REALTIME, &deadline);
+      deadline.tv_nsec += 100000000;
+      if (deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec += 1;
+        deadline.tv_nsec -= 1000000000;
+      }
+
+      if (sem_timedwait(&slot->response, &deadline) == 0) {
+        break;
+      }
+      if (errno != ETIMEDOUT && errno != EINTR) {
+        // the worker could still write its result into the slot, the next call gets a fresh one
+        string error = strerror(errno);
+        SPDLOG_WARN("Unable to wait on SpiceQL worker {} running {}, starting a new one: {}", pids[index], function, error);
+        respawn(index);
+        release();
+        throw runtime_error(fmt::format("Unable to wait on worker semaphore: {}", error));
+      }
+
+      if (workerExited(pids[index])) {
+        SPDLOG_WARN("SpiceQL worker {} died running {}, starting a new one", pids[index], function);
+        spawn(index);
+        release();
+        throw runtime_error(fmt::format("SpiceQL worker died running {}", function));
+      }
+    }
+
+    char *buffer = slotBuffer(slot);
+    json response = json::parse(buffer, buffer + slot->size);
+    release();
+
+    if (response.contains("error")) {
+      string error = response["error"];
+      string type = response.value("type", "runtime_error");
+      if (type == "invalid_argument") {
+        throw invalid_argument(error);
+      }
+      if (type == "out_of_range") {
+        throw out_of_range(error);
+      }
+      throw runtime_error(error);
+    }
+
+    return response["return"];
+  }
+
+
+  vector<string> SpiceWorkerPool::getFunctions() {
+    vector<string> functions;
+    for (auto &[name, handler] : getHandlers()) {
+      functions.push_back(name);
+    }
+    return functions;
+  }
+
+
+  size_t SpiceWorkerPool::size() {
+    return slots.size();
+  }
+
+
+  size_t SpiceWorkerPool::getAffinityKey(string mission, optional<double> et) {
+    string key = mission;
+    if (et) {
+      key += fmt::format("/{}", static_cast<long long>(floor(*et / timeBucket)));
+    }
+    return hash<string>{}(key);
+  }
+
+
+  size_t SpiceWorkerPool::ringPosition(size_t key) {
+    auto point = lower_bound(ring.begin(), ring.end(), make_pair(key, size_t(0)));
+    return point != ring.end() ? distance(ring.begin(), point) : 0;
+  }
+
+
+  size_t SpiceWorkerPool::getPreferredWorker(string mission, double et) {
+    return ring[ringPosition(getAffinityKey(mission, et))].second;
+  }
+
+
+  void SpiceWorkerPool::addHandler(string name, function<json(json &)> run, int missionArg, int timeArg) {
+    getHandlers()[name] = {run, missionArg, timeArg};
+  }
+
+
+  pid_t SpiceWorkerPool::getWorkerPid(size_t index) {
+    lock_guard<mutex> lock(idleLock);
+    return pids.at(index);
+  }
+
+
+  vector<vector<double>> SpiceWorkerPool::getTargetStates(vector<double> ets, string target, string observer, string frame, string abcorr,
+                                                          string mission, string ckQuality, string spkQuality, bool searchKernels) {
+    return call("getTargetStates", json::array({ets, target, observer, frame, abcorr, mission, ckQuality, spkQuality, searchKernels}));
+  }
+
+
+  vector<vector<double>> SpiceWorkerPool::getTargetOrientations(vector<double> ets, int toFrame, int refFrame, string mission,
+                                                                string ckQuality, bool searchKernels) {
+    return call("getTargetOrientations", json::array({ets, toFrame, refFrame, mission, ckQuality, searchKernels}));
+  }
+
+
+  vector<vector<int>> SpiceWorkerPool::frameTrace(double et, int initialFrame, string mission, string ckQuality, bool searchKernels) {
+    return call("frameTrace", json::array({et, initialFrame, mission, ckQuality, searchKernels}));
+  }
+
+
+  int SpiceWorkerPool::translateNameToCode(string frame, string mission, bool searchKernels) {
+    return call("translateNameToCode", json::array({frame, mission, searchKernels}));
+  }
+
+
+  string SpiceWorkerPool::translateCodeToName(int frame, string mission, bool searchKernels) {
+    return call("translateCodeToName", json::array({frame, mission, searchKernels}));
+  }
+
+
+  double SpiceWorkerPool::utcToEt(string utc, bool searchKernels) {
+    return call("utcToEt", json::array({utc, searchKernels}));
+  }
+
+
+  string SpiceWorkerPool::etToUtc(double et, string format, double precision, bool searchKernels) {
+    return call("etToUtc", json::array({et, format, precision, searchKernels}));
+  }
+}
@@ -233,6 +233,24 @@ TEST_F(TestConfig, FunctionalTestsSubsetConfigGetVector) {
   }
 }
 
+TEST_F(TestConfig, FunctionalTestsConfigGetKernelTypes) {
+  MockRepository mocks;
+  mocks.OnCallFunc(Memo::ls).Return(paths);
+
+  json resJson = testConfig.get("lroc", {"ck", "spk", "sclk"}, {{"spk", {"smithed"}}});
+  ASSERT_EQ(resJson.size(), 3);
+  EXPECT_FALSE(resJson.contains("fk"));
+  EXPECT_FALSE(resJson.contains("ik"));
+  EXPECT_FALSE(resJson.contains("tspk"));
+  EXPECT_TRUE(resJson["ck"]["reconstructed"]["kernels"].size() > 0);
+  EXPECT_TRUE(resJson["spk"]["smithed"]["kernels"].size() > 0);
+  EXPECT_FALSE(resJson["spk"].contains("reconstructed"));
+  EXPECT_TRUE(resJson["sclk"]["kernels"].size() > 0);
+
+  // the unevaluated config is left untouched
+  EXPECT_TRUE(testConfig["lroc"].contains("fk"));
+}
+
 TEST_F(TestConfig, FunctionalTestsConfigGetParentPointer) {
   MockRepository mocks;
   mocks.OnCallFunc(SpiceQL::getRootDependency).Return("");
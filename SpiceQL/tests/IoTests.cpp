@@ -1,7 +1,11 @@
 #include <gtest/gtest.h>
+#include <cstring>
+#include <fstream>
+#include <limits>
 #include <vector>
 
 #include "Fixtures.h"
+#include "daf.h"
 #include "io.h"
 #include "utils.h"
 
@@ -121,3 +125,89 @@ TEST(UnitTest, WriteTextKernelArrayAppend) {
   EXPECT_EQ(translateNameToCode("instrument3"), -90103);
 }
 
+
+
+TEST_F(LroKernelSet, UnitTestReadDafSummaries) {
+  DafSummaries spk = readDafSummaries(spkPath1);
+  EXPECT_EQ(spk.type, "SPK");
+  EXPECT_EQ(spk.nd, 2);
+  EXPECT_EQ(spk.ni, 6);
+  ASSERT_EQ(spk.segments.size(), 1);
+  EXPECT_EQ(spk.segments[0].ic[0], -85000);
+  EXPECT_EQ(spk.segments[0].ic[1], 1);
+  EXPECT_DOUBLE_EQ(spk.segments[0].dc[0], 110000000);
+  EXPECT_DOUBLE_EQ(spk.segments[0].dc[1], 120000000);
+
+  DafSummaries ck = readDafSummaries(ckPath1);
+  EXPECT_EQ(ck.type, "CK");
+  ASSERT_EQ(ck.segments.size(), 1);
+  EXPECT_EQ(ck.segments[0].ic[0], -85000);
+
+  std::map<int, std::vector<std::pair<double, double>>> coverage = getDafCoverage(spk);
+  ASSERT_EQ(coverage.size(), 1);
+  std::vector<std::pair<double, double>> expected = {{110000000, 120000000}};
+  EXPECT_EQ(coverage[-85000], expected);
+
+  EXPECT_THROW(readDafSummaries(ikPath1), std::invalid_argument);
+}
+
+
+TEST_F(LroKernelSet, UnitTestReadDafSummariesCorrupt) {
+  // a native format SPK with one summary record, record pointers are stored as doubles
+  auto writeDaf = [&](std::string name, double next, double nsum) {
+    std::vector<char> data(2048, ' ');
+    int32_t nd = 2, ni = 6, fward = 2;
+    std::memcpy(data.data(), "DAF/SPK ", 8);
+    std::memcpy(data.data() + 8, &nd, sizeof(nd));
+    std::memcpy(data.data() + 12, &ni, sizeof(ni));
+    std::memcpy(data.data() + 76, &fward, sizeof(fward));
+    double control[3] = {next, 0, nsum};
+    std::memcpy(data.data() + 1024, control, sizeof(control));
+
+    std::string path = (root / name).string();
+    std::ofstream(path, std::ios::binary).write(data.data(), data.size());
+    return path;
+  };
+
+  EXPECT_EQ(readDafSummaries(writeDaf("empty.bsp", 0, 0)).segments.size(), 0);
+  EXPECT_THROW(readDafSummaries(writeDaf("hugeNext.bsp", 1e300, 0)), std::invalid_argument);
+  EXPECT_THROW(readDafSummaries(writeDaf("negativeNext.bsp", -1, 0)), std::invalid_argument);
+  EXPECT_THROW(readDafSummaries(writeDaf("nanCount.bsp", 0, std::numeric_limits<double>::quiet_NaN())), std::invalid_argument);
+  EXPECT_THROW(readDafSummaries(writeDaf("hugeCount.bsp", 0, 1e20)), std::invalid_argument);
+}
+
+
+TEST(IoTests, UnitTestGetDafCoverage) {
+  DafSummaries summaries;
+  summaries.type = "SPK";
+  summaries.nd = 2;
+  summaries.ni = 6;
+  summaries.segments = {{{30, 40}, {-1, 0, 1, 13, 1, 2}},
+                        {{10, 20}, {-1, 0, 1, 13, 3, 4}},
+                        {{15, 30}, {-1, 0, 1, 13, 5, 6}},
+                        {{50, 60}, {-1, 0, 1, 13, 7, 8}},
+                        {{0, 5}, {399, 0, 1, 13, 9, 10}}};
+
+  std::map<int, std::vector<std::pair<double, double>>> coverage = getDafCoverage(summaries);
+  ASSERT_EQ(coverage.size(), 2);
+  std::vector<std::pair<double, double>> expected = {{10, 40}, {50, 60}};
+  EXPECT_EQ(coverage[-1], expected);
+  expected = {{0, 5}};
+  EXPECT_EQ(coverage[399], expected);
+}
+
+
+TEST_F(LroKernelSet, UnitTestGetTimeIntervalsNative) {
+  Kernel lsk(lskPath);
+  Kernel sclk(sclkPath);
+
+  std::vector<std::pair<double, double>> intervals = getTimeIntervals(ckPath1);
+  ASSERT_EQ(intervals.size(), 1);
+  EXPECT_NEAR(intervals[0].first, 110000000, 1);
+  EXPECT_NEAR(intervals[0].second, 120000000, 1);
+
+  intervals = getTimeIntervals(spkPath2);
+  ASSERT_EQ(intervals.size(), 1);
+  EXPECT_DOUBLE_EQ(intervals[0].first, 130000000);
+  EXPECT_DOUBLE_EQ(intervals[0].second, 140000000);
+}
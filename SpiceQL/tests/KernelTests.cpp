@@ -3,7 +3,12 @@
 
 #include <HippoMocks/hippomocks.h>
 
+#include <sys/wait.h>
+#include <unistd.h>
+
 #include "utils.h"
+#include "fork.h"
+#include "memo.h"
 #include "Fixtures.h"
 #include "spice_types.h"
 #include "query.h"
@@ -63,8 +68,8 @@ TEST_F(LroKernelSet, UnitTestStackedKernelCopyConstructor) {
     // should match what spice counts
     ktotal_c("text", &nkernels);
 
-    // 5 total text kernels, but the lsk should have been loaded 3 times
-    EXPECT_EQ(nkernels, 4);
+    // the lsk has 3 references, but it is already the last text kernel so it is only furnished once
+    EXPECT_EQ(nkernels, 2);
     EXPECT_EQ(pool.getRefCounts().at(lskPath), 3);
   }
 
@@ -95,14 +100,14 @@ TEST_F(LroKernelSet, UnitTestStackedKernelSetConstructorDestructor) {
 
   // load kernels in a closed call stack
   {
-    // kernels are now loaded twice
+    // kernels are now loaded twice, only kernels shadowed by another of their kind are furnished again
     KernelSet k(kernels);
 
     // should match what spice counts
     ktotal_c("text", &nkernels);
     EXPECT_EQ(nkernels, 7);
     ktotal_c("ck", &nkernels);
-    EXPECT_EQ(nkernels, 2);
+    EXPECT_EQ(nkernels, 1);
     ktotal_c("spk", &nkernels);
     EXPECT_EQ(nkernels, 4);
 
@@ -132,6 +137,269 @@ TEST_F(LroKernelSet, UnitTestStackedKernelSetConstructorDestructor) {
 }
 
 
+TEST_F(LroKernelSet, UnitTestKernelPoolPromote) {
+  int nkernels;
+
+  Kernel lsk(lskPath);
+  Kernel ik(ikPath1);
+  Kernel spk(spkPath1);
+
+  ktotal_c("text", &nkernels);
+  EXPECT_EQ(nkernels, 3);
+
+  // the ik was loaded after the lsk, so the lsk is furnished again on top of it
+  EXPECT_TRUE(pool.promote(lskPath));
+  ktotal_c("text", &nkernels);
+  EXPECT_EQ(nkernels, 4);
+  EXPECT_EQ(pool.getLoadOrder().back().first, lskPath);
+
+  // the spk is a different kind and can't shadow the lsk
+  EXPECT_FALSE(pool.promote(lskPath));
+  EXPECT_FALSE(pool.promote(spkPath1));
+  ktotal_c("text", &nkernels);
+  EXPECT_EQ(nkernels, 4);
+
+  EXPECT_THROW(pool.promote(ckPath1), std::out_of_range);
+}
+
+
+TEST_F(LroKernelSet, UnitTestKernelPoolPin) {
+  int nkernels;
+
+  pool.pin(lskPath);
+  pool.pin(lskPath);
+  EXPECT_EQ(pool.getRefCount(lskPath), 1);
+  std::vector<string> expected = {lskPath};
+  EXPECT_EQ(pool.getPinnedKernels(), expected);
+
+  {
+    Kernel k(lskPath);
+    EXPECT_EQ(pool.getRefCount(lskPath), 2);
+  }
+
+  // still furnished after every other reference is gone
+  ktotal_c("text", &nkernels);
+  EXPECT_EQ(nkernels, 2);
+  EXPECT_EQ(pool.getRefCount(lskPath), 1);
+  EXPECT_FALSE(pool.isBasePinned("lsk"));
+  EXPECT_TRUE(pool.isPinned(lskPath));
+
+  // kernel sets don't take another reference to a pinned kernel
+  nlohmann::json kernels;
+  kernels["kernels"] = {{lskPath}};
+  {
+    KernelSet ks(kernels);
+    EXPECT_TRUE(ks.loadedKernels.empty());
+    EXPECT_EQ(pool.getRefCount(lskPath), 1);
+  }
+
+  pool.unpin(lskPath);
+  EXPECT_FALSE(pool.isPinned(lskPath));
+  ktotal_c("text", &nkernels);
+  EXPECT_EQ(nkernels, 1);
+  EXPECT_TRUE(pool.getPinnedKernels().empty());
+  EXPECT_THROW(pool.unpin(lskPath), std::out_of_range);
+}
+
+
+TEST_F(LroKernelSet, UnitTestKernelPoolRetention) {
+  int nkernels;
+  pool.setRetention(1);
+
+  {
+    Kernel k(lskPath);
+  }
+
+  // released kernels stay furnished
+  ktotal_c("text", &nkernels);
+  EXPECT_EQ(nkernels, 2);
+  EXPECT_EQ(pool.getRefCount(lskPath), 0);
+  std::vector<string> expected = {lskPath};
+  EXPECT_EQ(pool.getRetainedKernels(), expected);
+
+  {
+    // reused without being furnished again
+    Kernel k(lskPath);
+    ktotal_c("text", &nkernels);
+    EXPECT_EQ(nkernels, 2);
+    EXPECT_EQ(pool.getRefCount(lskPath), 1);
+    EXPECT_TRUE(pool.getRetainedKernels().empty());
+  }
+
+  {
+    Kernel k(ikPath1);
+  }
+
+  // only one kernel fits, the least recently used one is unloaded
+  ktotal_c("text", &nkernels);
+  EXPECT_EQ(nkernels, 2);
+  expected = {ikPath1};
+  EXPECT_EQ(pool.getRetainedKernels(), expected);
+
+  pool.setRetention(0);
+  ktotal_c("text", &nkernels);
+  EXPECT_EQ(nkernels, 1);
+  EXPECT_TRUE(pool.getRetainedKernels().empty());
+}
+
+
+TEST_F(LroKernelSet, UnitTestKernelSetDeltaLoading) {
+  int nkernels;
+  pool.setDeltaLoading(true);
+
+  nlohmann::json kernels;
+  kernels["lsk"]["kernels"] = {{lskPath}};
+  kernels["ik"]["kernels"] = {{ikPath1}};
+
+  KernelSet ks(kernels);
+  ktotal_c("text", &nkernels);
+  EXPECT_EQ(nkernels, 3);
+
+  {
+    // already furnished in order, nothing new is furnished
+    KernelSet k(kernels);
+    ktotal_c("text", &nkernels);
+    EXPECT_EQ(nkernels, 3);
+    EXPECT_EQ(pool.getRefCount(lskPath), 2);
+    EXPECT_EQ(pool.getRefCount(ikPath1), 2);
+  }
+
+  ktotal_c("text", &nkernels);
+  EXPECT_EQ(nkernels, 3);
+  EXPECT_EQ(pool.getRefCount(ikPath1), 1);
+
+  {
+    // the ik is already the last text kernel, only the lsk is furnished again on top of it
+    nlohmann::json reversed;
+    reversed["kernels"] = {{ikPath1}, {lskPath}};
+    KernelSet k(reversed);
+    ktotal_c("text", &nkernels);
+    EXPECT_EQ(nkernels, 4);
+    EXPECT_EQ(pool.getLoadOrder().back().first, lskPath);
+  }
+
+  // only kernels that leave the set are unloaded
+  nlohmann::json lskOnly;
+  lskOnly["lsk"]["kernels"] = {{lskPath}};
+  ks.activate(lskOnly);
+  ktotal_c("text", &nkernels);
+  EXPECT_EQ(nkernels, 2);
+  EXPECT_EQ(pool.getRefCount(lskPath), 1);
+  EXPECT_EQ(pool.getRefCount(ikPath1), 0);
+
+  pool.setDeltaLoading(false);
+}
+
+
+TEST_F(LroKernelSet, UnitTestKernelSetMetaKernel) {
+  int nkernels;
+  setenv("SPICEQL_META_KERNEL_THRESHOLD", "2", true);
+
+  nlohmann::json kernels;
+  kernels["kernels"] = {{lskPath}, {ikPath1}};
+
+  {
+    // both kernels are furnished with a single meta-kernel
+    KernelSet ks(kernels);
+    ktotal_c("text", &nkernels);
+    EXPECT_EQ(nkernels, 3);
+    EXPECT_EQ(ks.loadedKernels.size(), 1);
+    EXPECT_EQ(fs::path(pool.getLoadOrder().back().first).extension(), ".tm");
+
+    // the kernels it loads are counted for each copy of the meta-kernel
+    EXPECT_EQ(pool.getRefCount(lskPath), 1);
+    EXPECT_EQ(pool.getRefCount(ikPath1), 1);
+
+    // the same set maps to the same meta-kernel
+    KernelSet ks2(kernels);
+    EXPECT_EQ(pool.getRefCount(lskPath), 2);
+    EXPECT_EQ(pool.getLoadedKernels().size(), 4);
+  }
+
+  ktotal_c("text", &nkernels);
+  EXPECT_EQ(nkernels, 1);
+  EXPECT_EQ(pool.getRefCount(lskPath), 0);
+  EXPECT_EQ(pool.getRefCount(ikPath1), 0);
+
+  // smaller sets are furnished one kernel at a time
+  nlohmann::json lskOnly;
+  lskOnly["kernels"] = {{lskPath}};
+  KernelSet ks(lskOnly);
+  EXPECT_EQ(pool.getRefCount(lskPath), 1);
+
+  unsetenv("SPICEQL_META_KERNEL_THRESHOLD");
+}
+
+
+TEST_F(LroKernelSet, UnitTestKernelPoolReopenKernels) {
+  int before;
+  int after;
+
+  Kernel lsk(lskPath);
+  Kernel spk(spkPath1);
+  std::vector<std::pair<string, string>> order = pool.getLoadOrder();
+  ktotal_c("all", &before);
+
+  pool.reopenKernels();
+  ktotal_c("all", &after);
+  EXPECT_EQ(after, before);
+  EXPECT_EQ(pool.getLoadOrder(), order);
+  EXPECT_EQ(pool.getRefCount(spkPath1), 1);
+
+  SpiceChar fileType[32], source[2048];
+  SpiceInt parentHandle, childHandle;
+  SpiceBoolean found;
+  kinfo_c(spkPath1.c_str(), 32, 2048, fileType, source, &parentHandle, &found);
+  ASSERT_TRUE(found);
+
+  bool redis = Memo::isRedisEnabled();
+  sw::redis::RedisCluster *parentRedis = redis ? Memo::getRedisConnection() : nullptr;
+
+  // a forked child gets its own copies of the same kernels, and its own connections.
+  // Each check that fails sets a bit of the exit status
+  pid_t pid = forkProcess();
+  if (pid == 0) {
+    int failed = 0;
+    int childKernels;
+    ktotal_c("all", &childKernels);
+    failed |= childKernels == before && pool.getLoadOrder() == order ? 0 : 1;
+
+    // reopened files get new handles, the parent's descriptors aren't shared
+    kinfo_c(spkPath1.c_str(), 32, 2048, fileType, source, &childHandle, &found);
+    failed |= found && childHandle != parentHandle ? 0 : 2;
+
+    const char *cacheDir = getenv("SPICEQL_CACHE_DIR");
+    failed |= cacheDir && Memo::getCacheDir() == cacheDir ? 0 : 4;
+
+    if (redis) {
+      failed |= Memo::getRedisConnection() != parentRedis ? 0 : 8;
+    }
+
+    // closing every kernel in the child leaves the parent's open
+    kclear_c();
+    _exit(failed);
+  }
+
+  int status;
+  waitpid(pid, &status, 0);
+  ASSERT_TRUE(WIFEXITED(status));
+  EXPECT_EQ(WEXITSTATUS(status), 0);
+  EXPECT_EQ(pool.getLoadOrder(), order);
+
+  // the cache directory children use is exported
+  ASSERT_NE(getenv("SPICEQL_CACHE_DIR"), nullptr);
+  EXPECT_EQ(Memo::getCacheDir(), getenv("SPICEQL_CACHE_DIR"));
+
+  // the parent's handle still reads the SPK
+  dafbfs_c(parentHandle);
+  daffna_c(&found);
+  EXPECT_TRUE(found);
+  if (redis) {
+    EXPECT_EQ(Memo::getRedisConnection(), parentRedis);
+  }
+}
+
+
 TEST_F(LroKernelSet, UnitTestStackedKernelPoolGetLoadedKernels) {
   // load all available kernels
   nlohmann::json kernels = listMissionKernels(root, conf);
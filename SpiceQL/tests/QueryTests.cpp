@@ -8,6 +8,8 @@
 
 #include "Fixtures.h"
 
+#include "memo.h"
+#include "memoized_functions.h"
 #include "query.h"
 #include "utils.h"
 
@@ -27,6 +29,22 @@ TEST(QueryTests, UnitTestGetLatestKernel) {
   EXPECT_EQ(getLatestKernel(kernels)[0],  "test/iak.0004.ti");
 }
 
+
+TEST(QueryTests, UnitTestGetLatestKernelNumericVersions) {
+  vector<string> kernels = {
+    "ik/msgr_mdis_v9.ti",
+    "ik/msgr_mdis_v10.ti",
+    "ik/msgr_mdis_v2.ti",
+    "ik/lro_lroc_v1.ti"
+  };
+
+  vector<string> expected = {"ik/msgr_mdis_v10.ti", "ik/lro_lroc_v1.ti"};
+  EXPECT_EQ(getLatestKernel(kernels), expected);
+
+  EXPECT_LT(getKernelVersionKey("a/msgr_mdis_v9.ti"), getKernelVersionKey("b/msgr_mdis_v10.ti"));
+  EXPECT_EQ(getKernelVersionKey("a/iak.0004.ti"), getKernelVersionKey("b/iak.4.ti"));
+}
+
 TEST(QueryTests, getKernelStringValue){
   unique_ptr<Kernel> k(new Kernel("data/msgr_mdis_v010.ti"));
   // INS-236810_CCD_CENTER        =  (  511.5, 511.5 )
@@ -98,6 +116,339 @@ TEST(QueryTests, UnitTestGetLatestKernelError) {
 }
 
 
+TEST(QueryTests, UnitTestGetQualityFallbacks) {
+  // any quality will do
+  EXPECT_TRUE(getQualityFallbacks("na").empty());
+
+  EXPECT_EQ(getQualityFallbacks("smithed"), vector<string>({"smithed", "reconstructed", "nadir", "predicted"}));
+  EXPECT_EQ(getQualityFallbacks("reconstructed"), vector<string>({"reconstructed", "nadir", "predicted"}));
+  EXPECT_EQ(getQualityFallbacks("predicted"), vector<string>({"predicted"}));
+  EXPECT_THROW(getQualityFallbacks("best"), invalid_argument);
+}
+
+
+TEST(QueryTests, UnitTestSearchAndRefineKernelsQualityFallback) {
+  setenv("SPICEQL_LAZY_COVERAGE", "true", true);
+  string predicted = "m01_map.bsp";
+  string smithed = "themis_dayir_merged_2018Jul13_spk.bsp";
+  string reconstructed = "m01_ab_v2.bsp";
+
+  MockRepository mocks;
+  // one kernel for each of odyssey's SPK qualities
+  mocks.OnCallFunc(Memo::getPathsFromRegexGroups).Do([&](string root, vector<vector<string>> regexGroups) {
+    vector<vector<vector<string>>> res;
+    for (auto &regexes : regexGroups) {
+      string regex = regexes.empty() ? "" : regexes.front();
+      if (regex == "m01_map.bsp") {
+        res.push_back({{predicted}});
+      }
+      else if (regex.find("themis") != string::npos && regex.find("spk") != string::npos) {
+        res.push_back({{smithed}});
+      }
+      else if (regex == "m01_ab_v2.bsp") {
+        res.push_back({{reconstructed}});
+      }
+      else {
+        res.push_back({});
+      }
+    }
+    return res;
+  });
+
+  // the smithed kernel doesn't cover the time, the reconstructed one does
+  vector<string> searched;
+  mocks.OnCallFunc(SpiceQL::searchEphemerisKernels).Do([&](nlohmann::json kernels, vector<double> times, bool isContiguous, nlohmann::json cachedTimes) {
+    for (auto &[qual, group] : kernels["spk"].items()) {
+      searched.push_back(qual);
+    }
+    if (kernels["spk"].contains("smithed")) {
+      kernels["spk"]["smithed"]["kernels"] = nlohmann::json::array();
+    }
+    return kernels;
+  });
+
+  nlohmann::json res = searchAndRefineKernels("odyssey", {110000000}, "reconstructed", "smithed", {"spk"});
+  unsetenv("SPICEQL_LAZY_COVERAGE");
+
+  // predicted is never searched since reconstructed has coverage
+  vector<string> expectedSearched = {"smithed", "reconstructed"};
+  EXPECT_EQ(searched, expectedSearched);
+  nlohmann::json expected = {{reconstructed}};
+  EXPECT_EQ(res["odyssey"]["spk"]["kernels"], expected);
+  EXPECT_FALSE(res["odyssey"]["spk"].contains("smithed"));
+  EXPECT_FALSE(res["odyssey"]["spk"].contains("predicted"));
+}
+
+
+TEST(QueryTests, UnitTestSearchEphemerisKernelsFilenameDates) {
+  nlohmann::json kernels = R"({
+    "ck" : {
+      "reconstructed" : {
+        "kernels" : [["ck/mro_sc_psp_060101_060107.bc", "ck/mro_sc_psp_070101_070107.bc", "ck/mro_other.bc"]],
+        "dates" : [{"regex" : "mro_sc_psp_([0-9]{6})_([0-9]{6}).bc$", "format" : "%y%m%d"}]
+      }
+    }
+  })"_json;
+
+  // every kernel claims to cover the search time, only the file name dates can rule one out.
+  // Coverage is only read for the kernels that are left, reading mro_sc_psp_070101_070107.bc throws
+  std::vector<std::pair<double, double>> everything = {{0, 1e9}};
+  MockRepository mocks;
+  mocks.OnCallFunc(Memo::getTimeIntervals).With("ck/mro_sc_psp_060101_060107.bc").Return(everything);
+  mocks.OnCallFunc(Memo::getTimeIntervals).With("ck/mro_other.bc").Return(everything);
+
+  // 2006-01-03
+  nlohmann::json res = searchEphemerisKernels(kernels, {189518400}, true);
+
+  nlohmann::json expected = {{"ck/mro_sc_psp_060101_060107.bc"}, {"ck/mro_other.bc"}};
+  EXPECT_EQ(res["ck"]["reconstructed"]["kernels"], expected);
+  EXPECT_FALSE(res["ck"]["reconstructed"].contains("dates"));
+}
+
+
+TEST(QueryTests, UnitTestSearchEphemerisKernelsFilenameDatesCachedTimes) {
+  nlohmann::json kernels = R"({
+    "ck" : {
+      "reconstructed" : {
+        "kernels" : [["ck/mro_sc_psp_060101_060107.bc", "ck/mro_sc_psp_070101_070107.bc"]],
+        "dates" : [{"regex" : "mro_sc_psp_([0-9]{6})_([0-9]{6}).bc$", "format" : "%y%m%d"}]
+      }
+    }
+  })"_json;
+
+  // with the coverage already loaded it is used as is, file name dates aren't checked
+  nlohmann::json cachedTimes;
+  cachedTimes["ck/mro_sc_psp_060101_060107.bc"] = {{0, 1e9}};
+  cachedTimes["ck/mro_sc_psp_070101_070107.bc"] = {{0, 1e9}};
+
+  nlohmann::json res = searchEphemerisKernels(kernels, {189518400}, true, cachedTimes);
+
+  nlohmann::json expected = {{"ck/mro_sc_psp_060101_060107.bc"}, {"ck/mro_sc_psp_070101_070107.bc"}};
+  EXPECT_EQ(res["ck"]["reconstructed"]["kernels"], expected);
+}
+
+
+TEST(QueryTests, UnitTestSearchEphemerisKernelsFilenameDatesWindow) {
+  nlohmann::json kernels = R"({
+    "ck" : {
+      "reconstructed" : {
+        "kernels" : [["ck/mro_sc_psp_060101_060107.bc", "ck/mro_sc_psp_060108_060114.bc", "ck/mro_sc_psp_070101_070107.bc"]],
+        "dates" : [{"regex" : "mro_sc_psp_([0-9]{6})_([0-9]{6}).bc$", "format" : "%y%m%d"}]
+      }
+    }
+  })"_json;
+
+  std::vector<std::pair<double, double>> everything = {{0, 1e9}};
+  MockRepository mocks;
+  mocks.OnCallFunc(Memo::getTimeIntervals).With("ck/mro_sc_psp_060101_060107.bc").Return(everything);
+  mocks.OnCallFunc(Memo::getTimeIntervals).With("ck/mro_sc_psp_060108_060114.bc").Return(everything);
+
+  // 2006-01-05 to 2006-01-10 crosses from the first file into the second
+  nlohmann::json res = searchEphemerisKernels(kernels, {189691200, 190123200}, true);
+
+  nlohmann::json expected = {{"ck/mro_sc_psp_060101_060107.bc"}, {"ck/mro_sc_psp_060108_060114.bc"}};
+  EXPECT_EQ(res["ck"]["reconstructed"]["kernels"], expected);
+}
+
+
+TEST(QueryTests, UnitTestFilterKernelsByBodies) {
+  nlohmann::json kernels = R"({
+    "base" : {
+      "spk" : {"kernels" : [["de430.bsp"]]},
+      "pck" : {"kernels" : [["pck00009.tpc"]]}
+    },
+    "mro" : {
+      "spk" : {"kernels" : [["mro_psp.bsp", "lro_sc.bsp", "mro_late.bsp", "unknown.bsp"]]}
+    }
+  })"_json;
+
+  std::map<std::string, std::string> coverage = {
+    {"de430.bsp", R"({"499" : {"intervals" : [[-1e9, 1e9]], "centers" : [4]}, "4" : {"intervals" : [[-1e9, 1e9]], "centers" : [0]}})"},
+    {"mro_psp.bsp", R"({"-74" : {"intervals" : [[0, 100]], "centers" : [499]}})"},
+    {"lro_sc.bsp", R"({"-85" : {"intervals" : [[0, 100]], "centers" : [301]}})"},
+    {"mro_late.bsp", R"({"-74" : {"intervals" : [[200, 300]], "centers" : [499]}})"},
+    {"unknown.bsp", "{}"}
+  };
+
+  MockRepository mocks;
+  mocks.OnCallFunc(SpiceQL::Memo::getBodyCoverage).Do([&](std::string kpath) -> std::string {
+    return coverage.at(kpath);
+  });
+
+  nlohmann::json res = filterKernelsByBodies(kernels, {-74, 499}, {10, 20});
+
+  nlohmann::json expectedMro = {{"mro_psp.bsp", "unknown.bsp"}};
+  nlohmann::json expectedBase = {{"de430.bsp"}};
+  EXPECT_EQ(res["mro"]["spk"]["kernels"], expectedMro);
+  EXPECT_EQ(res["base"]["spk"]["kernels"], expectedBase);
+  EXPECT_EQ(res["base"]["pck"], kernels["base"]["pck"]);
+
+  // known coverage, e.g. from the coverage store, isn't read again
+  nlohmann::json stored = R"({"stored.bsp" : {"-85" : {"intervals" : [[0, 100]], "centers" : [301]}}})"_json;
+  kernels["mro"]["spk"]["kernels"] = {{"mro_psp.bsp", "stored.bsp"}};
+  res = filterKernelsByBodies(kernels, {-74, 499}, {10, 20}, stored);
+  expectedMro = {{"mro_psp.bsp"}};
+  EXPECT_EQ(res["mro"]["spk"]["kernels"], expectedMro);
+}
+
+
+TEST(QueryTests, UnitTestGetMinimalCoveringKernels) {
+  nlohmann::json kernels = R"({
+    "spk" : {"kernels" : [["a.bsp", "b.bsp"], ["c.bsp"], ["unknown.bsp"]]},
+    "ck" : {"kernels" : [["a.bc", "b.bc"]]}
+  })"_json;
+
+  std::map<std::string, std::string> coverage = {
+    {"a.bsp", R"({"-74" : {"intervals" : [[0, 100]], "centers" : [499]}})"},
+    {"b.bsp", R"({"-74" : {"intervals" : [[0, 50]], "centers" : [499]}})"},
+    {"c.bsp", R"({"-74" : {"intervals" : [[200, 300]], "centers" : [499]}})"},
+    {"unknown.bsp", "{}"},
+    {"a.bc", R"({"-74000" : {"intervals" : [[0, 100]]}})"},
+    {"b.bc", R"({"-74000" : {"intervals" : [[0, 100]]}})"}
+  };
+
+  MockRepository mocks;
+  mocks.OnCallFunc(SpiceQL::Memo::getBodyCoverage).Do([&](std::string kpath) -> std::string {
+    return coverage.at(kpath);
+  });
+
+  // b shadows a at 10 but not at 60, c has nothing at either time
+  unsetenv("SPICEQL_CK_COVERAGE_LEVEL");
+  nlohmann::json res = getMinimalCoveringKernels(kernels, {10, 60});
+  nlohmann::json expectedSpk = {{"a.bsp", "b.bsp"}, {"unknown.bsp"}};
+  EXPECT_EQ(res["spk"]["kernels"], expectedSpk);
+  EXPECT_EQ(res["ck"], kernels["ck"]);
+
+  res = getMinimalCoveringKernels(kernels, {10});
+  expectedSpk = {{"b.bsp"}, {"unknown.bsp"}};
+  EXPECT_EQ(res["spk"]["kernels"], expectedSpk);
+
+  // CKs are only reduced with interval level coverage
+  setenv("SPICEQL_CK_COVERAGE_LEVEL", "INTERVAL", true);
+  res = getMinimalCoveringKernels(kernels, {10, 60});
+  unsetenv("SPICEQL_CK_COVERAGE_LEVEL");
+  nlohmann::json expectedCk = {{"b.bc"}};
+  EXPECT_EQ(res["ck"]["kernels"], expectedCk);
+}
+
+
+TEST(QueryTests, UnitTestGetMinimalCoveringKernelsWindow) {
+  nlohmann::json kernels = R"({
+    "spk" : {"kernels" : [["a.bsp", "b.bsp"]]}
+  })"_json;
+
+  std::map<std::string, std::string> coverage = {
+    {"a.bsp", R"({"-74" : {"intervals" : [[0, 10]], "centers" : [499]}})"},
+    {"b.bsp", R"({"-74" : {"intervals" : [[0, 2], [9, 10]], "centers" : [499]}})"}
+  };
+
+  MockRepository mocks;
+  mocks.OnCallFunc(SpiceQL::Memo::getBodyCoverage).Do([&](std::string kpath) -> std::string {
+    return coverage.at(kpath);
+  });
+
+  // b wins at both ends of the window, but only a covers the gap in between
+  nlohmann::json res = getMinimalCoveringKernels(kernels, {0, 10});
+  nlohmann::json expectedSpk = {{"a.bsp", "b.bsp"}};
+  EXPECT_EQ(res["spk"]["kernels"], expectedSpk);
+
+  // a window inside one of b's intervals only needs b
+  res = getMinimalCoveringKernels(kernels, {0, 1});
+  expectedSpk = {{"b.bsp"}};
+  EXPECT_EQ(res["spk"]["kernels"], expectedSpk);
+}
+
+
+TEST(QueryTests, UnitTestKernelTimeline) {
+  nlohmann::json kernels = R"({
+    "reconstructed" : {"kernels" : [["r1.bc"], ["r2.bc"]]},
+    "predicted" : {"kernels" : [["p1.bc"]]}
+  })"_json;
+  nlohmann::json coverage = R"({"r1.bc" : [[0, 10]], "r2.bc" : [[5, 20]], "p1.bc" : [[0, 100]]})"_json;
+
+  nlohmann::json timeline = buildKernelTimeline(kernels, coverage, {"reconstructed", "predicted"});
+  ASSERT_EQ(timeline["ranges"].size(), 4);
+  EXPECT_EQ(timeline["ranges"][1]["start"], 5.0);
+  EXPECT_EQ(timeline["ranges"][1]["stop"], 10.0);
+  EXPECT_EQ(timeline["ranges"][1]["kernels"], nlohmann::json({0, 1}));
+  // predicted is only used where there is nothing reconstructed
+  EXPECT_EQ(timeline["ranges"][3]["start"], 20.0);
+  EXPECT_EQ(timeline["ranges"][3]["kernels"], nlohmann::json({2}));
+
+  nlohmann::json res = searchKernelTimeline(timeline, {1, 15});
+  nlohmann::json expected = {{"r1.bc"}, {"r2.bc"}};
+  EXPECT_EQ(res["kernels"], expected);
+  EXPECT_EQ(res["quality"], "reconstructed");
+
+  res = searchKernelTimeline(timeline, {50});
+  expected = {{"p1.bc"}};
+  EXPECT_EQ(res["kernels"], expected);
+  EXPECT_EQ(res["quality"], "predicted");
+
+  res = searchKernelTimeline(timeline, {200});
+  EXPECT_TRUE(res["kernels"].empty());
+  EXPECT_FALSE(res.contains("quality"));
+
+  // with mixed qualities the best quality is loaded last
+  res = searchKernelTimeline(timeline, {1, 50});
+  expected = {{"p1.bc"}, {"r1.bc"}};
+  EXPECT_EQ(res["kernels"], expected);
+  EXPECT_EQ(res["quality"], "reconstructed");
+
+  // groups the timeline has none of give a timeline without kernels
+  timeline = buildKernelTimeline(kernels, coverage, {"smithed"});
+  EXPECT_TRUE(timeline["kernels"].empty());
+  EXPECT_TRUE(timeline["ranges"].empty());
+}
+
+
+TEST(QueryTests, UnitTestKernelTimelineVersionGroups) {
+  nlohmann::json kernels = R"({
+    "reconstructed" : {"kernels" : [["v1.bc", "v2.bc"], ["other1.bc"]]}
+  })"_json;
+  nlohmann::json coverage = R"({"v1.bc" : [[0, 10]], "v2.bc" : [[5, 20]], "other1.bc" : [[0, 20]]})"_json;
+
+  nlohmann::json timeline = buildKernelTimeline(kernels, coverage, {"reconstructed"});
+  nlohmann::json res = searchKernelTimeline(timeline, {1, 15});
+  // versions of the same kernel stay together so getLatestKernels can pick one
+  nlohmann::json expected = {{"v1.bc", "v2.bc"}, {"other1.bc"}};
+  EXPECT_EQ(res["kernels"], expected);
+  expected = {{"v2.bc"}, {"other1.bc"}};
+  EXPECT_EQ(getLatestKernels({{"kernels", res["kernels"]}})["kernels"], expected);
+}
+
+
+TEST(QueryTests, UnitTestGetKernelTimelineCached) {
+  nlohmann::json kernels = R"({"reconstructed" : {"kernels" : [["r1.bc"]]}})"_json;
+  nlohmann::json coverage = R"({"r1.bc" : [[0, 10]]})"_json;
+  string coverageHash = getCoverageHash(coverage.dump());
+
+  fs::path cacheDir = Memo::getCacheDir();
+  fs::path timelinePath = cacheDir / "spiceql_timeline_timelinetest_ck_reconstructed.json";
+  fs::path emptyPath = cacheDir / "spiceql_timeline_timelinetest_spk_reconstructed.json";
+
+  nlohmann::json timeline = buildKernelTimeline(kernels, coverage, {"reconstructed"});
+  timeline["coverageHash"] = coverageHash;
+  ofstream(timelinePath) << timeline.dump();
+  nlohmann::json empty = buildKernelTimeline({}, coverage, {"reconstructed"});
+  empty["coverageHash"] = coverageHash;
+  ofstream(emptyPath) << empty.dump();
+
+  MockRepository mocks;
+  mocks.NeverCallFunc(SpiceQL::globTimeIntervals);
+
+  EXPECT_EQ(getKernelTimeline("timelinetest", "ck", "reconstructed", coverageHash)["kernels"], timeline["kernels"]);
+  // groups the mission doesn't have are empty without being rebuilt
+  EXPECT_TRUE(getKernelTimeline("timelinetest", "spk", "reconstructed", coverageHash).empty());
+
+  // the parsed timelines stay in memory while the coverage is the same
+  fs::remove(timelinePath);
+  fs::remove(emptyPath);
+  EXPECT_EQ(getKernelTimeline("timelinetest", "ck", "reconstructed", coverageHash)["kernels"], timeline["kernels"]);
+  EXPECT_TRUE(getKernelTimeline("timelinetest", "spk", "reconstructed", coverageHash).empty());
+}
+
+
 TEST_F(KernelDataDirectories, FunctionalTestListMissionKernelsAllMess) {
   string dbPath = getMissionConfigFile("mess");
 
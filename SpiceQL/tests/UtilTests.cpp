@@ -1,8 +1,17 @@
 #include <gtest/gtest.h>
 
 #include <ghc/fs_std.hpp>
+#include <atomic>
 #include <chrono>
 
+#include <fcntl.h>
+#include <semaphore.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
 using namespace std::chrono;
 
 #include "TestUtilities.h"
@@ -14,6 +23,9 @@ using namespace std::chrono;
 #include "SpiceUsr.h"
 #include "memo.h"
 #include "query.h"
+#include "executor.h"
+#include "fork.h"
+#include "workers.h"
 
 #include <spdlog/spdlog.h>
 
@@ -333,6 +345,617 @@ TEST(UtilTests, testGetPathsFromRegexSingleRegex) {
 }
 
 
+TEST(UtilTests, testGetPathsFromRegexGroups) {
+  // create a temp work area 
+  fs::path temp = fs::temp_directory_path() / SpiceQL::gen_random(10); 
+  fs::create_directories(temp);
+
+  // create some files 
+  fstream fs;
+  fs.open((temp/"test12345.ti").string(), ios::out);
+  fs.close();
+  fs.open((temp/"test44444.ti").string(), ios::out);
+  fs.close();
+  fs.open((temp/"test1.spk").string(), ios::out);
+  fs.close();
+  fs.open((temp/"test2.spk").string(), ios::out);
+  fs.close();
+
+  std::vector<std::vector<std::string>> groups = {{"test[0-9]{5}.ti", "test[0-9].spk"}, {"test[0-9].spk"}, {"nothing[0-9].bc"}};
+  std::vector<std::vector<std::vector<std::string>>> res = getPathsFromRegexGroups(temp, groups);
+
+  // one result per group, each shaped like getPathsFromRegex
+  ASSERT_EQ(res.size(), 3);
+  EXPECT_EQ(res.at(0), getPathsFromRegex(temp, groups.at(0)));
+  ASSERT_EQ(res.at(1).size(), 1);
+  EXPECT_EQ(res.at(1).at(0).size(), 2);
+  EXPECT_TRUE(res.at(2).empty());
+}
+
+
+TEST(UtilTests, testGetRegexLiteralPrefix) {
+  EXPECT_EQ(getRegexLiteralPrefix("mro_sc_psp_[0-9]{6}_[0-9]{6}.bc"), std::make_pair(std::string("mro_sc_psp_"), false));
+  EXPECT_EQ(getRegexLiteralPrefix("MRO_SCLKSCET\\.[0-9]{5}.tsc"), std::make_pair(std::string("MRO_SCLKSCET."), false));
+  EXPECT_EQ(getRegexLiteralPrefix("^ura[0-9]{3}.bsp$"), std::make_pair(std::string("ura"), true));
+  EXPECT_EQ(getRegexLiteralPrefix("lro_?sclk"), std::make_pair(std::string("lro"), false));
+  EXPECT_EQ(getRegexLiteralPrefix("ab+c"), std::make_pair(std::string("ab"), false));
+  EXPECT_EQ(getRegexLiteralPrefix("[0-9]{6}_[0-9]{6}r*.bc"), std::make_pair(std::string(""), false));
+  EXPECT_EQ(getRegexLiteralPrefix("\\d+.bsp"), std::make_pair(std::string(""), false));
+  EXPECT_EQ(getRegexLiteralPrefix("^abc|def"), std::make_pair(std::string(""), true));
+}
+
+
+TEST(UtilTests, testGetPathsFromRegexGroupsPrefixes) {
+  fs::path temp = fs::temp_directory_path() / SpiceQL::gen_random(10); 
+  fs::create_directories(temp);
+
+  fstream fs;
+  for (std::string name : {"lro_1.bc", "lro_2.bc", "xlro_3.bc", "lrp_4.bc", "lr.bc"}) {
+    fs.open((temp/name).string(), ios::out);
+    fs.close();
+  }
+
+  std::vector<std::vector<std::vector<std::string>>> res = getPathsFromRegexGroups(temp, {{"^lro_[0-9].bc"}, {"lro_[0-9].bc"}});
+
+  ASSERT_EQ(res.size(), 2);
+  ASSERT_EQ(res.at(0).size(), 1);
+  ASSERT_EQ(res.at(1).size(), 1);
+
+  // anchored only matches at the start of the name, unanchored matches anywhere
+  std::vector<std::string> anchored = res.at(0).at(0);
+  std::vector<std::string> unanchored = res.at(1).at(0);
+  std::sort(anchored.begin(), anchored.end());
+  std::sort(unanchored.begin(), unanchored.end());
+  EXPECT_EQ(anchored, std::vector<std::string>({(temp/"lro_1.bc").string(), (temp/"lro_2.bc").string()}));
+  EXPECT_EQ(unanchored, std::vector<std::string>({(temp/"lro_1.bc").string(), (temp/"lro_2.bc").string(), (temp/"xlro_3.bc").string()}));
+}
+
+
+TEST(UtilTests, testGetFilenameDateRange) {
+  nlohmann::json extractors = R"([
+    {"regex" : "mro_sc_psp_([0-9]{6})_([0-9]{6}).bc$", "format" : "%y%m%d", "margin" : 0}
+  ])"_json;
+
+  // 2006-01-01T00:00:00 and 2006-01-07T00:00:00 UTC, within leapseconds
+  std::optional<std::pair<double, double>> range = getFilenameDateRange("/some/path/mro_sc_psp_060101_060107.bc", extractors);
+  ASSERT_TRUE(range.has_value());
+  EXPECT_NEAR(range->first, 189345665.18, 100);
+  EXPECT_NEAR(range->second, 189864065.18, 100);
+
+  EXPECT_FALSE(getFilenameDateRange("/some/path/mro_sc_psp_060101_060107_v2.bc", extractors).has_value());
+  EXPECT_FALSE(getFilenameDateRange("/some/path/mro_sc_psp_06010a_060107.bc", extractors).has_value());
+}
+
+
+TEST(UtilTests, testGetEnvBool) {
+  unsetenv("SPICEQL_TEST_FLAG");
+  EXPECT_FALSE(getEnvBool("SPICEQL_TEST_FLAG"));
+  EXPECT_TRUE(getEnvBool("SPICEQL_TEST_FLAG", true));
+
+  setenv("SPICEQL_TEST_FLAG", "True", true);
+  EXPECT_TRUE(getEnvBool("SPICEQL_TEST_FLAG"));
+  setenv("SPICEQL_TEST_FLAG", "false", true);
+  EXPECT_FALSE(getEnvBool("SPICEQL_TEST_FLAG", true));
+  setenv("SPICEQL_TEST_FLAG", "1", true);
+  EXPECT_TRUE(getEnvBool("SPICEQL_TEST_FLAG"));
+  setenv("SPICEQL_TEST_FLAG", "0", true);
+  EXPECT_FALSE(getEnvBool("SPICEQL_TEST_FLAG", true));
+  setenv("SPICEQL_TEST_FLAG", "maybe", true);
+  EXPECT_TRUE(getEnvBool("SPICEQL_TEST_FLAG", true));
+
+  unsetenv("SPICEQL_TEST_FLAG");
+}
+
+
+TEST(UtilTests, testGetEnvUnsigned) {
+  unsetenv("SPICEQL_TEST_COUNT");
+  EXPECT_EQ(getEnvUnsigned("SPICEQL_TEST_COUNT", 7), 7);
+
+  setenv("SPICEQL_TEST_COUNT", "42", true);
+  EXPECT_EQ(getEnvUnsigned("SPICEQL_TEST_COUNT", 7), 42);
+  setenv("SPICEQL_TEST_COUNT", "0", true);
+  EXPECT_EQ(getEnvUnsigned("SPICEQL_TEST_COUNT", 7), 0);
+
+  // negative, partly numeric and out of range values use the default
+  for (const char *value : {"-1", "12abc", "many", "", "99999999999999999999999"}) {
+    setenv("SPICEQL_TEST_COUNT", value, true);
+    EXPECT_EQ(getEnvUnsigned("SPICEQL_TEST_COUNT", 7), 7) << value;
+  }
+
+  unsetenv("SPICEQL_TEST_COUNT");
+}
+
+
+TEST(UtilTests, testUpdateTimeIntervals) {
+  fs::path temp = fs::temp_directory_path() / SpiceQL::gen_random(10); 
+  fs::create_directories(temp);
+
+  std::vector<std::string> kernels;
+  for (std::string name : {"a.bc", "b.bc", "c.bc", "d.bc"}) {
+    std::ofstream ofs((temp/name).string());
+    ofs << name;
+    kernels.push_back((temp/name).string());
+  }
+
+  nlohmann::json store;
+  {
+    MockRepository mocks;
+    std::vector<std::pair<double, double>> intervals = {{1, 2}};
+    mocks.OnCallFunc(SpiceQL::getTimeIntervals).Return(intervals);
+    store = updateTimeIntervals({}, {kernels[0], kernels[1], kernels[3]});
+  }
+
+  ASSERT_EQ(store.size(), 3);
+  EXPECT_EQ(store[kernels[0]]["intervals"], nlohmann::json({{1, 2}}));
+  EXPECT_EQ(store[kernels[1]]["size"], 4);
+
+  // b changes, a is removed and c is new, only b and c should be read again
+  {
+    std::ofstream ofs(kernels[1], std::ios::app);
+    ofs << "more data";
+  }
+
+  {
+    MockRepository mocks;
+    std::vector<std::pair<double, double>> intervals = {{3, 4}};
+    mocks.OnCallFunc(SpiceQL::getTimeIntervals).Return(intervals);
+    size_t calls = 0;
+    store = updateTimeIntervals(store, {kernels[1], kernels[2], kernels[3]}, 2, [&](size_t done, size_t total) {
+      calls++;
+      EXPECT_EQ(total, 2);
+      EXPECT_EQ(done, calls);
+    });
+    EXPECT_EQ(calls, 2);
+  }
+
+  ASSERT_EQ(store.size(), 3);
+  EXPECT_FALSE(store.contains(kernels[0]));
+  EXPECT_EQ(store[kernels[1]]["intervals"], nlohmann::json({{3, 4}}));
+  EXPECT_EQ(store[kernels[2]]["intervals"], nlohmann::json({{3, 4}}));
+  EXPECT_EQ(store[kernels[3]]["intervals"], nlohmann::json({{1, 2}}));
+
+  // changing the CK coverage level invalidates every entry
+  setenv("SPICEQL_CK_COVERAGE_LEVEL", "interval", true);
+  {
+    MockRepository mocks;
+    std::vector<std::pair<double, double>> intervals = {{5, 6}};
+    mocks.OnCallFunc(SpiceQL::getTimeIntervals).Return(intervals);
+    store = updateTimeIntervals(store, {kernels[1], kernels[3]});
+  }
+  unsetenv("SPICEQL_CK_COVERAGE_LEVEL");
+
+  EXPECT_EQ(store[kernels[1]]["ckLevel"], "INTERVAL");
+  EXPECT_EQ(store[kernels[3]]["intervals"], nlohmann::json({{5, 6}}));
+}
+
+
+TEST(UtilTests, testGetCkCoverageLevel) {
+  unsetenv("SPICEQL_CK_COVERAGE_LEVEL");
+  unsetenv("SPICEQL_CK_COVERAGE_TOLERANCE");
+  EXPECT_EQ(getCkCoverageLevel(), "SEGMENT");
+  EXPECT_EQ(getCkCoverageTolerance(), 0);
+
+  setenv("SPICEQL_CK_COVERAGE_LEVEL", "Interval", true);
+  setenv("SPICEQL_CK_COVERAGE_TOLERANCE", "128", true);
+  EXPECT_EQ(getCkCoverageLevel(), "INTERVAL");
+  EXPECT_EQ(getCkCoverageTolerance(), 128);
+
+  setenv("SPICEQL_CK_COVERAGE_LEVEL", "frames", true);
+  setenv("SPICEQL_CK_COVERAGE_TOLERANCE", "lots", true);
+  EXPECT_EQ(getCkCoverageLevel(), "SEGMENT");
+  EXPECT_EQ(getCkCoverageTolerance(), 0);
+
+  unsetenv("SPICEQL_CK_COVERAGE_LEVEL");
+  unsetenv("SPICEQL_CK_COVERAGE_TOLERANCE");
+}
+
+
+TEST(UtilTests, testSpiceExecutor) {
+  SpiceExecutor &executor = SpiceExecutor::getInstance();
+  executor.setEnabled(false);
+
+  // off, tasks run inline
+  EXPECT_FALSE(runOnSpiceExecutor([&]() { return executor.isExecutorThread(); }));
+
+  executor.setEnabled(true);
+  EXPECT_TRUE(runOnSpiceExecutor([&]() { return executor.isExecutorThread(); }));
+
+  // nested tasks run inline instead of waiting on themselves
+  EXPECT_EQ(runOnSpiceExecutor([]() { return runOnSpiceExecutor([]() { return 42; }); }), 42);
+
+  // tasks from many threads run one at a time
+  int count = 0;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; t++) {
+    threads.emplace_back([&]() {
+      for (int i = 0; i < 1000; i++) {
+        runOnSpiceExecutor([&]() { count++; });
+      }
+    });
+  }
+  for (auto &t : threads) {
+    t.join();
+  }
+  EXPECT_EQ(count, 4000);
+
+  std::future<std::string> result = executor.submit([]() { return std::string("done"); });
+  EXPECT_EQ(result.get(), "done");
+
+  EXPECT_THROW(runOnSpiceExecutor([]() -> int { throw std::invalid_argument("bad"); }), std::invalid_argument);
+
+  // turning it off while other threads submit doesn't strand their tasks
+  std::atomic<int> finished{0};
+  threads.clear();
+  for (int t = 0; t < 4; t++) {
+    threads.emplace_back([&]() {
+      for (int i = 0; i < 1000; i++) {
+        runOnSpiceExecutor([&]() { finished++; });
+      }
+    });
+  }
+  executor.setEnabled(false);
+  for (auto &t : threads) {
+    t.join();
+  }
+  EXPECT_EQ(finished.load(), 4000);
+  EXPECT_FALSE(executor.isEnabled());
+}
+
+
+TEST(UtilTests, testSpiceExecutorFork) {
+  SpiceExecutor &executor = SpiceExecutor::getInstance();
+  executor.setEnabled(true);
+
+  // other threads keep using the executor while the process forks
+  std::atomic<bool> stop{false};
+  std::atomic<int> finished{0};
+  std::thread querying([&]() {
+    while (!stop) {
+      runOnSpiceExecutor([&]() { finished++; });
+    }
+  });
+
+  for (int i = 0; i < 5; i++) {
+    pid_t pid = forkProcess();
+    if (pid == 0) {
+      _exit(runOnSpiceExecutor([&]() { return executor.isExecutorThread(); }) ? 0 : 1);
+    }
+
+    int status;
+    waitpid(pid, &status, 0);
+    ASSERT_TRUE(WIFEXITED(status));
+    EXPECT_EQ(WEXITSTATUS(status), 0);
+  }
+
+  int before = finished.load();
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  stop = true;
+  querying.join();
+
+  EXPECT_TRUE(executor.isEnabled());
+  EXPECT_GT(finished.load(), before);
+  EXPECT_TRUE(runOnSpiceExecutor([&]() { return executor.isExecutorThread(); }));
+  executor.setEnabled(false);
+}
+
+
+TEST(UtilTests, testSpiceWorkerPool) {
+  SpiceWorkerPool pool(2);
+  EXPECT_EQ(pool.size(), 2);
+
+  // built in body codes don't need any kernels
+  std::vector<std::thread> threads;
+  std::atomic<int> matches = 0;
+  for (int t = 0; t < 4; t++) {
+    threads.emplace_back([&]() {
+      for (int i = 0; i < 25; i++) {
+        matches += pool.translateNameToCode("MARS", "", false) == 499;
+      }
+    });
+  }
+  for (auto &t : threads) {
+    t.join();
+  }
+  EXPECT_EQ(matches, 100);
+  EXPECT_EQ(pool.call("translateCodeToName", nlohmann::json::array({499, "", false})), "MARS");
+
+  // errors in the worker are rethrown in the caller
+  EXPECT_THROW(pool.translateNameToCode("NOT A BODY", "", false), std::invalid_argument);
+  EXPECT_THROW(pool.call("notAFunction", nlohmann::json::array()), std::invalid_argument);
+
+  // the same mission and day always prefer the same worker
+  size_t preferred = pool.getPreferredWorker("lro", 1000);
+  EXPECT_LT(preferred, pool.size());
+  EXPECT_EQ(pool.getPreferredWorker("lro", 2000), preferred);
+}
+
+
+namespace {
+  // adds a function routed like a query for a mission and time that says which worker ran it,
+  // optionally holding the worker until the test lets it go
+  class RoutingWorkerPool : public SpiceWorkerPool {
+    public:
+    struct Gate {
+      sem_t started;
+      sem_t release;
+    };
+
+    RoutingWorkerPool(size_t workers, Gate *gate) : SpiceWorkerPool(addProbe(workers, gate)) {}
+
+    private:
+    // runs before the base class forks the workers
+    static size_t addProbe(size_t workers, Gate *gate) {
+      addHandler("routingProbe", [gate](nlohmann::json &a) -> nlohmann::json {
+        if (a.at(2).get<bool>()) {
+          sem_post(&gate->started);
+          sem_wait(&gate->release);
+        }
+        return getpid();
+      }, 0, 1);
+      return workers;
+    }
+  };
+}
+
+
+TEST(UtilTests, testSpiceWorkerPoolRouting) {
+  // the gate is shared with the forked workers
+  void *mapped = mmap(NULL, sizeof(RoutingWorkerPool::Gate), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  ASSERT_NE(mapped, MAP_FAILED);
+  auto *gate = static_cast<RoutingWorkerPool::Gate *>(mapped);
+  sem_init(&gate->started, 1, 0);
+  sem_init(&gate->release, 1, 0);
+
+  {
+    RoutingWorkerPool pool(3, gate);
+    pid_t owner = pool.getWorkerPid(pool.getPreferredWorker("lro", 1000));
+    auto probe = [&](bool hold) -> pid_t {
+      return pool.call("routingProbe", nlohmann::json::array({"lro", 1000, hold}));
+    };
+
+    // an idle owner gets every call for its key
+    for (int i = 0; i < 5; i++) {
+      EXPECT_EQ(probe(false), owner);
+    }
+
+    // while the owner is busy calls spill over to the same idle worker
+    std::thread busy([&]() {
+      EXPECT_EQ(probe(true), owner);
+    });
+    sem_wait(&gate->started);
+
+    pid_t spill = probe(false);
+    EXPECT_NE(spill, owner);
+    EXPECT_TRUE(spill == pool.getWorkerPid(0) || spill == pool.getWorkerPid(1) || spill == pool.getWorkerPid(2));
+    EXPECT_EQ(probe(false), spill);
+    sem_post(&gate->release);
+    busy.join();
+
+    // and go back to the owner once it is idle
+    EXPECT_EQ(probe(false), owner);
+  }
+
+  sem_destroy(&gate->started);
+  sem_destroy(&gate->release);
+  munmap(mapped, sizeof(RoutingWorkerPool::Gate));
+}
+
+
+TEST(UtilTests, testWriteMetaKernel) {
+  fs::path dir = fs::temp_directory_path() / ("spiceql-meta-" + gen_random(10));
+  std::string longPath = "/" + std::string(100, 'a') + "/it's.bc";
+
+  std::string meta = writeMetaKernel({"/kernels/a.bsp", longPath}, dir);
+  EXPECT_EQ(fs::path(meta).parent_path(), dir);
+  EXPECT_EQ(fs::path(meta).extension(), ".tm");
+  EXPECT_EQ(getKernelTypeFromHeader(meta), "META");
+
+  std::ifstream ifs(meta);
+  std::string content((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+  EXPECT_NE(content.find("KERNELS_TO_LOAD"), std::string::npos);
+  EXPECT_NE(content.find("'/kernels/a.bsp'"), std::string::npos);
+  EXPECT_NE(content.find("+'"), std::string::npos);
+  EXPECT_NE(content.find("it''s.bc'"), std::string::npos);
+
+  // same list, same file
+  EXPECT_EQ(writeMetaKernel({"/kernels/a.bsp", longPath}, dir), meta);
+  EXPECT_NE(writeMetaKernel({longPath, "/kernels/a.bsp"}, dir), meta);
+
+  fs::remove_all(dir);
+}
+
+
+TEST(UtilTests, testPruneMetaKernels) {
+  fs::path dir = fs::temp_directory_path() / ("spiceql-meta-" + gen_random(10));
+  std::vector<std::string> metas;
+  for (int i = 0; i < 5; i++) {
+    metas.push_back(writeMetaKernel({fmt::format("/kernels/{}.bsp", i)}, dir));
+    fs::last_write_time(metas.back(), fs::file_time_type::clock::now() - std::chrono::hours(5 - i));
+  }
+  std::ofstream((dir / "other.tm").string()) << "not a SpiceQL meta-kernel";
+
+  EXPECT_EQ(getMetaKernelLimit(), 256);
+  EXPECT_EQ(pruneMetaKernels(dir, 0), 0);
+
+  // the oldest go first, unless they are kept
+  EXPECT_EQ(pruneMetaKernels(dir, 2, {metas[0]}), 2);
+  EXPECT_TRUE(fs::exists(metas[0]));
+  EXPECT_FALSE(fs::exists(metas[1]));
+  EXPECT_FALSE(fs::exists(metas[2]));
+  EXPECT_TRUE(fs::exists(metas[3]));
+  EXPECT_TRUE(fs::exists(metas[4]));
+  EXPECT_TRUE(fs::exists(dir / "other.tm"));
+
+  // reusing a meta-kernel makes it the most recently used
+  writeMetaKernel({"/kernels/3.bsp"}, dir);
+  EXPECT_EQ(pruneMetaKernels(dir, 1), 2);
+  EXPECT_TRUE(fs::exists(metas[3]));
+
+  // meta-kernels another process may be about to furnish are left alone
+  std::string fresh = writeMetaKernel({"/kernels/fresh.bsp"}, dir);
+  EXPECT_EQ(pruneMetaKernels(dir, 1), 0);
+  EXPECT_TRUE(fs::exists(fresh));
+  EXPECT_TRUE(fs::exists(metas[3]));
+
+  // as are ones a kernel pool has locked
+  fs::last_write_time(fresh, fs::file_time_type::clock::now() - std::chrono::hours(1));
+  fs::last_write_time(metas[3], fs::file_time_type::clock::now() - std::chrono::hours(2));
+  int fd = open(metas[3].c_str(), O_RDONLY);
+  ASSERT_EQ(flock(fd, LOCK_SH), 0);
+  EXPECT_EQ(pruneMetaKernels(dir, 1), 0);
+  EXPECT_TRUE(fs::exists(metas[3]));
+  close(fd);
+  EXPECT_EQ(pruneMetaKernels(dir, 1), 1);
+  EXPECT_FALSE(fs::exists(metas[3]));
+  EXPECT_TRUE(fs::exists(fresh));
+
+  fs::remove_all(dir);
+}
+
+
+TEST(UtilTests, testGetCoverageHash) {
+  std::string coverage = R"({"a.bc":[[0.0,10.0]]})";
+  EXPECT_EQ(getCoverageHash(coverage), getCoverageHash(coverage));
+  EXPECT_EQ(getCoverageHash(coverage).size(), 16);
+  EXPECT_NE(getCoverageHash(coverage), getCoverageHash(R"({"a.bc":[[0.0,20.0]]})"));
+}
+
+
+TEST(UtilTests, testGetStoredBodyCoverage) {
+  std::string mission = "store" + gen_random(10);
+  fs::path kernel = fs::temp_directory_path() / ("spiceql-store-" + gen_random(10) + ".bsp");
+  std::ofstream(kernel.string()) << "DAF/SPK";
+  fs::path storePath = fs::path(Memo::getCacheDir()) / ("spiceql_coverage_" + mission + ".json");
+
+  struct stat info;
+  stat(kernel.c_str(), &info);
+  nlohmann::json entry = R"({"intervals" : [[0, 10]], "bodies" : {"-74" : {"intervals" : [[0, 10]], "centers" : [499]}}})"_json;
+  entry["size"] = static_cast<uintmax_t>(info.st_size);
+  entry["mtime"] = static_cast<int64_t>(fs::last_write_time(kernel).time_since_epoch().count());
+  entry["inode"] = static_cast<uintmax_t>(info.st_ino);
+  entry["ckLevel"] = getCkCoverageLevel();
+  entry["ckTolerance"] = getCkCoverageTolerance();
+
+  // no store yet
+  EXPECT_TRUE(getStoredBodyCoverage(mission, {kernel.string()}).empty());
+
+  nlohmann::json store;
+  store[kernel.string()] = entry;
+  store["/missing.bsp"] = entry;
+  std::ofstream(storePath.string()) << store.dump();
+
+  nlohmann::json res = getStoredBodyCoverage(mission, {kernel.string(), "/missing.bsp", "/other.bsp"});
+  EXPECT_EQ(res.size(), 1);
+  EXPECT_EQ(res[kernel.string()], entry["bodies"]);
+
+  // a kernel that changed since the store was written isn't used
+  std::ofstream(kernel.string(), std::ios::app) << "changed";
+  EXPECT_TRUE(getStoredBodyCoverage(mission, {kernel.string()}).empty());
+
+  fs::remove(kernel);
+  fs::remove(storePath);
+}
+
+
+TEST(UtilTests, testPrefetchKernels) {
+  EXPECT_EQ(getPrefetchThreads(), 0);
+  setenv("SPICEQL_PREFETCH_THREADS", "4", true);
+  EXPECT_EQ(getPrefetchThreads(), 4);
+  setenv("SPICEQL_PREFETCH_THREADS", "many", true);
+  EXPECT_EQ(getPrefetchThreads(), 0);
+  unsetenv("SPICEQL_PREFETCH_THREADS");
+
+  fs::path dir = fs::temp_directory_path() / ("spiceql-prefetch-" + gen_random(10));
+  fs::create_directories(dir);
+  std::vector<std::string> kernels;
+  for (int i = 0; i < 8; i++) {
+    std::ofstream((dir / fmt::format("{}.bsp", i)).string()) << std::string(4096, 'a');
+    kernels.push_back((dir / fmt::format("{}.bsp", i)).string());
+  }
+
+  // every kernel is closed after it is advised, missing kernels are skipped
+  auto openFiles = []() { return std::distance(fs::directory_iterator("/proc/self/fd"), fs::directory_iterator()); };
+  auto before = openFiles();
+  kernels.push_back((dir / "missing.bsp").string());
+  EXPECT_NO_THROW(prefetchKernels(kernels, 4));
+  EXPECT_NO_THROW(prefetchKernels({}, 4));
+  EXPECT_EQ(openFiles(), before);
+
+  // every prefetch shares the same threads
+  auto threadCount = []() { return std::distance(fs::directory_iterator("/proc/self/task"), fs::directory_iterator()); };
+  auto threads = threadCount();
+  for (int i = 0; i < 10; i++) {
+    prefetchKernels(kernels, 4);
+  }
+  EXPECT_EQ(threadCount(), threads);
+
+  // async prefetches are handed to the background thread
+  auto start = high_resolution_clock::now();
+  for (int i = 0; i < 100; i++) {
+    prefetchKernels(kernels, 4, true);
+  }
+  EXPECT_LT(duration_cast<milliseconds>(high_resolution_clock::now() - start).count(), 100);
+
+  // and the kernel files it opens are closed when it is done
+  for (int i = 0; i < 100 && openFiles() != before; i++) {
+    std::this_thread::sleep_for(milliseconds(10));
+  }
+  EXPECT_EQ(openFiles(), before);
+
+  fs::remove_all(dir);
+}
+
+
+TEST(UtilTests, testParallelForEach) {
+  std::vector<std::atomic<int>> seen(1000);
+  parallelForEach(seen.size(), 4, [&](size_t i) {
+    seen[i]++;
+  });
+  EXPECT_TRUE(std::all_of(seen.begin(), seen.end(), [](std::atomic<int> &s) { return s == 1; }));
+
+  EXPECT_THROW(parallelForEach(100, 4, [](size_t i) {
+    if (i == 42) {
+      throw std::runtime_error("task failed");
+    }
+  }), std::runtime_error);
+}
+
+
+TEST(UtilTests, testGetKernelTypeFromHeader) {
+  fs::path temp = fs::temp_directory_path() / SpiceQL::gen_random(10); 
+  fs::create_directories(temp);
+
+  std::map<std::string, std::string> headers = {
+    {"test.bsp", std::string("DAF/SPK ") + std::string(1016, '\0')},
+    {"test.bc", std::string("DAF/CK  ") + std::string(1016, '\0')},
+    {"test.bds", std::string("DAS/DSK ") + std::string(1016, '\0')},
+    {"test.tf", "KPL/FK\n\n\\begindata\n"},
+    {"test.tm", "KPL/MK\r\n"},
+    {"test.txt", "not a kernel"},
+    {"short", "KP"}
+  };
+
+  for (auto &[name, contents] : headers) {
+    std::ofstream ofs((temp/name).string(), std::ios::binary);
+    ofs << contents;
+  }
+
+  EXPECT_EQ(getKernelTypeFromHeader(temp/"test.bsp"), "SPK");
+  EXPECT_EQ(getKernelTypeFromHeader(temp/"test.bc"), "CK");
+  EXPECT_EQ(getKernelTypeFromHeader(temp/"test.bds"), "DSK");
+  EXPECT_EQ(getKernelTypeFromHeader(temp/"test.tf"), "TEXT");
+  EXPECT_EQ(getKernelTypeFromHeader(temp/"test.tm"), "META");
+  EXPECT_EQ(getKernelTypeFromHeader(temp/"test.txt"), "");
+  EXPECT_EQ(getKernelTypeFromHeader(temp/"short"), "");
+  EXPECT_EQ(getKernelTypeFromHeader("data/naif0012.tls"), "TEXT");
+
+  std::map<std::string, std::string> types = getKernelTypes(temp, false);
+  EXPECT_EQ(types.size(), 5);
+  EXPECT_EQ(types[(temp/"test.bc").string()], "CK");
+  EXPECT_FALSE(types.count((temp/"test.txt").string()));
+}
+
+
 TEST(UtilTests, testJson2DArrayTo2DVector) { 
   nlohmann::json arrays = R"({
       "2D Array" : [["1.bc", "2.bc", "3.bc"], ["1.bc", "2.bc"]],
@@ -0,0 +1,12 @@
+%module(package="pyspiceql") daf
+
+%{
+  #include "daf.h"
+%}
+
+%include "daf.h"
+
+namespace std {
+  %template(DafSegmentVector) vector<SpiceQL::DafSegment>;
+  %template(IntPairDoubleVectorMap) map<int, vector<pair<double, double>>>;
+}
\ No newline at end of file
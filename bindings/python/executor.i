@@ -0,0 +1,11 @@
+%module(package="pyspiceql") executor
+
+%{
+  #include "executor.h"
+%}
+
+%ignore SpiceQL::SpiceExecutor::submit;
+%ignore SpiceQL::SpiceExecutor::run;
+%ignore SpiceQL::runOnSpiceExecutor;
+
+%include "executor.h"
@@ -0,0 +1,9 @@
+%module(package="pyspiceql") fork
+
+%{
+  #include "fork.h"
+%}
+
+%ignore SpiceQL::forkProcess;
+
+%include "fork.h"
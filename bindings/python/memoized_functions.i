@@ -7,7 +7,10 @@
 
 %rename(Memo_ls) SpiceQL::Memo::ls;
 %rename(Memo_getTimeIntervals) SpiceQL::Memo::getTimeIntervals;
+%rename(Memo_getBodyCoverage) SpiceQL::Memo::getBodyCoverage;
 %rename(Memo_globTimeIntervals) SpiceQL::Memo::globTimeIntervals;
 %rename(Memo_getPathsFromRegex) SpiceQL::Memo::getPathsFromRegex;
+%rename(Memo_getPathsFromRegexGroups) SpiceQL::Memo::getPathsFromRegexGroups;
+%rename(Memo_getKernelTypes) SpiceQL::Memo::getKernelTypes;
 
 %include "memoized_functions.h"
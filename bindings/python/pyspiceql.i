@@ -6,6 +6,7 @@
 %include "std_map.i"
 %include "carrays.i"
 %include "std_pair.i"
+%include "stdint.i"
 
 #include <nlohmann/json.hpp>
 
@@ -47,8 +48,13 @@ namespace std {
   %template(VectorIntVector) vector< vector<int> >;
   %template(StringVector) vector<string>;
   %template(VectorStringVector) vector< vector<string> >;
+  %template(VectorVectorStringVector) vector< vector< vector<string> > >;
   %template(ConstCharVector) vector<const char*>;
   %template(PairDoubleVector) vector<pair<double, double>>;
+  %template(StringBoolPair) pair<string, bool>;
+  %template(StringStringPair) pair<string, string>;
+  %template(PairStringVector) vector<pair<string, string>>;
+  %template(StringStringMap) map<string, string>;
   %template(DoubleArray6) array<double, 6>;
 }
 
@@ -63,8 +69,12 @@ namespace std {
 }
 
 %include "config.i"
+%include "daf.i"
+%include "executor.i"
+%include "fork.i"
 %include "io.i"
 %include "query.i"
 %include "spice_types.i"
 %include "utils.i"
+%include "workers.i"
 %include "memoized_functions.i"
\ No newline at end of file
@@ -1,5 +1,6 @@
 import pytest
-from pyspiceql import getMissionConfig, Config, getKernelStringValue
+from concurrent.futures import ThreadPoolExecutor
+from pyspiceql import getMissionConfig, Config, getKernelStringValue, SpiceWorkerPool
 
 def test_jsonConversion():
     lro_config = getMissionConfig('lro')
@@ -14,3 +15,10 @@ def test_config():
 def test_exception():
     with pytest.raises(RuntimeError):
         getKernelStringValue("bad_terrible_no_good_key")
+
+def test_workerPoolConcurrentCalls():
+    # calls wait on their worker without the GIL, so threads share the pool
+    pool = SpiceWorkerPool(2)
+    with ThreadPoolExecutor(max_workers=4) as executor:
+        codes = list(executor.map(lambda i: pool.translateNameToCode("MARS", "", False), range(32)))
+    assert codes == [499] * 32
@@ -4,4 +4,6 @@
   #include "utils.h"
 %}
 
+%ignore SpiceQL::parallelForEach;
+
 %include "utils.h"
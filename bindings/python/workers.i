@@ -0,0 +1,34 @@
+%module(package="pyspiceql") workers
+
+%{
+  #include "workers.h"
+%}
+
+// calls block until a worker replies, so they let other Python threads run in the meantime.
+// The GIL is taken back before an exception is turned into a Python error
+%define %spiceql_release_gil(method)
+%exception method {
+  PyThreadState *threadState = PyEval_SaveThread();
+  try {
+    $action
+  } catch (std::exception const& e) {
+    PyEval_RestoreThread(threadState);
+    SWIG_exception(SWIG_RuntimeError, (std::string("std::exception: ") + e.what()).c_str());
+  } catch (...) {
+    PyEval_RestoreThread(threadState);
+    SWIG_exception(SWIG_UnknownError, "Unknown error");
+  }
+  PyEval_RestoreThread(threadState);
+}
+%enddef
+
+%spiceql_release_gil(SpiceQL::SpiceWorkerPool::call)
+%spiceql_release_gil(SpiceQL::SpiceWorkerPool::getTargetStates)
+%spiceql_release_gil(SpiceQL::SpiceWorkerPool::getTargetOrientations)
+%spiceql_release_gil(SpiceQL::SpiceWorkerPool::frameTrace)
+%spiceql_release_gil(SpiceQL::SpiceWorkerPool::translateNameToCode)
+%spiceql_release_gil(SpiceQL::SpiceWorkerPool::translateCodeToName)
+%spiceql_release_gil(SpiceQL::SpiceWorkerPool::utcToEt)
+%spiceql_release_gil(SpiceQL::SpiceWorkerPool::etToUtc)
+
+%include "workers.h"